@@ -0,0 +1,414 @@
+//
+// Created by agent on 18/10/26.
+//
+
+#include "TaskSystem.h"
+#include "TaskSystemAlgorithms.h"
+#include "TaskSystemStatic.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+/****************************************************************
+ *  FAN-IN GRAPH
+ ****************************************************************/
+
+/**
+ * Counters of the producers packed next to each other, as the dependency counters were before the padding
+ */
+struct UnpaddedCounter{
+    std::atomic<unsigned long> value;
+};
+
+/**
+ * Counters of the producers each on its own cache line, as the scheduling state of a Task
+ */
+struct alignas(PThreadPool::CACHE_LINE_SIZE) PaddedCounter{
+    std::atomic<unsigned long> value;
+};
+
+/**
+ * Producer of a fan-in graph; the counter is updated by the worker that runs the task
+ * while the counters of the neighbour producers are updated by other workers
+ */
+class ProducerTask : public TaskSystem::TaskSystem::Task{
+public:
+    unsigned long seed;
+    unsigned long result;
+    std::atomic<unsigned long>* counter;
+
+    ProducerTask() : seed(0), result(0), counter(nullptr) {}
+};
+
+class SinkTask : public TaskSystem::TaskSystem::Task{
+public:
+    std::vector<ProducerTask>* producers;
+    unsigned long total;
+
+    SinkTask() : producers(nullptr), total(0) {}
+};
+
+/**
+ * Execute a graph of numProducers small tasks that all converge in a single sink task,
+ * every producer updates its own counter of the given layout
+ * @return The average time of an execution in microseconds
+ */
+template <typename Counter>
+double benchmarkFanIn(TaskSystem::TaskSystem* taskSystem, unsigned int numProducers, unsigned int numRuns){
+    std::vector<Counter> counters(numProducers);
+    std::vector<ProducerTask> producers(numProducers);
+    SinkTask sink;
+    TaskSystem::TaskSystem::TaskGraph taskGraph;
+
+    sink.producers = &producers;
+    sink.setExecute([](void* args){
+        SinkTask* context = (SinkTask*) args;
+
+        for (std::vector<ProducerTask>::iterator it = context->producers->begin(); it != context->producers->end(); it++) {
+            context->total += it->result;
+        }
+    });
+
+    taskGraph.addTask(&sink);
+
+    for (unsigned int i = 0; i < numProducers; ++i) {
+        counters[i].value.store(0, std::memory_order_relaxed);
+
+        producers[i].seed = i;
+        producers[i].counter = &counters[i].value;
+        producers[i].setExecute([](void* args){
+            ProducerTask* context = (ProducerTask*) args;
+
+            for (int j = 0; j < 64; ++j) {
+                context->counter->fetch_add(context->seed + j, std::memory_order_relaxed);
+            }
+
+            context->result = context->counter->load(std::memory_order_relaxed);
+        });
+
+        taskGraph.addTask(&producers[i]);
+        producers[i].addDependencyTo(&sink);
+    }
+
+    //Warm up
+    taskSystem->executeTaskGraph(&taskGraph);
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    for (unsigned int i = 0; i < numRuns; ++i) {
+        taskSystem->executeTaskGraph(&taskGraph);
+    }
+
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+
+    return std::chrono::duration<double, std::micro>(end - start).count() / numRuns;
+}
+
+/****************************************************************
+ *  DATA-PARALLEL MAP
+ ****************************************************************/
+
+/**
+ * Arrays of a float-add, c = a + b, or of a saxpy, c = alpha * a + b
+ */
+struct MapArrays{
+    float* a;
+    float* b;
+    float* c;
+    float alpha;
+};
+
+void floatAddScalar(long begin, long end, void* args){
+    MapArrays* arrays = (MapArrays*) args;
+
+    for (long i = begin; i < end; ++i) {
+        arrays->c[i] = arrays->a[i] + arrays->b[i];
+    }
+}
+
+void saxpyScalar(long begin, long end, void* args){
+    MapArrays* arrays = (MapArrays*) args;
+
+    for (long i = begin; i < end; ++i) {
+        arrays->c[i] = arrays->alpha * arrays->a[i] + arrays->b[i];
+    }
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+
+/**
+ * AVX2 kernels; the chunks of parallelMap start on a cache line so only the
+ * elements after the last full vector of the array are left to the scalar loop
+ */
+__attribute__((target("avx2,fma")))
+void floatAddAVX2(long begin, long end, void* args){
+    MapArrays* arrays = (MapArrays*) args;
+    long i = begin;
+
+    for (; i + 8 <= end; i += 8) {
+        __m256 sum = _mm256_add_ps(_mm256_loadu_ps(arrays->a + i), _mm256_loadu_ps(arrays->b + i));
+        _mm256_storeu_ps(arrays->c + i, sum);
+    }
+
+    floatAddScalar(i, end, args);
+}
+
+__attribute__((target("avx2,fma")))
+void saxpyAVX2(long begin, long end, void* args){
+    MapArrays* arrays = (MapArrays*) args;
+    __m256 alpha = _mm256_set1_ps(arrays->alpha);
+    long i = begin;
+
+    for (; i + 8 <= end; i += 8) {
+        __m256 result = _mm256_fmadd_ps(alpha, _mm256_loadu_ps(arrays->a + i), _mm256_loadu_ps(arrays->b + i));
+        _mm256_storeu_ps(arrays->c + i, result);
+    }
+
+    saxpyScalar(i, end, args);
+}
+
+#endif
+
+/**
+ * Compare a kernel executed by a single thread on the whole array with parallelMap
+ * @return The speedup of parallelMap
+ */
+double benchmarkMap(TaskSystem::TaskSystem* taskSystem, const char* name, void (*kernel)(long, long, void*),
+                    MapArrays* arrays, long size, unsigned int numRuns){
+    //Warm up
+    kernel(0, size, arrays);
+    taskSystem->parallelMap(arrays->a, sizeof(float), size, kernel, arrays);
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    for (unsigned int i = 0; i < numRuns; ++i) {
+        kernel(0, size, arrays);
+    }
+
+    std::chrono::steady_clock::time_point middle = std::chrono::steady_clock::now();
+
+    for (unsigned int i = 0; i < numRuns; ++i) {
+        taskSystem->parallelMap(arrays->a, sizeof(float), size, kernel, arrays);
+    }
+
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+
+    double singleTime = std::chrono::duration<double, std::micro>(middle - start).count() / numRuns;
+    double parallelTime = std::chrono::duration<double, std::micro>(end - middle).count() / numRuns;
+
+    std::cout << name << "  elements: " << size
+              << "  single thread: " << singleTime << " us"
+              << "  parallelMap: " << parallelTime << " us"
+              << "  speedup: " << singleTime / parallelTime << std::endl;
+
+    return singleTime / parallelTime;
+}
+
+/****************************************************************
+ *  PARALLEL SORT
+ ****************************************************************/
+
+/**
+ * Record of a batch sorted by key
+ */
+struct Record{
+    unsigned long key;
+    unsigned long payload[3];
+};
+
+/**
+ * Compare std::sort with parallelSort on a batch of random records
+ */
+void benchmarkSort(TaskSystem::TaskSystem* taskSystem, long size){
+    std::vector<Record> records(size);
+    unsigned long seed = 42;
+
+    for (long i = 0; i < size; ++i) {
+        seed = seed * 6364136223846793005ul + 1442695040888963407ul;
+        records[i].key = seed >> 16;
+        records[i].payload[0] = (unsigned long) i;
+    }
+
+    std::vector<Record> sorted(records);
+
+    auto byKey = [](const Record& a, const Record& b){
+        return a.key < b.key;
+    };
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::sort(sorted.begin(), sorted.end(), byKey);
+    std::chrono::steady_clock::time_point middle = std::chrono::steady_clock::now();
+    TaskSystem::parallelSort(taskSystem, records.begin(), records.end(), byKey);
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+
+    double singleTime = std::chrono::duration<double, std::milli>(middle - start).count();
+    double parallelTime = std::chrono::duration<double, std::milli>(end - middle).count();
+
+    std::cout << "sort  records: " << size
+              << "  std::sort: " << singleTime << " ms"
+              << "  parallelSort: " << parallelTime << " ms"
+              << "  speedup: " << singleTime / parallelTime << std::endl;
+}
+
+/****************************************************************
+ *  STATIC FORK/JOIN
+ ****************************************************************/
+
+/**
+ * Stages of a 5 stage fork/join: a source, three branches and a join
+ */
+struct ForkJoinContext{
+    unsigned long values[5];
+};
+
+inline void forkJoinStage(ForkJoinContext* context, int stage, unsigned long input){
+    unsigned long value = input;
+
+    for (int j = 0; j < 64; ++j) {
+        value = value * 31 + stage + j;
+    }
+
+    context->values[stage] = value;
+}
+
+void forkJoinSource(ForkJoinContext* context){
+    forkJoinStage(context, 0, 1);
+}
+
+template<int Stage>
+void forkJoinBranch(ForkJoinContext* context){
+    forkJoinStage(context, Stage, context->values[0]);
+}
+
+void forkJoinJoin(ForkJoinContext* context){
+    forkJoinStage(context, 4, context->values[1] + context->values[2] + context->values[3]);
+}
+
+typedef TaskSystem::StaticGraph<ForkJoinContext,
+        TaskSystem::StaticTask<forkJoinSource>,
+        TaskSystem::StaticTask<forkJoinBranch<1>, 0>,
+        TaskSystem::StaticTask<forkJoinBranch<2>, 0>,
+        TaskSystem::StaticTask<forkJoinBranch<3>, 0>,
+        TaskSystem::StaticTask<forkJoinJoin, 1, 2, 3>> StaticForkJoin;
+
+class ForkJoinTask : public TaskSystem::TaskSystem::Task{
+public:
+    ForkJoinContext* context;
+    void (*stage)(ForkJoinContext*);
+};
+
+/**
+ * Compare the execution of the same fork/join as a TaskGraph and as a StaticGraph
+ */
+void benchmarkForkJoin(TaskSystem::TaskSystem* taskSystem, unsigned int numRuns){
+    ForkJoinContext context = {};
+    ForkJoinTask tasks[5];
+    void (*stages[5])(ForkJoinContext*) = {forkJoinSource, forkJoinBranch<1>, forkJoinBranch<2>,
+                                          forkJoinBranch<3>, forkJoinJoin};
+    TaskSystem::TaskSystem::TaskGraph taskGraph;
+
+    for (int i = 0; i < 5; ++i) {
+        tasks[i].context = &context;
+        tasks[i].stage = stages[i];
+        tasks[i].setExecute([](void* args){
+            ForkJoinTask* task = (ForkJoinTask*) args;
+            task->stage(task->context);
+        });
+
+        taskGraph.addTask(&tasks[i]);
+    }
+
+    for (int i = 1; i < 4; ++i) {
+        tasks[0].addDependencyTo(&tasks[i]);
+        tasks[i].addDependencyTo(&tasks[4]);
+    }
+
+    //Warm up
+    taskSystem->executeTaskGraph(&taskGraph);
+    StaticForkJoin::execute(taskSystem, &context);
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    for (unsigned int i = 0; i < numRuns; ++i) {
+        taskSystem->executeTaskGraph(&taskGraph);
+    }
+
+    std::chrono::steady_clock::time_point middle = std::chrono::steady_clock::now();
+
+    for (unsigned int i = 0; i < numRuns; ++i) {
+        StaticForkJoin::execute(taskSystem, &context);
+    }
+
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+
+    double graphTime = std::chrono::duration<double, std::micro>(middle - start).count() / numRuns;
+    double staticTime = std::chrono::duration<double, std::micro>(end - middle).count() / numRuns;
+
+    std::cout << "fork/join  TaskGraph: " << graphTime << " us"
+              << "  StaticGraph: " << staticTime << " us"
+              << "  speedup: " << graphTime / staticTime << std::endl;
+}
+
+/**
+ * Usage: Benchmark [numWorkers] [numProducers] [numRuns] [arraySize]
+ */
+int main(int argc, char** argv){
+    unsigned int numWorkers = argc > 1 ? (unsigned int) atoi(argv[1]) : std::thread::hardware_concurrency();
+    unsigned int numProducers = argc > 2 ? (unsigned int) atoi(argv[2]) : 4096;
+    unsigned int numRuns = argc > 3 ? (unsigned int) atoi(argv[3]) : 50;
+    long arraySize = argc > 4 ? atol(argv[4]) : 1 << 24;
+
+    TaskSystem::TaskSystem taskSystem(numWorkers);
+
+    double unpaddedTime = benchmarkFanIn<UnpaddedCounter>(&taskSystem, numProducers, numRuns);
+    double paddedTime = benchmarkFanIn<PaddedCounter>(&taskSystem, numProducers, numRuns);
+
+    std::cout << "fan-in  workers: " << numWorkers
+              << "  producers: " << numProducers
+              << "  unpadded run: " << unpaddedTime << " us"
+              << "  task: " << unpaddedTime * 1000 / numProducers << " ns"
+              << "  padded run: " << paddedTime << " us"
+              << "  task: " << paddedTime * 1000 / numProducers << " ns" << std::endl;
+
+    benchmarkForkJoin(&taskSystem, numRuns * 1000);
+
+    MapArrays arrays;
+    arrays.a = (float*) aligned_alloc(PThreadPool::CACHE_LINE_SIZE, (arraySize * sizeof(float) + 63) / 64 * 64);
+    arrays.b = (float*) aligned_alloc(PThreadPool::CACHE_LINE_SIZE, (arraySize * sizeof(float) + 63) / 64 * 64);
+    arrays.c = (float*) aligned_alloc(PThreadPool::CACHE_LINE_SIZE, (arraySize * sizeof(float) + 63) / 64 * 64);
+    arrays.alpha = 2.5f;
+
+    for (long i = 0; i < arraySize; ++i) {
+        arrays.a[i] = (float) i;
+        arrays.b[i] = (float) (arraySize - i);
+    }
+
+    void (*floatAdd)(long, long, void*) = floatAddScalar;
+    void (*saxpy)(long, long, void*) = saxpyScalar;
+
+#if defined(__x86_64__) || defined(__i386__)
+    //The baseline is the single thread AVX2 kernel when the processor supports it
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+        floatAdd = floatAddAVX2;
+        saxpy = saxpyAVX2;
+    }
+#endif
+
+    benchmarkMap(&taskSystem, "float-add", floatAdd, &arrays, arraySize, numRuns);
+    benchmarkMap(&taskSystem, "saxpy    ", saxpy, &arrays, arraySize, numRuns);
+
+    free(arrays.a);
+    free(arrays.b);
+    free(arrays.c);
+
+    benchmarkSort(&taskSystem, arraySize / 4);
+
+    return 0;
+}
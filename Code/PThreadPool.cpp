@@ -4,29 +4,35 @@
 
 #include "PThreadPool.h"
 
+thread_local int PThreadPool::currentWorkerIndex = -1;
+
+thread_local PThreadPool* PThreadPool::currentPool = nullptr;
+
 void *PThreadPool::WorkerPThread::pthreadWorkerLoop(void* args) {
     WorkerPThread* worker = (WorkerPThread*) args;
 
+    currentWorkerIndex = (int) worker->index;
+    currentPool = worker->ownerPool;
+
     while(true){
         //Wait for a new function
         sem_wait( worker->newFunctionSemaphore );
 
         //Execute the new function
-        worker->func(worker->funcArgs);
+        worker->pending.func(worker->pending.funcArgs);
 
         //Call the callback if specified
-        if(worker->callback != nullptr)
-            worker->callback(worker->callbackArgs);
+        if(worker->pending.callback != nullptr)
+            worker->pending.callback(worker->pending.callbackArgs);
 
-        //Set this pthread as ready
-        worker->ownerPool->pushReadyQueue(worker);
-        sem_post(worker->ownerPool->poolSemaphore);
+        //Execute the pinned functions or set this pthread as ready
+        worker->ownerPool->completeFunction(worker);
     }
 
     return nullptr;
 }
 
-PThreadPool::WorkerPThread::WorkerPThread(PThreadPool *ownerPool) : ownerPool(ownerPool) {
+PThreadPool::WorkerPThread::WorkerPThread(PThreadPool *ownerPool, unsigned int index) : index(index), reserved(false), numPinned(0), ownerPool(ownerPool) {
     static pthread_mutex_t idMutex1 = PTHREAD_MUTEX_INITIALIZER;
     static int idCont1 = 0;
 
@@ -41,7 +47,9 @@ PThreadPool::WorkerPThread::WorkerPThread(PThreadPool *ownerPool) : ownerPool(ow
 }
 
 PThreadPool::WorkerPThread::~WorkerPThread(){
+    //The worker stops at its next wait for a function, join before releasing what it uses
     pthread_cancel(workerPthread);
+    pthread_join(workerPthread, nullptr);
 
     sem_close(newFunctionSemaphore);
 }
@@ -49,7 +57,14 @@ PThreadPool::WorkerPThread::~WorkerPThread(){
 
 PThreadPool::PThreadPool() : PThreadPool(std::thread::hardware_concurrency()){}
 
-PThreadPool::PThreadPool( unsigned int numWorkerThreads ) : numWorkerThreads(numWorkerThreads) {
+PThreadPool::PThreadPool(unsigned int numWorkerThreads) : PThreadPool(numWorkerThreads, 0){}
+
+PThreadPool::PThreadPool(unsigned int numWorkerThreads, unsigned int numReservedWorkers)
+        : numWorkerThreads(numWorkerThreads), numPinnedTotal(0), numHighWaiting(0), numNormalWaiting(0), highStreak(0) {
+    //The normal lane keeps at least one worker
+    PThreadPool::numReservedWorkers = numWorkerThreads > 0 && numReservedWorkers >= numWorkerThreads ?
+                                      numWorkerThreads - 1 : numReservedWorkers;
+
     static pthread_mutex_t idMutex2 = PTHREAD_MUTEX_INITIALIZER;
     static int idCont2 = 0;
 
@@ -57,21 +72,264 @@ PThreadPool::PThreadPool( unsigned int numWorkerThreads ) : numWorkerThreads(num
     semName = "poolSemaphore" + std::to_string(idCont2++);
     pthread_mutex_unlock(&idMutex2);
 
-    poolSemaphore = sem_open(semName.c_str(), O_CREAT , 0644, numWorkerThreads);
+    poolSemaphore = sem_open(semName.c_str(), O_CREAT , 0644, getNumSharedWorkers());
     sem_unlink(semName.c_str());
 
+    highSemaphore = sem_open((semName + "High").c_str(), O_CREAT , 0644, 0);
+    sem_unlink((semName + "High").c_str());
+
     queueMutex = PTHREAD_MUTEX_INITIALIZER;
 
+    numReadyMasks = (numWorkerThreads + 63) / 64;
+    readyMasks = new std::atomic<unsigned long>[numReadyMasks];
+
+    for (unsigned int i = 0; i < numReadyMasks; ++i) {
+        readyMasks[i].store(0, std::memory_order_relaxed);
+    }
+
     workers = new WorkerPThread*[numWorkerThreads];
 
-    for (int i = 0; i < numWorkerThreads; ++i) {
-        WorkerPThread* newWorker = new WorkerPThread(this);
+    for (unsigned int i = 0; i < numWorkerThreads; ++i) {
+        WorkerPThread* newWorker = new WorkerPThread(this, i);
         workers[i] = newWorker;
 
-        pushReadyQueue(newWorker);
+        if(i >= getNumSharedWorkers()){
+            newWorker->reserved = true;
+
+            pthread_mutex_lock(&queueMutex);
+            reservedReadyWorkers.push_back(newWorker);
+            pthread_mutex_unlock(&queueMutex);
+        }else{
+            pushReadyQueue(newWorker);
+        }
+    }
+}
+
+
+void PThreadPool::completeFunction(WorkerPThread *worker) {
+    if(worker->reserved || worker->numPinned.load(std::memory_order_relaxed) != 0 ||
+       numHighWaiting.load(std::memory_order_relaxed) != 0){
+        completeFunctionLocked(worker);
+        return;
+    }
+
+    highStreak.store(0, std::memory_order_relaxed);
+
+    pushReadyQueue(worker);
+    sem_post(poolSemaphore);
+
+    //A pinned function or a high submitter that arrived while the worker set itself as ready has seen it ready
+    //or is seen here; the two sides write their counter before reading the other one
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    if(numPinnedTotal.load(std::memory_order_relaxed) != 0 || numHighWaiting.load(std::memory_order_relaxed) != 0){
+        pthread_mutex_lock(&queueMutex);
+        rebalanceReadyWorkers();
+        pthread_mutex_unlock(&queueMutex);
+    }
+}
+
+void PThreadPool::completeFunctionLocked(WorkerPThread *worker) {
+    sem_t* semaphore;
+
+    pthread_mutex_lock(&queueMutex);
+
+    if(!worker->pinnedFunctions.empty()){
+        popPinnedFunction(worker);
+
+        semaphore = worker->newFunctionSemaphore;
+    }else if(numHighWaiting > 0 && (worker->reserved || numNormalWaiting == 0 || highStreak < HIGH_BURST)){
+        //The high lane goes first, a shared worker only for HIGH_BURST consecutive times while the normal lane waits
+        numHighWaiting--;
+        if(!worker->reserved)
+            highStreak++;
+
+        highReadyWorkers.push_back(worker);
+
+        //Posted with the mutex, a submitter that times out sees the worker handed to it before it leaves
+        sem_post(highSemaphore);
+        semaphore = nullptr;
+    }else if(worker->reserved){
+        reservedReadyWorkers.push_back(worker);
+        semaphore = nullptr;
+    }else{
+        highStreak = 0;
+
+        pushReadyQueue(worker);
+        semaphore = poolSemaphore;
+    }
+
+    pthread_mutex_unlock(&queueMutex);
+
+    if(semaphore != nullptr)
+        sem_post(semaphore);
+}
+
+void PThreadPool::rebalanceReadyWorkers() {
+    //The ready workers take their pinned functions; a busy one takes them when it completes
+    for (unsigned int i = 0; i < getNumSharedWorkers() && numPinnedTotal > 0; ++i) {
+        WorkerPThread* worker = workers[i];
+
+        if(worker->pinnedFunctions.empty() || sem_trywait(poolSemaphore) != 0)
+            continue;
+
+        if(tryClaimWorker(worker)){
+            popPinnedFunction(worker);
+            sem_post(worker->newFunctionSemaphore);
+        }else{
+            sem_post(poolSemaphore);
+        }
+    }
+
+    WorkerPThread* highWorker;
+
+    while(numHighWaiting > 0 && (highWorker = popHighReadyWorker()) != nullptr){
+        numHighWaiting--;
+
+        highReadyWorkers.push_back(highWorker);
+        sem_post(highSemaphore);
+    }
+}
+
+PThreadPool::WorkerPThread *PThreadPool::popHighReadyWorker() {
+    WorkerPThread* worker = nullptr;
+
+    if(!reservedReadyWorkers.empty()){
+        worker = reservedReadyWorkers.front();
+        reservedReadyWorkers.pop_front();
+    }else if((numNormalWaiting == 0 || highStreak < HIGH_BURST) && sem_trywait(poolSemaphore) == 0){
+        //A ready shared worker is taken before the normal submitters only within the burst
+        worker = popReadyQueue();
+        highStreak++;
+    }
+
+    return worker;
+}
+
+bool PThreadPool::tryExecuteFunction(void (*func)(void *), void *args, void (*callback)(void *), void *callbackArgs,
+                                     PThreadPool::Priority priority) {
+    if(priority == NORMAL)
+        return tryExecuteFunction(func, args, callback, callbackArgs);
+
+    pthread_mutex_lock(&queueMutex);
+    WorkerPThread* worker = popHighReadyWorker();
+    pthread_mutex_unlock(&queueMutex);
+
+    if(worker == nullptr)
+        return false;
+
+    worker->executeFunction(func, args, callback, callbackArgs);
+
+    return true;
+}
+
+PThreadPool::WorkerPThread *PThreadPool::takeHighWorker(const timespec *deadline) {
+    pthread_mutex_lock(&queueMutex);
+
+    WorkerPThread* worker = popHighReadyWorker();
+
+    if(worker == nullptr){
+        numHighWaiting++;
+
+        //A shared worker that set itself as ready without seeing the waiting submitter is seen here
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        if((worker = popHighReadyWorker()) != nullptr)
+            numHighWaiting--;
     }
+
+    pthread_mutex_unlock(&queueMutex);
+
+    if(worker != nullptr)
+        return worker;
+
+    int result;
+
+    if(deadline == nullptr)
+        while((result = sem_wait(highSemaphore)) != 0 && errno == EINTR);
+    else
+        while((result = sem_clockwait(highSemaphore, CLOCK_MONOTONIC, deadline)) != 0 && errno == EINTR);
+
+    pthread_mutex_lock(&queueMutex);
+
+    //A worker can be handed after the deadline and before the mutex is taken
+    if(result == 0 || sem_trywait(highSemaphore) == 0){
+        worker = highReadyWorkers.front();
+        highReadyWorkers.pop_front();
+    }else{
+        numHighWaiting--;
+    }
+
+    pthread_mutex_unlock(&queueMutex);
+
+    return worker;
 }
 
+void PThreadPool::waitIdle() {
+    //Every ready shared worker holds a unit of the pool semaphore
+    for (unsigned int i = 0; i < getNumSharedWorkers(); ++i) {
+        while(sem_wait(poolSemaphore) != 0 && errno == EINTR);
+    }
+
+    for (unsigned int i = 0; i < getNumSharedWorkers(); ++i) {
+        sem_post(poolSemaphore);
+    }
+
+    while(true){
+        pthread_mutex_lock(&queueMutex);
+        bool reservedIdle = reservedReadyWorkers.size() == numReservedWorkers;
+        pthread_mutex_unlock(&queueMutex);
+
+        if(reservedIdle)
+            return;
+
+        std::this_thread::yield();
+    }
+}
+
+bool PThreadPool::executeFunctionOn(unsigned int workerIndex, bool pinned, void (*func)(void *), void *args,
+                                    void (*callback)(void *), void *callbackArgs, const timespec *deadline) {
+    WorkerPThread* target = workers[workerIndex % getNumSharedWorkers()];
+
+    if(!waitReadyWorker(deadline))
+        return false;
+
+    WorkerPThread* worker;
+
+    if(tryClaimWorker(target)){
+        worker = target;
+    }else if(!pinned){
+        //The preferred worker is busy while an other one is ready, the function is executed by the first ready
+        worker = popReadyQueue();
+    }else{
+        //The pinned worker takes the function when it completes the current one, the ready worker stays ready
+        pthread_mutex_lock(&queueMutex);
+
+        target->pinnedFunctions.push_back({func, args, callback, callbackArgs});
+        target->numPinned.fetch_add(1, std::memory_order_relaxed);
+        numPinnedTotal.fetch_add(1, std::memory_order_relaxed);
+
+        //The worker can have set itself as ready without seeing the function
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        if(!tryClaimWorker(target)){
+            pthread_mutex_unlock(&queueMutex);
+            sem_post(poolSemaphore);
+            return true;
+        }
+
+        worker = target;
+        popPinnedFunction(worker);
+
+        pthread_mutex_unlock(&queueMutex);
+        sem_post(worker->newFunctionSemaphore);
+        return true;
+    }
+
+    worker->executeFunction(func, args, callback, callbackArgs);
+
+    return true;
+}
 
 PThreadPool::~PThreadPool() {
     if(workers == nullptr) return;
@@ -84,8 +342,12 @@ PThreadPool::~PThreadPool() {
     delete[] workers;
     workers = nullptr;
 
+    delete[] readyMasks;
+    readyMasks = nullptr;
+
 
     sem_close(poolSemaphore);
+    sem_close(highSemaphore);
 }
 
 
@@ -5,8 +5,14 @@
 #ifndef CODE_PTHREADPOOL_H
 #define CODE_PTHREADPOOL_H
 
+#include <atomic>
+#include <cerrno>
+#include <ctime>
+#include <deque>
 #include <queue>
+#include <string>
 #include <thread>
+#include <fcntl.h>
 #include <pthread.h>
 #include <semaphore.h>
 
@@ -14,40 +20,82 @@
  * Pool of PThread workers
  */
 class PThreadPool {
+public:
+    /**
+     * Size of a cache line, used to keep data written by different threads on different lines
+     */
+    static constexpr unsigned int CACHE_LINE_SIZE = 64;
+
+    /**
+     * Lane of a submitted function; a worker that completes its function goes first to the submitters
+     * waiting in the high lane, the normal lane is never starved by the high one
+     */
+    enum Priority {HIGH, NORMAL};
+
+    /**
+     * Maximum number of consecutive shared workers handed to the high lane,
+     * the next one is made ready for the normal lane even if high submitters are waiting
+     */
+    static constexpr unsigned int HIGH_BURST = 4;
+
 private:
     /**
      * PThread worker, execute one function at a time with the managed pthread
      */
-    class WorkerPThread{
+    class alignas(CACHE_LINE_SIZE) WorkerPThread{
     private:
+        friend class PThreadPool;
+
         /**
-         * The function to be executed
+         * Function to be executed, written by the submitter on its own cache line
+         * so that it does not invalidate the fields read by the worker
          */
-        void (*func)(void *);
+        struct alignas(CACHE_LINE_SIZE) PendingFunction{
+            /**
+             * The function to be executed
+             */
+            void (*func)(void *);
+
+            /**
+             * Args to call the function
+             */
+            void* funcArgs;
+
+            /**
+             * Called after the execution of the task
+             */
+            void (*callback)(void *);
+
+            /**
+             * Args for the execution of the callback
+             */
+            void* callbackArgs;
+        } pending;
 
         /**
-         * Args to call the function
+         * Semaphore that notify when a new function to be executed is ready
          */
-        void* funcArgs;
+        sem_t* newFunctionSemaphore;
 
         /**
-         * Called after the execution of the task
+         * Index of the worker in the pool
          */
-        void (*callback)(void *);
+        unsigned int index;
 
         /**
-         * Args for the execution of the callback
+         * True if the worker executes only the functions of the high lane
          */
-        void* callbackArgs;
+        bool reserved;
 
         /**
-         * Semaphore that notify when a new function to be executed is ready
+         * Functions pinned to this worker submitted while it was busy, protected by the queue mutex of the pool
          */
-        sem_t* newFunctionSemaphore;
+        std::deque<PendingFunction> pinnedFunctions;
 
-        /** Name of the semaphore
+        /**
+         * Size of pinnedFunctions, read without the mutex by the worker when it completes a function
          */
-        std::string semName;
+        std::atomic<unsigned int> numPinned;
 
         /**
          * Pool owner of the worker
@@ -59,6 +107,10 @@ private:
          */
         pthread_t workerPthread;
 
+        /** Name of the semaphore
+         */
+        std::string semName;
+
         /**
          * Loop of the worker
          * @return nullptr
@@ -66,7 +118,7 @@ private:
         static void* pthreadWorkerLoop(void* args);
 
     public:
-        WorkerPThread(PThreadPool *ownerPool);
+        WorkerPThread(PThreadPool *ownerPool, unsigned int index);
 
         virtual ~WorkerPThread();
 
@@ -75,24 +127,34 @@ private:
         }
 
         inline void executeFunction(void (*func)(void*),void* args,void (*callback)(void*),void* callbackArgs){
-            this->func = func;
-            this->funcArgs = args;
-            this->callback = callback;
-            this->callbackArgs = callbackArgs;
+            pending.func = func;
+            pending.funcArgs = args;
+            pending.callback = callback;
+            pending.callbackArgs = callbackArgs;
 
             sem_post(newFunctionSemaphore);
         }
     };
 
+    /**
+     * Index of the worker running on the current thread, -1 outside of the workers
+     */
+    static thread_local int currentWorkerIndex;
+
+    /**
+     * Pool of the worker running on the current thread, nullptr outside of the workers
+     */
+    static thread_local PThreadPool* currentPool;
+
     /**
      * Number of worker threads available
      */
     unsigned int numWorkerThreads;
 
     /**
-     * Queue of workers ready for a new function to be executed
+     * Number of workers reserved to the high lane, the last ones of the array
      */
-    std::queue<WorkerPThread*> readyWorkers;
+    unsigned int numReservedWorkers;
 
     /**
      * Array of created workers
@@ -100,14 +162,61 @@ private:
     WorkerPThread** workers;
 
     /**
-     * Mutex to synchronize the access to the queue
+     * Bitmask of the shared workers ready for a new function, bit i of word i / 64 for the worker i.
+     * A submitter claims a worker by clearing its bit after taking a unit of the pool semaphore,
+     * a worker sets its bit before giving the unit back, so the common path never takes a mutex
+     */
+    std::atomic<unsigned long>* readyMasks;
+
+    /**
+     * Number of words of readyMasks
+     */
+    unsigned int numReadyMasks;
+
+    /**
+     * Mutex of the pinned functions and of the high lane, on its own cache line
      */
-    pthread_mutex_t queueMutex;
+    alignas(CACHE_LINE_SIZE) pthread_mutex_t queueMutex;
+
+    /**
+     * Reserved workers ready for a function of the high lane
+     */
+    std::deque<WorkerPThread*> reservedReadyWorkers;
+
+    /**
+     * Workers handed by their completion to the submitters waiting in the high lane
+     */
+    std::deque<WorkerPThread*> highReadyWorkers;
+
+    /**
+     * Number of pinned functions of all the workers, written with the queue mutex
+     */
+    std::atomic<unsigned int> numPinnedTotal;
+
+    /**
+     * Number of submitters waiting in the high lane for a worker, written with the queue mutex
+     */
+    std::atomic<unsigned int> numHighWaiting;
+
+    /**
+     * Number of submitters blocked waiting for a worker of the normal lane
+     */
+    std::atomic<unsigned int> numNormalWaiting;
+
+    /**
+     * Consecutive shared workers handed to the high lane
+     */
+    std::atomic<unsigned int> highStreak;
 
     /**
      * Semaphore that manage the execution of new functions through the executeFunction method
      */
-    sem_t* poolSemaphore;
+    alignas(CACHE_LINE_SIZE) sem_t* poolSemaphore;
+
+    /**
+     * Semaphore that counts the workers handed to the submitters waiting in the high lane
+     */
+    sem_t* highSemaphore;
 
     /**
      * Name of the semaphore
@@ -115,32 +224,117 @@ private:
     std::string semName;
 
     /**
-     * Synchronized access to the queue
+     * Claim a ready shared worker, the caller must hold a unit of the pool semaphore
+     * so at least one bit is set or about to be set
      */
     inline WorkerPThread* popReadyQueue(){
-        pthread_mutex_lock(&queueMutex);
+        while(true){
+            for (unsigned int word = 0; word < numReadyMasks; ++word) {
+                unsigned long mask = readyMasks[word].load(std::memory_order_relaxed);
 
-        WorkerPThread* worker = readyWorkers.front();
-        readyWorkers.pop();
+                //The lowest ready worker is preferred, its cache is more likely to be warm
+                while(mask != 0){
+                    unsigned long bit = mask & -mask;
+
+                    mask = readyMasks[word].fetch_and(~bit, std::memory_order_acquire);
+
+                    if(mask & bit)
+                        return workers[word * 64 + __builtin_ctzl(bit)];
+                }
+            }
+        }
+    }
 
-        pthread_mutex_unlock(&queueMutex);
+    /**
+     * Claim the given worker if it is ready
+     */
+    inline bool tryClaimWorker(WorkerPThread* worker){
+        unsigned long bit = 1ul << (worker->index % 64);
 
-        return worker;
+        return readyMasks[worker->index / 64].fetch_and(~bit, std::memory_order_acquire) & bit;
     }
 
     inline void pushReadyQueue(WorkerPThread* worker){
-        pthread_mutex_lock(&queueMutex);
+        readyMasks[worker->index / 64].fetch_or(1ul << (worker->index % 64), std::memory_order_seq_cst);
+    }
+
+    /**
+     * Take a ready worker from the pool semaphore
+     * @param deadline Absolute time of CLOCK_MONOTONIC, nullptr to wait without a limit
+     * @return False if no worker has been ready before the deadline
+     */
+    inline bool waitReadyWorker(const timespec* deadline) {
+        if(sem_trywait(poolSemaphore) == 0)
+            return true;
+
+        //A blocked submitter limits the workers the high lane can take before it
+        numNormalWaiting.fetch_add(1, std::memory_order_relaxed);
+
+        int result;
 
-        readyWorkers.push(worker);
+        if(deadline == nullptr)
+            while((result = sem_wait(poolSemaphore)) != 0 && errno == EINTR);
+        else
+            while((result = sem_clockwait(poolSemaphore, CLOCK_MONOTONIC, deadline)) != 0 && errno == EINTR);
 
-        pthread_mutex_unlock(&queueMutex);
+        numNormalWaiting.fetch_sub(1, std::memory_order_relaxed);
+
+        return result == 0;
     }
 
+    /**
+     * Called by a worker after the execution of a function, give to the worker its pinned function
+     * or hand it to a lane
+     */
+    void completeFunction(WorkerPThread* worker);
+
+    /**
+     * Complete a function with the queue mutex when the worker has pinned functions, is reserved
+     * or high submitters are waiting
+     */
+    void completeFunctionLocked(WorkerPThread* worker);
+
+    /**
+     * Give the ready shared workers to their pinned functions and to the waiting high submitters
+     * that a worker did not see when it set itself as ready, called with the queue mutex locked
+     */
+    void rebalanceReadyWorkers();
+
+    /**
+     * Move the first pinned function of the worker to its pending function, called with the queue mutex locked
+     */
+    inline void popPinnedFunction(WorkerPThread* worker){
+        worker->pending = worker->pinnedFunctions.front();
+        worker->pinnedFunctions.pop_front();
+        worker->numPinned.fetch_sub(1, std::memory_order_relaxed);
+        numPinnedTotal.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    /**
+     * Take a worker for a function of the high lane: a ready reserved worker, a ready shared worker
+     * or the first worker that completes its function
+     * @param deadline Absolute time of CLOCK_MONOTONIC, nullptr to wait without a limit
+     * @return nullptr if no worker has been ready before the deadline
+     */
+    WorkerPThread* takeHighWorker(const timespec* deadline);
+
+    /**
+     * Take a ready worker for the high lane without waiting, called with the queue mutex locked
+     * @return nullptr if no worker can be taken
+     */
+    WorkerPThread* popHighReadyWorker();
+
 public:
 
     PThreadPool();
     PThreadPool(unsigned int numWorkerThreads);
 
+    /**
+     * @param numReservedWorkers Number of workers that execute only the functions of the high lane,
+     * at least one worker is always left to the normal lane
+     */
+    PThreadPool(unsigned int numWorkerThreads, unsigned int numReservedWorkers);
+
     virtual ~PThreadPool();
 
     /**
@@ -154,16 +348,116 @@ public:
     }
 
     inline void executeFunction(void (*func)(void*), void* args, void (*callback)(void*), void* callbackArgs) {
-        sem_wait(poolSemaphore);
+        waitReadyWorker(nullptr);
 
         WorkerPThread* worker = popReadyQueue();
 
         worker->executeFunction(func, args, callback, callbackArgs);
     }
 
+    /**
+     * Execute the function in the given lane, blocking until a worker of the lane is ready
+     */
+    inline void executeFunction(void (*func)(void*), void* args, void (*callback)(void*), void* callbackArgs,
+                                Priority priority) {
+        if(priority == NORMAL)
+            executeFunction(func, args, callback, callbackArgs);
+        else
+            takeHighWorker(nullptr)->executeFunction(func, args, callback, callbackArgs);
+    }
+
+    /**
+     * Execute the function if a worker is ready, without blocking
+     * @return True if the function has been given to a worker
+     */
+    inline bool tryExecuteFunction(void (*func)(void*), void* args, void (*callback)(void*), void* callbackArgs) {
+        if(sem_trywait(poolSemaphore) != 0)
+            return false;
+
+        WorkerPThread* worker = popReadyQueue();
+
+        worker->executeFunction(func, args, callback, callbackArgs);
+
+        return true;
+    }
+
+    /**
+     * Execute the function in the given lane if a worker of the lane is ready, without blocking
+     * @return True if the function has been given to a worker
+     */
+    bool tryExecuteFunction(void (*func)(void*), void* args, void (*callback)(void*), void* callbackArgs,
+                            Priority priority);
+
+    /**
+     * Execute the function like executeFunction, waiting for a ready worker at most until the deadline
+     * @param deadline Absolute time of CLOCK_MONOTONIC
+     * @return False if no worker has been ready before the deadline, the function has not been executed
+     */
+    inline bool executeFunctionUntil(const timespec* deadline, void (*func)(void*), void* args,
+                                     void (*callback)(void*), void* callbackArgs, Priority priority = NORMAL) {
+        WorkerPThread* worker;
+
+        if(priority == HIGH){
+            if((worker = takeHighWorker(deadline)) == nullptr)
+                return false;
+        }else{
+            if(!waitReadyWorker(deadline))
+                return false;
+
+            worker = popReadyQueue();
+        }
+
+        worker->executeFunction(func, args, callback, callbackArgs);
+
+        return true;
+    }
+
+    /**
+     * Execute the function preferably on the given worker; if the worker is busy the function is executed by
+     * any ready worker or, if pinned, queued to the worker and executed as soon as it completes its function.
+     * The call blocks until a worker is ready, like executeFunction
+     * @param workerIndex Index of the worker, modulo the number of shared workers
+     * @param pinned True to execute the function only on the given worker
+     * @param deadline Absolute time of CLOCK_MONOTONIC after which the call gives up, nullptr to wait without a limit
+     * @return False if no worker has been ready before the deadline, the function has not been executed
+     */
+    bool executeFunctionOn(unsigned int workerIndex, bool pinned, void (*func)(void*), void* args,
+                           void (*callback)(void*), void* callbackArgs, const timespec* deadline = nullptr);
+
+    /**
+     * Wait until every worker has completed its function and its pinned functions and is ready again;
+     * no function must be submitted during the wait
+     */
+    void waitIdle();
+
     inline unsigned int getNumWorkerThreads() {
         return numWorkerThreads;
     }
+
+    inline unsigned int getNumReservedWorkers() {
+        return numReservedWorkers;
+    }
+
+    /**
+     * @return The number of workers that execute the functions of the normal lane
+     */
+    inline unsigned int getNumSharedWorkers() {
+        return numWorkerThreads - numReservedWorkers;
+    }
+
+    /**
+     * @return The index in its pool of the worker running on the calling thread, -1 if the thread is not a worker
+     */
+    static inline int getCurrentWorkerIndex() {
+        return currentWorkerIndex;
+    }
+
+    /**
+     * @return The pool of the worker running on the calling thread, nullptr if the thread is not a worker
+     */
+    static inline PThreadPool* getCurrentPool() {
+        return currentPool;
+    }
 };
 
 
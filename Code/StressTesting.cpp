@@ -0,0 +1,512 @@
+//
+// Created by agent on 18/10/26.
+//
+
+#define BOOST_TEST_MODULE TaskSystemStressTesting
+
+#include <boost/test/included/unit_test.hpp>
+
+#include "TaskSystem.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <iostream>
+#include <random>
+#include <vector>
+
+/****************************************************************
+ *  RANDOM DAG GENERATOR
+ ****************************************************************/
+
+/**
+ * Global clock of the stress tasks, every task takes a timestamp when it starts and one when it ends
+ */
+std::atomic<unsigned long> stressClock(0);
+
+/**
+ * Task or graph of a generated DAG together with the elements of the same parent graph it depends on
+ */
+struct StressElement{
+    std::vector<StressElement*> predecessors;
+
+    /**
+     * Elements contained by a graph, empty for a task
+     */
+    std::vector<StressElement*> children;
+
+    /**
+     * Timestamps of the last execution, for a graph the first start and the last end of its children
+     */
+    unsigned long startTime;
+    unsigned long endTime;
+
+    StressElement() : startTime(0), endTime(0) {}
+};
+
+class StressTask : public TaskSystem::TaskSystem::Task{
+public:
+    StressElement element;
+
+    /**
+     * Number of executions of the task
+     */
+    unsigned long executions;
+
+    /**
+     * Iterations of the busy loop of the task, 0 for an empty task
+     */
+    unsigned int work;
+    unsigned long result;
+
+    StressTask() : executions(0), work(0), result(0) {
+        setExecute([](void* args){
+            StressTask* task = (StressTask*) args;
+
+            task->element.startTime = stressClock.fetch_add(1);
+
+            for (unsigned int i = 0; i < task->work; ++i) {
+                task->result = task->result * 31 + i;
+            }
+
+            task->executions++;
+            task->element.endTime = stressClock.fetch_add(1);
+        });
+    }
+};
+
+class StressGraph : public TaskSystem::TaskSystem::TaskGraph{
+public:
+    StressElement element;
+};
+
+/**
+ * Generator of random DAGs of StressTasks; the tasks and graphs are owned by the generator, the dependencies
+ * are added in topological order so every added dependency ends in an element with no successors yet
+ */
+class RandomDAG{
+public:
+    std::deque<StressTask> tasks;
+    std::deque<StressGraph> graphs;
+
+    std::mt19937_64 random;
+
+    /**
+     * Graph executed by the TaskSystem
+     */
+    StressGraph* root;
+
+    explicit RandomDAG(unsigned long seed) : random(seed) {
+        graphs.emplace_back();
+        root = &graphs.back();
+    }
+
+    StressTask* newTask(StressGraph* graph, unsigned int work){
+        tasks.emplace_back();
+
+        StressTask* task = &tasks.back();
+        task->work = work;
+
+        graph->addTask(task);
+        graph->element.children.push_back(&task->element);
+
+        return task;
+    }
+
+    StressGraph* newGraph(StressGraph* graph){
+        graphs.emplace_back();
+
+        StressGraph* subGraph = &graphs.back();
+
+        graph->addSubGraph(subGraph);
+        graph->element.children.push_back(&subGraph->element);
+
+        return subGraph;
+    }
+
+    template<typename From, typename To>
+    void addDependency(From* from, To* to){
+        from->addDependencyTo(to);
+        to->element.predecessors.push_back(&from->element);
+    }
+
+    /**
+     * Layers of width tasks, every task depends on degree random tasks of the previous layer
+     */
+    void layered(StressGraph* graph, unsigned int numLayers, unsigned int width, unsigned int degree){
+        std::vector<StressTask*> previous;
+        std::vector<StressTask*> current;
+
+        for (unsigned int layer = 0; layer < numLayers; ++layer) {
+            current.clear();
+
+            for (unsigned int i = 0; i < width; ++i) {
+                StressTask* task = newTask(graph, 0);
+
+                for (unsigned int j = 0; j < degree && !previous.empty(); ++j) {
+                    addDependency(previous[random() % previous.size()], task);
+                }
+
+                current.push_back(task);
+            }
+
+            previous.swap(current);
+        }
+    }
+
+    /**
+     * Random series-parallel composition of about numTasks tasks: a block is a single task,
+     * two blocks in sequence or up to maxBranches blocks between a fork and a join task
+     * @return The first and the last task of the block
+     */
+    std::pair<StressTask*, StressTask*> seriesParallel(StressGraph* graph, unsigned long numTasks, unsigned int maxBranches){
+        if (numTasks <= 1) {
+            StressTask* task = newTask(graph, 0);
+            return std::make_pair(task, task);
+        }
+
+        if (numTasks < 4 || random() % 2 == 0) {
+            unsigned long firstSize = 1 + random() % (numTasks - 1);
+
+            std::pair<StressTask*, StressTask*> first = seriesParallel(graph, firstSize, maxBranches);
+            std::pair<StressTask*, StressTask*> second = seriesParallel(graph, numTasks - firstSize, maxBranches);
+
+            addDependency(first.second, second.first);
+
+            return std::make_pair(first.first, second.second);
+        }
+
+        StressTask* fork = newTask(graph, 0);
+        unsigned long remaining = numTasks - 2;
+        unsigned int numBranches = (unsigned int) std::min<unsigned long>(2 + random() % (maxBranches - 1), remaining);
+        std::vector<StressTask*> lasts;
+
+        for (unsigned int i = 0; i < numBranches; ++i) {
+            unsigned long branchSize = i + 1 == numBranches ? remaining : 1 + random() % (remaining - (numBranches - i - 1));
+            remaining -= branchSize;
+
+            std::pair<StressTask*, StressTask*> branch = seriesParallel(graph, branchSize, maxBranches);
+            addDependency(fork, branch.first);
+            lasts.push_back(branch.second);
+        }
+
+        StressTask* join = newTask(graph, 0);
+        for (std::vector<StressTask*>::iterator it = lasts.begin(); it != lasts.end(); it++) {
+            addDependency(*it, join);
+        }
+
+        return std::make_pair(fork, join);
+    }
+
+    /**
+     * Every task depends on up to degree distinct random tasks among the window tasks created before it
+     */
+    void randomDAG(StressGraph* graph, unsigned long numTasks, unsigned int degree, unsigned long window){
+        std::vector<StressTask*> created;
+        std::vector<unsigned long> picked;
+
+        for (unsigned long i = 0; i < numTasks; ++i) {
+            StressTask* task = newTask(graph, 0);
+            unsigned long available = std::min(i, window);
+
+            picked.clear();
+
+            for (unsigned int j = 0; j < degree && j < available; ++j) {
+                unsigned long index = i - 1 - random() % available;
+
+                if (std::find(picked.begin(), picked.end(), index) == picked.end()) {
+                    picked.push_back(index);
+                    addDependency(created[index], task);
+                }
+            }
+
+            created.push_back(task);
+        }
+    }
+
+    /**
+     * Tree of subgraphs depth levels deep, every graph holds fanOut subgraphs and tasksPerGraph tasks
+     * with random dependencies among them
+     */
+    void nested(StressGraph* graph, unsigned int depth, unsigned int fanOut, unsigned int tasksPerGraph){
+        std::vector<StressElement*> created;
+        std::vector<StressTask*> createdTasks;
+        std::vector<StressGraph*> createdGraphs;
+
+        for (unsigned int i = 0; i < fanOut + tasksPerGraph; ++i) {
+            bool isGraph = depth > 0 && (createdGraphs.size() < fanOut &&
+                    (createdTasks.size() == tasksPerGraph || random() % 2 == 0));
+
+            if (isGraph) {
+                StressGraph* subGraph = newGraph(graph);
+
+                //The dependencies are added before the subgraph is filled so the cycle checks stay short
+                if (!createdTasks.empty() && random() % 2 == 0)
+                    addDependency(createdTasks[random() % createdTasks.size()], subGraph);
+                if (!createdGraphs.empty() && random() % 2 == 0)
+                    addDependency(createdGraphs[random() % createdGraphs.size()], subGraph);
+
+                nested(subGraph, depth - 1, fanOut, tasksPerGraph);
+
+                createdGraphs.push_back(subGraph);
+            } else if (createdTasks.size() < tasksPerGraph) {
+                StressTask* task = newTask(graph, 0);
+
+                if (!createdTasks.empty() && random() % 2 == 0)
+                    addDependency(createdTasks[random() % createdTasks.size()], task);
+                if (!createdGraphs.empty() && random() % 2 == 0)
+                    addDependency(createdGraphs[random() % createdGraphs.size()], task);
+
+                createdTasks.push_back(task);
+            }
+        }
+    }
+
+    /**
+     * Chain of depth subgraphs each nested in the previous one, every graph holds a task before its subgraph
+     */
+    void deepChain(StressGraph* graph, unsigned int depth){
+        for (unsigned int i = 0; i < depth; ++i) {
+            StressTask* task = newTask(graph, 0);
+            StressGraph* subGraph = newGraph(graph);
+
+            addDependency(task, subGraph);
+
+            graph = subGraph;
+        }
+
+        newTask(graph, 0);
+    }
+};
+
+/****************************************************************
+ *  VERIFICATION
+ ****************************************************************/
+
+/**
+ * Compute the first start and the last end of the graphs of the element
+ * @return False if the element or one of its children has no execution
+ */
+bool computeTimes(StressElement* element){
+    if (element->children.empty())
+        return true;
+
+    bool executed = true;
+    element->startTime = ~0ul;
+    element->endTime = 0;
+
+    for (std::vector<StressElement*>::iterator it = element->children.begin(); it != element->children.end(); it++) {
+        executed = computeTimes(*it) && executed;
+
+        element->startTime = std::min(element->startTime, (*it)->startTime);
+        element->endTime = std::max(element->endTime, (*it)->endTime);
+    }
+
+    return executed;
+}
+
+/**
+ * Check that every element started after the end of all its predecessors
+ * @return The number of violated dependencies
+ */
+unsigned long countViolations(StressElement* element){
+    unsigned long violations = 0;
+
+    for (std::vector<StressElement*>::iterator it = element->predecessors.begin(); it != element->predecessors.end(); it++) {
+        if ((*it)->endTime >= element->startTime)
+            violations++;
+    }
+
+    for (std::vector<StressElement*>::iterator it = element->children.begin(); it != element->children.end(); it++) {
+        violations += countViolations(*it);
+    }
+
+    return violations;
+}
+
+/**
+ * Execute the root graph numRuns times checking after each run that every task has been executed once
+ * and that no dependency has been violated, then print the throughput of the executions
+ */
+void stressExecute(const char* name, RandomDAG* dag, unsigned int numWorkers, unsigned int numRuns,
+                   std::chrono::steady_clock::time_point buildStart){
+    TaskSystem::TaskSystem taskSystem(numWorkers);
+
+    std::chrono::steady_clock::time_point buildEnd = std::chrono::steady_clock::now();
+    double executionTime = 0;
+
+    for (unsigned int run = 1; run <= numRuns; ++run) {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        taskSystem.executeTaskGraph(dag->root);
+        std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+
+        //The first execution also compiles the plan
+        if (run > 1 || numRuns == 1)
+            executionTime += std::chrono::duration<double>(end - start).count();
+
+        unsigned long missed = 0;
+        for (std::deque<StressTask>::iterator it = dag->tasks.begin(); it != dag->tasks.end(); it++) {
+            if (it->executions != run)
+                missed++;
+        }
+
+        BOOST_TEST(missed == 0);
+        BOOST_TEST(computeTimes(&dag->root->element));
+        BOOST_TEST(countViolations(&dag->root->element) == 0);
+    }
+
+    unsigned int timedRuns = numRuns > 1 ? numRuns - 1 : 1;
+
+    std::cout << name << "  tasks: " << dag->tasks.size()
+              << "  graphs: " << dag->graphs.size()
+              << "  build: " << std::chrono::duration<double, std::milli>(buildEnd - buildStart).count() << " ms"
+              << "  run: " << executionTime * 1000 / timedRuns << " ms"
+              << "  throughput: " << dag->tasks.size() * timedRuns / executionTime << " tasks/s" << std::endl;
+}
+
+/****************************************************************
+ *  STRESS TESTS
+ ****************************************************************/
+
+/**
+ * Test that a layered graph of 10^5 tasks, each depending on tasks of the previous layer, respects its dependencies
+ */
+BOOST_AUTO_TEST_CASE(test_case_stress_layered){
+    try {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        RandomDAG dag(1);
+
+        dag.layered(dag.root, 100, 1000, 3);
+
+        stressExecute("layered        ", &dag, 4, 4, start);
+
+    }catch(std::exception& exe){
+        BOOST_TEST(false);
+    }
+}
+
+/**
+ * Test that a random series-parallel graph of 10^5 tasks respects its dependencies
+ */
+BOOST_AUTO_TEST_CASE(test_case_stress_series_parallel){
+    try {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        RandomDAG dag(2);
+
+        dag.seriesParallel(dag.root, 100000, 8);
+
+        stressExecute("series-parallel", &dag, 4, 4, start);
+
+    }catch(std::exception& exe){
+        BOOST_TEST(false);
+    }
+}
+
+/**
+ * Test that a random sparse graph of 10^5 tasks with dependencies among distant tasks respects them
+ */
+BOOST_AUTO_TEST_CASE(test_case_stress_random_sparse){
+    try {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        RandomDAG dag(3);
+
+        dag.randomDAG(dag.root, 100000, 2, 10000);
+
+        stressExecute("random sparse  ", &dag, 4, 4, start);
+
+    }catch(std::exception& exe){
+        BOOST_TEST(false);
+    }
+}
+
+/**
+ * Test that a random dense graph of 10^5 tasks with many dependencies for each task respects them
+ */
+BOOST_AUTO_TEST_CASE(test_case_stress_random_dense){
+    try {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        RandomDAG dag(4);
+
+        dag.randomDAG(dag.root, 100000, 16, 64);
+
+        stressExecute("random dense   ", &dag, 4, 4, start);
+
+    }catch(std::exception& exe){
+        BOOST_TEST(false);
+    }
+}
+
+/**
+ * Test that a tree of nested subgraphs with dependencies between tasks and graphs at every level respects them
+ */
+BOOST_AUTO_TEST_CASE(test_case_stress_nested){
+    try {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        RandomDAG dag(5);
+
+        dag.nested(dag.root, 7, 4, 6);
+
+        stressExecute("nested         ", &dag, 4, 4, start);
+
+    }catch(std::exception& exe){
+        BOOST_TEST(false);
+    }
+}
+
+/**
+ * Test that a chain of subgraphs nested a thousand levels deep is executed in order
+ */
+BOOST_AUTO_TEST_CASE(test_case_stress_deep_nesting){
+    try {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        RandomDAG dag(6);
+
+        dag.deepChain(dag.root, 1000);
+
+        stressExecute("deep nesting   ", &dag, 4, 4, start);
+
+    }catch(std::exception& exe){
+        BOOST_TEST(false);
+    }
+}
+
+/**
+ * Test that a layered graph of 10^6 tasks respects its dependencies while the plan is profiled and
+ * the tasks keep the worker of their predecessors
+ */
+BOOST_AUTO_TEST_CASE(test_case_stress_million){
+    try {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        RandomDAG dag(7);
+
+        dag.layered(dag.root, 1000, 1000, 2);
+        dag.root->setProfiling(true);
+        dag.root->setAffinity(true);
+
+        stressExecute("million        ", &dag, 4, 2, start);
+
+    }catch(std::exception& exe){
+        BOOST_TEST(false);
+    }
+}
+
+/**
+ * Test the graph of 10^6 tasks with its plan allocated from huge pages and prefaulted at compile time
+ */
+BOOST_AUTO_TEST_CASE(test_case_stress_million_huge_pages){
+    try {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        RandomDAG dag(7);
+
+        dag.layered(dag.root, 1000, 1000, 2);
+        dag.root->setProfiling(true);
+        dag.root->setAffinity(true);
+        dag.root->setHugePages(true);
+
+        stressExecute("million huge   ", &dag, 4, 2, start);
+
+    }catch(std::exception& exe){
+        BOOST_TEST(false);
+    }
+}
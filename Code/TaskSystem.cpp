@@ -2,12 +2,21 @@
 // Created by Marco on 28/07/18.
 //
 
+#include <algorithm>
+#include <climits>
+#include <chrono>
+#include <cxxabi.h>
 #include <iostream>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
 #include "TaskSystem.h"
 
 
 namespace TaskSystem {
 
+    thread_local TaskSystem::ExecutionPlan *TaskSystem::currentPlan = nullptr;
+
     void TaskSystem::TaskElement::setParentGraph(TaskSystem::TaskGraph *taskGraph) {
         parentGraph = taskGraph;
     }
@@ -20,8 +29,11 @@ namespace TaskSystem {
 
     TaskSystem::Task::Task(bool dummy) : dummy(dummy) {
         parentGraph = nullptr;
-
-        dependencyMutex = PTHREAD_MUTEX_INITIALIZER;
+        costHint = 0;
+        pinnedWorker = -1;
+        deadline = 0;
+        statistics = nullptr;
+        event = nullptr;
 
         execute = [](void*){};
 
@@ -41,41 +53,62 @@ namespace TaskSystem {
     TaskSystem::Task::addDependencyBetween(TaskSystem::Task *taskStart,
                                                        TaskSystem::Task *taskEnd) {
 
-        TaskDependency *newDependency = new TaskDependency(taskStart, taskEnd);
+        TaskDependency *newDependency;
+
+        if (taskStart->getParentGraph() != nullptr)
+            newDependency = taskStart->getParentGraph()->newDependency(taskStart, taskEnd);
+        else
+            newDependency = new TaskDependency(taskStart, taskEnd, nullptr);
 
         taskStart->toTask.emplace_back(newDependency);
         taskEnd->fromTask.emplace_back(newDependency);
 
+        taskStart->invalidatePlans();
+        taskEnd->invalidatePlans();
+
         return newDependency;
     }
 
     bool TaskSystem::Task::removeDependencyBetween(TaskSystem::Task *taskStart,
                                                                TaskSystem::Task *taskEnd) {
-        bool found = false;
-
-        std::vector<TaskDependency *>::iterator it = taskStart->toTask.begin();
-        while (it != taskStart->toTask.end()) {
-            if ((*it)->toTask == taskEnd) {
-                it = taskStart->toTask.erase(it);
-                found = true;
+        //The start and end tasks of a graph have a dependency for every source and sink of the graph,
+        //the dependencies are looked for in the shorter vector and removed from the back of the longer one
+        bool fromStart = taskStart->toTask.size() <= taskEnd->fromTask.size();
+        std::vector<TaskDependency *> &shorter = fromStart ? taskStart->toTask : taskEnd->fromTask;
+        std::vector<TaskDependency *> &longer = fromStart ? taskEnd->fromTask : taskStart->toTask;
+
+        std::vector<TaskDependency *> found;
+
+        std::vector<TaskDependency *>::iterator it = shorter.begin();
+        while (it != shorter.end()) {
+            if ((*it)->fromTask == taskStart && (*it)->toTask == taskEnd) {
+                found.push_back(*it);
+                it = shorter.erase(it);
             } else {
                 it++;
             }
         }
 
-        it = taskEnd->fromTask.begin();
-        while (it != taskEnd->fromTask.end()) {
-            if ((*it)->fromTask == taskStart) {
-                TaskDependency *dependency = *it;
-                it = taskEnd->fromTask.erase(it);
+        if (found.empty())
+            return false;
+
+        for (std::vector<TaskDependency *>::iterator dep = found.begin(); dep != found.end(); dep++) {
+            TaskDependency *dependency = *dep;
 
+            std::vector<TaskDependency *>::reverse_iterator position = std::find(longer.rbegin(), longer.rend(), dependency);
+            if (position != longer.rend())
+                longer.erase(std::next(position).base());
+
+            if (dependency->ownerGraph != nullptr)
+                dependency->ownerGraph->deleteDependency(dependency);
+            else
                 delete dependency;
-            } else {
-                it++;
-            }
         }
 
-        return found;
+        taskStart->invalidatePlans();
+        taskEnd->invalidatePlans();
+
+        return true;
     }
 
     void TaskSystem::Task::addDependencyTo(TaskSystem::Task *task) noexcept(false) {
@@ -128,14 +161,24 @@ namespace TaskSystem {
 
     bool TaskSystem::Task::checkAcyclicDependency(TaskSystem::TaskDependency dependency,
                                                               TaskSystem::Task *task) {
-        if (*task == *(dependency.toTask))
-            return true;
+        //Depth first visit with an explicit stack, every task is visited once even if reached by more paths
+        std::vector<Task *> toVisit(1, dependency.toTask);
+        std::unordered_set<Task *> visited;
 
-        for (std::vector<TaskSystem::TaskDependency *>::iterator it = (dependency.toTask)->toTask.begin();
-             it != (dependency.toTask)->toTask.end(); it++) {
+        while (!toVisit.empty()) {
+            Task *current = toVisit.back();
+            toVisit.pop_back();
 
-            if (checkAcyclicDependency(*(*it), task))
+            if (*task == *current)
                 return true;
+
+            if (!visited.insert(current).second)
+                continue;
+
+            for (std::vector<TaskSystem::TaskDependency *>::iterator it = current->toTask.begin();
+                 it != current->toTask.end(); it++) {
+                toVisit.push_back((*it)->toTask);
+            }
         }
 
         return false;
@@ -167,25 +210,91 @@ namespace TaskSystem {
 
     void TaskSystem::Task::setExecute(void (*execute)(void *)) {
         Task::execute = execute;
+
+        invalidatePlans();
     }
 
-    TaskSystem::Task::Task(void (*execute)(void *)) : Task(false) {
-        this->execute = execute;
+    void TaskSystem::Task::setCostHint(unsigned long costHint) {
+        Task::costHint = costHint;
+
+        invalidatePlans();
+    }
+
+    void TaskSystem::Task::setPinnedWorker(int pinnedWorker) {
+        Task::pinnedWorker = pinnedWorker;
+
+        invalidatePlans();
+    }
+
+    int TaskSystem::Task::getPinnedWorker() {
+        return pinnedWorker;
+    }
+
+    void TaskSystem::Task::setDeadline(unsigned long deadline) {
+        Task::deadline = deadline;
+
+        invalidatePlans();
+    }
+
+    unsigned long TaskSystem::Task::getDeadline() {
+        return deadline;
+    }
+
+    unsigned long TaskSystem::Task::getCostHint() {
+        return costHint;
+    }
+
+    unsigned long TaskSystem::Task::getEstimatedCost() {
+        if (statistics != nullptr && statistics->numExecutions > 0)
+            return statistics->averageTime;
+
+        return costHint;
+    }
+
+    unsigned long TaskSystem::Task::getAverageTime() {
+        return statistics != nullptr ? statistics->averageTime : 0;
+    }
+
+    unsigned long TaskSystem::Task::getP95Time() {
+        return statistics != nullptr ? statistics->getP95Time() : 0;
+    }
+
+    unsigned long TaskSystem::Task::getNumProfiledExecutions() {
+        return statistics != nullptr ? statistics->numExecutions : 0;
+    }
+
+    void TaskSystem::TaskStatistics::addSample(unsigned long time) {
+        if (numExecutions == 0)
+            averageTime = time;
+        else
+            averageTime = averageTime - averageTime / 8 + time / 8;
+
+        recentTimes[numExecutions % NUM_RECENT_TIMES] = time > 0xFFFFFFFFul ? 0xFFFFFFFFu : (unsigned int) time;
+        numExecutions++;
     }
 
-    bool TaskSystem::Task::freeDependency() {
-        pthread_mutex_lock(&dependencyMutex);
+    unsigned long TaskSystem::TaskStatistics::getP95Time() {
+        unsigned int numSamples = numExecutions < NUM_RECENT_TIMES ? (unsigned int) numExecutions : NUM_RECENT_TIMES;
+
+        if (numSamples == 0)
+            return 0;
 
-        satisfiedDependencies++;
-        bool result = satisfiedDependencies == fromTask.size();
+        unsigned int sorted[NUM_RECENT_TIMES];
+        std::copy(recentTimes, recentTimes + numSamples, sorted);
 
-        pthread_mutex_unlock(&dependencyMutex);
+        unsigned int rank = (numSamples * 95 + 99) / 100 - 1;
+        std::nth_element(sorted, sorted + rank, sorted + numSamples);
 
-        return result;
+        return sorted[rank];
     }
 
-    void TaskSystem::Task::resetSatDependencies() {
-        satisfiedDependencies = 0;
+    TaskSystem::Task::Task(void (*execute)(void *)) : Task(false) {
+        this->execute = execute;
+    }
+
+    void TaskSystem::Task::invalidatePlans() {
+        if (parentGraph != nullptr)
+            parentGraph->invalidatePlan();
     }
 
     unsigned int TaskSystem::Task::getTaskID() {
@@ -193,15 +302,27 @@ namespace TaskSystem {
     }
 
     TaskSystem::TaskGraph::TaskGraph() {
-        Task::addDependencyBetween(&start, &end);
+        parentGraph = nullptr;
+        plan = nullptr;
+        retiredPlan = nullptr;
+        coarseningGrain = 0;
+        profiling = false;
+        affinity = false;
+        tenant = nullptr;
+        priority = PThreadPool::NORMAL;
+        recording = false;
+        replay = nullptr;
+        lastNumWorkers = 0;
+        lastExecutionTime = 0;
+        lastBusyTime = 0;
 
         start.setParentGraph(this);
         end.setParentGraph(this);
 
+        Task::addDependencyBetween(&start, &end);
+
         tasks.push_back(&start);
         tasks.push_back(&end);
-
-        parentGraph = nullptr;
     }
 
     void TaskSystem::TaskGraph::addTask(TaskSystem::Task *task) noexcept(false) {
@@ -212,15 +333,21 @@ namespace TaskSystem {
         if (tasks.size() == 2)
             Task::removeDependencyBetween(&start, &end);
 
+        task->setParentGraph(this);
+
         Task::addDependencyBetween(&start, task);
         Task::addDependencyBetween(task, &end);
 
-        task->setParentGraph(this);
-
         tasks.push_back(task);
     }
 
     TaskSystem::TaskGraph::~TaskGraph() {
+        //The tasks of an expired execution may still be running on the plan
+        if (plan != nullptr)
+            plan->release();
+
+        if (retiredPlan != nullptr)
+            retiredPlan->release();
     }
 
     void
@@ -294,134 +421,1046 @@ namespace TaskSystem {
         subGraphs.push_back(subGraph);
     }
 
-    void TaskSystem::TaskGraph::resetDependencies() {
-        for (std::vector<Task *>::iterator it = tasks.begin(); it != tasks.end(); it++) {
-            (*it)->resetSatDependencies();
+    TaskSystem::TaskDependency *TaskSystem::TaskGraph::newDependency(TaskSystem::Task *fromTask,
+                                                                     TaskSystem::Task *toTask) {
+        void *memory;
+
+        if (freeDependencies.empty()) {
+            memory = graphArena.allocate(sizeof(TaskDependency), alignof(TaskDependency));
+        } else {
+            memory = freeDependencies.back();
+            freeDependencies.pop_back();
+        }
+
+        return new(memory) TaskDependency(fromTask, toTask, this);
+    }
+
+    void TaskSystem::TaskGraph::deleteDependency(TaskSystem::TaskDependency *dependency) {
+        freeDependencies.push_back(dependency);
+    }
+
+    void TaskSystem::TaskGraph::invalidatePlan() {
+        //The plan of every parent contains the tasks of this graph
+        for (TaskGraph *graph = this; graph != nullptr; graph = graph->getParentGraph()) {
+            if (graph->plan != nullptr)
+                graph->retiredPlan = graph->plan;
+
+            graph->plan = nullptr;
         }
+    }
+
+    void TaskSystem::TaskGraph::collectTasks(std::vector<Task *> *out) {
+        out->insert(out->end(), tasks.begin(), tasks.end());
 
         for (std::vector<TaskGraph *>::iterator it = subGraphs.begin(); it != subGraphs.end(); it++) {
-            (*it)->resetDependencies();
+            (*it)->collectTasks(out);
         }
     }
 
-    TaskSystem::TaskDependency::TaskDependency(TaskSystem::Task *fromTask,
-                                                           TaskSystem::Task *toTask) : fromTask(
-            fromTask), toTask(toTask) {}
+    void TaskSystem::TaskGraph::compile() {
+        if (plan != nullptr)
+            return;
+
+        if (retiredPlan != nullptr)
+            retiredPlan->release();
 
-    TaskSystem::TaskDependency::~TaskDependency() {
+        retiredPlan = nullptr;
+        planArena.release();
+
+        std::vector<Task *> planTasks;
+        collectTasks(&planTasks);
+
+        unsigned int numTasks = static_cast<unsigned int>(planTasks.size());
+
+        std::unordered_map<Task *, unsigned int> taskIndexes;
+        taskIndexes.reserve(numTasks);
+
+        for (unsigned int i = 0; i < numTasks; ++i) {
+            taskIndexes[planTasks[i]] = i;
+        }
+
+        //Only the dependencies between tasks of this graph are part of the plan,
+        //the ones that reach the parent graphs are ignored
+        std::vector<std::vector<unsigned int>> taskSuccessors(numTasks);
+        std::vector<unsigned int> numPredecessors(numTasks, 0);
+
+        for (unsigned int i = 0; i < numTasks; ++i) {
+            std::vector<TaskDependency *> &dependencies = planTasks[i]->toTask;
+
+            for (std::vector<TaskDependency *>::iterator it = dependencies.begin(); it != dependencies.end(); it++) {
+                std::unordered_map<Task *, unsigned int>::iterator target = taskIndexes.find((*it)->toTask);
+
+                if (target == taskIndexes.end())
+                    continue;
+
+                taskSuccessors[i].push_back(target->second);
+                numPredecessors[target->second]++;
+            }
+        }
+
+        //Topological order, the members of a node are executed in this order
+        std::vector<unsigned int> order;
+        order.reserve(numTasks);
+
+        std::vector<unsigned int> missingPredecessors(numPredecessors);
+        for (unsigned int i = 0; i < numTasks; ++i) {
+            if (missingPredecessors[i] == 0)
+                order.push_back(i);
+        }
+
+        for (unsigned int i = 0; i < order.size(); ++i) {
+            std::vector<unsigned int> &successors = taskSuccessors[order[i]];
+
+            for (std::vector<unsigned int>::iterator it = successors.begin(); it != successors.end(); it++) {
+                if (--missingPredecessors[*it] == 0)
+                    order.push_back(*it);
+            }
+        }
+
+        if (profiling) {
+            for (std::vector<Task *>::iterator it = planTasks.begin(); it != planTasks.end(); it++) {
+                Task *task = *it;
+
+                if (task->statistics == nullptr && !task->isDummy())
+                    task->statistics = task->getParentGraph()->graphArena.allocateArray<TaskStatistics>(1);
+            }
+        }
+
+        //The nodes are numbered in topological order
+        std::vector<unsigned int> groupOf(numTasks);
+        unsigned int numGroups;
+
+        if (coarseningGrain > 0) {
+            numGroups = coarsen(planTasks, taskSuccessors, numPredecessors, order, &groupOf);
+        } else {
+            numGroups = numTasks;
+
+            for (unsigned int i = 0; i < numTasks; ++i) {
+                groupOf[order[i]] = i;
+            }
+        }
+
+        ExecutionPlan *newPlan = planArena.allocateArray<ExecutionPlan>(1);
+
+        newPlan->numNodes = numGroups;
+        newPlan->nodes = planArena.allocateArray<ExecutionPlan::Node>(numGroups);
+        newPlan->numMembers = numTasks;
+        newPlan->members = planArena.allocateArray<ExecutionPlan::Member>(numTasks);
+        newPlan->readyQueue = nullptr;
+        newPlan->profiling = profiling;
+        newPlan->affinity = affinity;
+        newPlan->pinned = false;
+        newPlan->record = recording ? planArena.allocateArray<ScheduleEntry>(numGroups) : nullptr;
+
+        for (unsigned int i = 0; i < numTasks; ++i) {
+            newPlan->nodes[groupOf[i]].numMembers++;
+        }
+
+        unsigned int member = 0;
+        for (unsigned int i = 0; i < numGroups; ++i) {
+            newPlan->nodes[i].firstMember = member;
+            member += newPlan->nodes[i].numMembers;
+            newPlan->nodes[i].numMembers = 0;
+        }
+
+        for (std::vector<unsigned int>::iterator it = order.begin(); it != order.end(); it++) {
+            ExecutionPlan::Node *node = &newPlan->nodes[groupOf[*it]];
+
+            ExecutionPlan::Member *member = &newPlan->members[node->firstMember + node->numMembers++];
+            Task *task = planTasks[*it];
+
+            member->execute = task->isDummy() ? nullptr : task->execute;
+            member->args = task;
+            member->task = task;
+        }
+
+        //Dependencies between the nodes, without duplicates and without the ones inside a node
+        std::vector<std::vector<unsigned int>> nodeSuccessors(numGroups);
+        unsigned int numSuccessors = 0;
+
+        for (unsigned int i = 0; i < numTasks; ++i) {
+            for (std::vector<unsigned int>::iterator it = taskSuccessors[i].begin(); it != taskSuccessors[i].end(); it++) {
+                if (groupOf[*it] != groupOf[i])
+                    nodeSuccessors[groupOf[i]].push_back(groupOf[*it]);
+            }
+        }
+
+        for (unsigned int i = 0; i < numGroups; ++i) {
+            std::vector<unsigned int> &successors = nodeSuccessors[i];
+
+            std::sort(successors.begin(), successors.end());
+            successors.erase(std::unique(successors.begin(), successors.end()), successors.end());
+
+            numSuccessors += static_cast<unsigned int>(successors.size());
+        }
+
+        newPlan->numSuccessors = numSuccessors;
+        newPlan->successors = planArena.allocateArray<unsigned int>(numSuccessors);
+
+        unsigned int successor = 0;
+        for (unsigned int i = 0; i < numGroups; ++i) {
+            ExecutionPlan::Node *node = &newPlan->nodes[i];
+
+            node->dummy = node->numMembers == 1 && newPlan->members[node->firstMember].execute == nullptr;
+            node->shared = false;
+            node->plan = newPlan;
+            node->lastWorker = -1;
+            node->preferredWorker = -1;
+            node->pinnedWorker = newPlan->members[node->firstMember].task->pinnedWorker;
+            node->event = newPlan->members[node->firstMember].task->event;
+
+            if (node->pinnedWorker >= 0)
+                newPlan->pinned = true;
+            node->firstSuccessor = successor;
+
+            for (std::vector<unsigned int>::iterator it = nodeSuccessors[i].begin(); it != nodeSuccessors[i].end(); it++) {
+                newPlan->successors[successor++] = *it;
+                newPlan->nodes[*it].numDependencies++;
+            }
+
+            node->numSuccessors = successor - node->firstSuccessor;
+        }
+
+        newPlan->startNode = &newPlan->nodes[groupOf[taskIndexes[&start]]];
+        newPlan->endNode = &newPlan->nodes[groupOf[taskIndexes[&end]]];
+
+        for (unsigned int i = 0; i < numTasks; ++i) {
+            if (planTasks[i]->deadline > 0) {
+                newPlan->latestStarts = planArena.allocateArray<unsigned long>(numGroups);
+                break;
+            }
+        }
+
+        newPlan->estimatedWork = newPlan->computeRanks();
+
+        plan = newPlan;
     }
 
-    void TaskSystem::executeTaskGraph(TaskSystem::TaskGraph* taskGraph) {
-        Task *start = taskGraph->getStart();
-        Task *end = taskGraph->getEnd();
+    void TaskSystem::TaskGraph::updateProfile() {
+        unsigned long previousWork = plan->estimatedWork;
+        unsigned long work = plan->computeRanks();
 
-        taskGraph->resetDependencies();
+        //Group again the tasks when the measured work moved away from the one used for the coarsening
+        if (coarseningGrain > 0 && (work > previousWork + previousWork / 4 || work < previousWork - previousWork / 4)) {
+            invalidatePlan();
+        }
+    }
 
-        static pthread_mutex_t idMutex = PTHREAD_MUTEX_INITIALIZER;
-        static int idCont = 0;
+    unsigned int TaskSystem::TaskGraph::coarsen(std::vector<Task *> &planTasks,
+                                                std::vector<std::vector<unsigned int>> &taskSuccessors,
+                                                std::vector<unsigned int> &numPredecessors,
+                                                std::vector<unsigned int> &order,
+                                                std::vector<unsigned int> *groupOf) {
+        unsigned int numTasks = static_cast<unsigned int>(planTasks.size());
+
+        std::vector<unsigned int> singlePredecessor(numTasks, 0);
+        for (unsigned int i = 0; i < numTasks; ++i) {
+            for (std::vector<unsigned int>::iterator it = taskSuccessors[i].begin(); it != taskSuccessors[i].end(); it++) {
+                singlePredecessor[*it] = i;
+            }
+        }
+
+        //Tasks without a cost estimate, dummy tasks, pinned tasks and event tasks are never merged
+        std::vector<unsigned long> cost(numTasks);
+        for (unsigned int i = 0; i < numTasks; ++i) {
+            cost[i] = planTasks[i]->isDummy() || planTasks[i]->pinnedWorker >= 0 || planTasks[i]->event != nullptr ?
+                      0 : planTasks[i]->getEstimatedCost();
+        }
 
-        class ThreadSafeQueue {
-            std::queue<Task *> queue;
+        //Merge chains: a task with a single predecessor that has a single successor
+        //joins the group of its predecessor. Every group is identified by its first task
+        std::vector<unsigned int> chainOf(numTasks);
+        std::vector<unsigned int> chainTail(numTasks);
+        std::vector<unsigned long> groupCost(cost);
 
-            pthread_mutex_t mutex;
-            sem_t *sem;
-            std::string semName;
-        public:
-            ThreadSafeQueue() {
-                mutex = PTHREAD_MUTEX_INITIALIZER;
+        for (unsigned int i = 0; i < numTasks; ++i) {
+            chainOf[i] = i;
+            chainTail[i] = i;
+        }
+
+        for (std::vector<unsigned int>::iterator it = order.begin(); it != order.end(); it++) {
+            unsigned int task = *it;
+
+            if (cost[task] == 0 || numPredecessors[task] != 1)
+                continue;
+
+            unsigned int predecessor = singlePredecessor[task];
+            unsigned int chain = chainOf[predecessor];
+
+            if (cost[predecessor] == 0 || taskSuccessors[predecessor].size() != 1
+                    || groupCost[chain] + cost[task] > coarseningGrain)
+                continue;
+
+            chainOf[task] = chain;
+            chainTail[chain] = task;
+            groupCost[chain] += cost[task];
+        }
+
+        //Merge siblings: chains with the same single predecessor and the same single successor
+        //are packed together up to the grain
+        std::vector<unsigned int> siblingOf(numTasks);
+        std::map<std::pair<unsigned int, unsigned int>, unsigned int> openGroups;
+
+        for (unsigned int i = 0; i < numTasks; ++i) {
+            siblingOf[i] = i;
+        }
 
-                pthread_mutex_lock(&idMutex);
-                semName = "QueueSem"+std::to_string(idCont++);
-                pthread_mutex_unlock(&idMutex);
+        for (std::vector<unsigned int>::iterator it = order.begin(); it != order.end(); it++) {
+            unsigned int chain = *it;
+            unsigned int tail = chainTail[chain];
 
-                sem = sem_open(semName.c_str(), O_CREAT, 0644, 0);
+            if (chainOf[chain] != chain || cost[chain] == 0 || numPredecessors[chain] != 1
+                    || taskSuccessors[tail].size() != 1)
+                continue;
+
+            std::pair<unsigned int, unsigned int> key(chainOf[singlePredecessor[chain]],
+                                                      chainOf[taskSuccessors[tail][0]]);
+
+            std::map<std::pair<unsigned int, unsigned int>, unsigned int>::iterator open = openGroups.find(key);
+
+            if (open != openGroups.end() && groupCost[open->second] + groupCost[chain] <= coarseningGrain) {
+                siblingOf[chain] = open->second;
+                groupCost[open->second] += groupCost[chain];
+            } else {
+                openGroups[key] = chain;
             }
+        }
 
-            virtual ~ThreadSafeQueue() {
-                sem_unlink(semName.c_str());
-                sem_close(sem);
+        //Number the groups in topological order of their first task
+        std::vector<unsigned int> groupIndex(numTasks, numTasks);
+        unsigned int numGroups = 0;
+
+        for (std::vector<unsigned int>::iterator it = order.begin(); it != order.end(); it++) {
+            unsigned int group = siblingOf[chainOf[*it]];
+
+            if (groupIndex[group] == numTasks)
+                groupIndex[group] = numGroups++;
+
+            (*groupOf)[*it] = groupIndex[group];
+        }
+
+        return numGroups;
+    }
+
+    void TaskSystem::TaskGraph::setCoarseningGrain(unsigned long coarseningGrain) {
+        TaskGraph::coarseningGrain = coarseningGrain;
+
+        invalidatePlan();
+    }
+
+    unsigned long TaskSystem::TaskGraph::getCoarseningGrain() {
+        return coarseningGrain;
+    }
+
+    void TaskSystem::TaskGraph::setProfiling(bool profiling) {
+        TaskGraph::profiling = profiling;
+
+        invalidatePlan();
+    }
+
+    bool TaskSystem::TaskGraph::isProfiling() {
+        return profiling;
+    }
+
+    void TaskSystem::TaskGraph::setAffinity(bool affinity) {
+        TaskGraph::affinity = affinity;
+
+        invalidatePlan();
+    }
+
+    bool TaskSystem::TaskGraph::hasAffinity() {
+        return affinity;
+    }
+
+    void TaskSystem::TaskGraph::setTenant(TaskSystem::Tenant *tenant) {
+        TaskGraph::tenant = tenant;
+    }
+
+    TaskSystem::Tenant *TaskSystem::TaskGraph::getTenant() {
+        return tenant;
+    }
+
+    void TaskSystem::TaskGraph::setPriority(PThreadPool::Priority priority) {
+        TaskGraph::priority = priority;
+    }
+
+    PThreadPool::Priority TaskSystem::TaskGraph::getPriority() {
+        return priority;
+    }
+
+    void TaskSystem::TaskGraph::setHugePages(bool hugePages) {
+        planArena.setHugePages(hugePages);
+
+        invalidatePlan();
+    }
+
+    bool TaskSystem::TaskGraph::isHugePages() {
+        return planArena.isHugePages();
+    }
+
+    unsigned int TaskSystem::TaskGraph::getNumPlanNodes() {
+        compile();
+
+        return plan->numNodes;
+    }
+
+    TaskSystem::GraphAnalysis TaskSystem::TaskGraph::analyze() {
+        compile();
+
+        GraphAnalysis analysis;
+        analysis.work = plan->computeRanks();
+        analysis.span = plan->startNode->rank;
+        analysis.parallelism = analysis.span > 0 ? (double) analysis.work / analysis.span : 1.0;
+
+        analysis.lastNumWorkers = lastNumWorkers;
+        analysis.lastExecutionTime = lastExecutionTime;
+        analysis.lastBusyTime = lastBusyTime;
+
+        //Without profiling the busy time is unknown and no idle time is reported
+        unsigned long capacity = lastExecutionTime * lastNumWorkers;
+        analysis.lastIdleTime = lastBusyTime > 0 && capacity > lastBusyTime ? capacity - lastBusyTime : 0;
+
+        return analysis;
+    }
+
+    double TaskSystem::GraphAnalysis::getIdealSpeedup(unsigned int numWorkers) {
+        if (work == 0 || numWorkers == 0)
+            return 1.0;
+
+        double time = std::max((double) work / numWorkers, (double) span);
+
+        return work / time;
+    }
+
+    double TaskSystem::GraphAnalysis::getGreedySpeedup(unsigned int numWorkers) {
+        if (work == 0 || numWorkers == 0)
+            return 1.0;
+
+        return work / ((double) work / numWorkers + span);
+    }
+
+    TaskSystem::TaskDependency::TaskDependency(TaskSystem::Task *fromTask, TaskSystem::Task *toTask,
+                                               TaskSystem::TaskGraph *ownerGraph) : fromTask(fromTask),
+                                                                                    toTask(toTask),
+                                                                                    ownerGraph(ownerGraph) {}
+
+    void TaskSystem::ExecutionPlan::assignWorkers(unsigned int numWorkers) {
+        for (unsigned int i = 0; i < numNodes; ++i) {
+            Node *node = &nodes[i];
+
+            if (node->pinnedWorker >= 0)
+                node->preferredWorker = node->pinnedWorker % (int) numWorkers;
+            else if (affinity && node->lastWorker >= 0)
+                node->preferredWorker = node->lastWorker % (int) numWorkers;
+            else
+                node->preferredWorker = -1;
+        }
+    }
+
+    void TaskSystem::ExecutionPlan::reset() {
+        for (unsigned int i = 0; i < numNodes; ++i) {
+            nodes[i].satisfiedDependencies.store(0, std::memory_order_relaxed);
+            nodes[i].lastWorker = -1;
+            nodes[i].lastTime = 0;
+        }
+    }
+
+    std::vector<TaskSystem::ExecutionPlan::Node *> TaskSystem::ExecutionPlan::getCriticalPath() {
+        std::vector<Node *> path;
+
+        Node *node = startNode;
+        path.push_back(node);
+
+        while (node != endNode) {
+            Node *next = &nodes[successors[node->firstSuccessor]];
+
+            for (unsigned int j = 1; j < node->numSuccessors; ++j) {
+                Node *successor = &nodes[successors[node->firstSuccessor + j]];
+
+                if (successor->rank > next->rank)
+                    next = successor;
+            }
+
+            node = next;
+            path.push_back(node);
+        }
+
+        return path;
+    }
+
+    unsigned long TaskSystem::ExecutionPlan::computeRanks() {
+        unsigned long work = 0;
+
+        for (unsigned int i = numNodes; i > 0; --i) {
+            Node *node = &nodes[i - 1];
+
+            unsigned long cost = 0;
+            for (unsigned int j = 0; j < node->numMembers; ++j) {
+                Member *member = &members[node->firstMember + j];
+
+                if (member->task != nullptr && member->execute != nullptr)
+                    cost += member->task->getEstimatedCost();
+            }
+
+            unsigned long successorsRank = 0;
+            for (unsigned int j = 0; j < node->numSuccessors; ++j) {
+                Node *successor = &nodes[successors[node->firstSuccessor + j]];
+
+                if (successor->rank > successorsRank)
+                    successorsRank = successor->rank;
+            }
+
+            node->rank = cost + successorsRank;
+            work += cost;
+
+            if (latestStarts == nullptr)
+                continue;
+
+            //The node must end before its own deadlines and before the latest start of its successors
+            unsigned long latestEnd = ULONG_MAX;
+            for (unsigned int j = 0; j < node->numMembers; ++j) {
+                Member *member = &members[node->firstMember + j];
+
+                if (member->task != nullptr && member->task->deadline > 0)
+                    latestEnd = std::min(latestEnd, member->task->deadline);
             }
 
-            inline void safePut(Task *task) {
-                pthread_mutex_lock(&mutex);
-                queue.push(task);
-                sem_post(sem);
-                pthread_mutex_unlock(&mutex);
+            for (unsigned int j = 0; j < node->numSuccessors; ++j) {
+                latestEnd = std::min(latestEnd, latestStarts[successors[node->firstSuccessor + j]]);
             }
 
-            inline Task *safePop() {
-                sem_wait(sem);
-                pthread_mutex_lock(&mutex);
-                Task *task = queue.front();
-                queue.pop();
-                pthread_mutex_unlock(&mutex);
+            if (latestEnd == ULONG_MAX)
+                latestStarts[i - 1] = ULONG_MAX;
+            else
+                latestStarts[i - 1] = latestEnd > cost ? latestEnd - cost : 0;
+        }
+
+        return work;
+    }
+
+    bool TaskSystem::ExecutionPlan::isCancelled() {
+        return failed.load(std::memory_order_relaxed) || expired.load(std::memory_order_relaxed) ||
+               (cancellation != nullptr && cancellation->isCancelled());
+    }
+
+    bool TaskSystem::ExecutionPlan::waitFunctions(const timespec *deadline) {
+        unsigned int spins = 0;
 
-                return task;
+        while (runningFunctions.load(std::memory_order_acquire) != 0) {
+            if (deadline != nullptr) {
+                timespec now;
+                clock_gettime(CLOCK_MONOTONIC, &now);
+
+                if (now.tv_sec > deadline->tv_sec || (now.tv_sec == deadline->tv_sec && now.tv_nsec >= deadline->tv_nsec))
+                    return false;
             }
-        } taskQueue;
 
-        taskQueue.safePut(start);
+            //The last completions of a finished execution take a few instructions, the ones of an expired execution
+            //can take as long as a task
+            if (++spins < 64)
+                std::this_thread::yield();
+            else
+                std::this_thread::sleep_for(std::chrono::microseconds(50));
+        }
+
+        return true;
+    }
+
+    void TaskSystem::ExecutionPlan::release() {
+        waitFunctions(nullptr);
+
+        delete readyQueue;
+        readyQueue = nullptr;
+    }
 
-        struct CBArgs {
-            ThreadSafeQueue *queuePointer;
-            Task *taskPointer;
+    void TaskSystem::ExecutionPlan::fail(std::exception_ptr exception) {
+        if (!failed.exchange(true, std::memory_order_acq_rel))
+            this->exception = exception;
 
-            CBArgs(ThreadSafeQueue *queuePointer, Task *taskPointer) : queuePointer(queuePointer),
-                                                                       taskPointer(taskPointer) {}
-        };
+        //The running tasks that poll the token stop as well
+        if (cancellation != nullptr)
+            cancellation->cancel();
+    }
 
-        void (*callback)(void *) = [](void *args) {
-            CBArgs *cbArgs = (CBArgs *) args;
+    void TaskSystem::ExecutionPlan::runNode(void *args) {
+        runNode((Node *) args, PThreadPool::getCurrentWorkerIndex());
+    }
 
-            Task *task = cbArgs->taskPointer;
-            ThreadSafeQueue *queue = cbArgs->queuePointer;
+    void TaskSystem::ExecutionPlan::runNode(TaskSystem::ExecutionPlan::Node *node, int worker) {
+        ExecutionPlan *plan = node->plan;
+        Member *member = plan->members + node->firstMember;
+        Member *lastMember = member + node->numMembers;
 
-            std::vector<TaskDependency *> dependencyList = task->getToTask();
-            for (std::vector<TaskDependency *>::iterator it = dependencyList.begin();
-                 it != dependencyList.end(); it++) {
+        //The thread of a nested execution can be a worker, its nodes are still recorded as run by the caller
+        node->lastWorker = worker;
 
-                TaskDependency* td = (*it);
-                Task *toTask = td->toTask;
+        if (plan->record != nullptr) {
+            ScheduleEntry *entry = &plan->record[plan->recordSize.fetch_add(1, std::memory_order_relaxed)];
+            entry->node = (unsigned int) (node - plan->nodes);
+            entry->worker = node->lastWorker;
+        }
 
-                if (toTask->freeDependency()) {
-                    queue->safePut(toTask);
+        //A replayed execution gives the next node only after this one has started
+        if (plan->replaying)
+            plan->replayStarted.fetch_add(1, std::memory_order_release);
+
+        ExecutionPlan *previousPlan = currentPlan;
+        currentPlan = plan;
+
+        //An exception must not unwind the worker loop, the dispatcher would wait forever for the end node
+        if (!plan->profiling) {
+            for (; member != lastMember && !plan->isCancelled(); member++) {
+                try {
+                    member->execute(member->args);
+                } catch (abi::__forced_unwind&) {
+                    //The cancellation of the worker thread must unwind it
+                    currentPlan = previousPlan;
+                    throw;
+                } catch (...) {
+                    plan->fail(std::current_exception());
                 }
             }
 
-            delete cbArgs;
-            cbArgs = nullptr;
-        };
+            currentPlan = previousPlan;
+            return;
+        }
+
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        unsigned long nodeTime = 0;
+
+        for (; member != lastMember && !plan->isCancelled(); member++) {
+            try {
+                member->execute(member->args);
+            } catch (abi::__forced_unwind&) {
+                currentPlan = previousPlan;
+                throw;
+            } catch (...) {
+                plan->fail(std::current_exception());
+            }
+
+            std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+            unsigned long time = (unsigned long) std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+
+            member->task->statistics->addSample(time);
+            nodeTime += time;
+            start = end;
+        }
+
+        node->lastTime = nodeTime;
+        currentPlan = previousPlan;
+    }
+
+    void TaskSystem::ExecutionPlan::releaseSuccessors(TaskSystem::ExecutionPlan::Node *node,
+                                                      TaskSystem::ExecutionPlan::Node **inlineNode) {
+        //Read everything before the first put, the plan can be released as soon as the end node is dispatched
+        ExecutionPlan *plan = node->plan;
+        NodeQueue *queue = plan->readyQueue;
+        Node *endNode = plan->endNode;
+        Node *nodes = plan->nodes;
+        unsigned int *successor = plan->successors + node->firstSuccessor;
+        unsigned int *lastSuccessor = successor + node->numSuccessors;
+        int worker = inlineNode != nullptr ? PThreadPool::getCurrentWorkerIndex() : -1;
+
+        for (; successor != lastSuccessor; successor++) {
+            Node *toNode = &nodes[*successor];
+
+            if (toNode->satisfiedDependencies.fetch_add(1, std::memory_order_acq_rel) + 1 != toNode->numDependencies)
+                continue;
+
+            if (toNode == endNode) {
+                queue->safePut(toNode);
+            } else if (toNode->event != nullptr) {
+                //The reactor puts the node in the queue when its event happens
+                plan->reactor->arm(toNode);
+            } else if (toNode->dummy) {
+                //Dummy nodes only join dependencies, the nesting of the subgraphs bounds the recursion
+                releaseSuccessors(toNode, inlineNode);
+            } else if (inlineNode == nullptr || (toNode->preferredWorker >= 0 && toNode->preferredWorker != worker)) {
+                //Nodes that prefer an other worker are dispatched to it
+                queue->safePut(toNode);
+            } else if (*inlineNode == nullptr) {
+                *inlineNode = toNode;
+            } else if (NodeRankLess()(*inlineNode, toNode)) {
+                queue->safePut(*inlineNode);
+                *inlineNode = toNode;
+            } else {
+                queue->safePut(toNode);
+            }
+        }
+    }
+
+    void TaskSystem::ExecutionPlan::nodeCompleted(void *args) {
+        Node *node = (Node *) args;
+        ExecutionPlan *plan = node->plan;
+        FairShare *fairShare = plan->fairShare;
+        FairShare::Account *account = plan->account;
+        bool shared = fairShare != nullptr && node->shared;
+        unsigned int inlineBudget = plan->maxInlineDepth;
+
+        while (true) {
+            Node *inlineNode = nullptr;
+
+            //A successor is not run inline while the worker is owed to a waiting graph
+            bool owed = fairShare != nullptr && fairShare->hasWaiters();
+
+            releaseSuccessors(node, inlineBudget > 0 && !owed ? &inlineNode : nullptr);
+
+            //Nobody dispatches the ready nodes while the caller executes one, the worker does not go idle before them
+            if (inlineNode == nullptr && !owed && plan->callerBusy.load(std::memory_order_acquire))
+                inlineNode = plan->takeReadyNode();
+
+            if (inlineNode == nullptr) {
+                if (shared)
+                    fairShare->release(account);
+
+                //The plan is released only after all its running functions have completed
+                plan->runningFunctions.fetch_sub(1, std::memory_order_release);
+
+                return;
+            }
+
+            if (inlineBudget > 0)
+                inlineBudget--;
+
+            runNode(inlineNode);
+
+            node = inlineNode;
+        }
+    }
+
+    TaskSystem::ExecutionPlan::Node *TaskSystem::ExecutionPlan::takeReadyNode() {
+        Node *node;
+
+        if (isCancelled() || !readyQueue->tryPop(&node))
+            return nullptr;
+
+        //The end node and the nodes of an other worker are left to the dispatcher
+        if (node == endNode || (node->preferredWorker >= 0 && node->preferredWorker != PThreadPool::getCurrentWorkerIndex())) {
+            readyQueue->safePut(node);
+            return nullptr;
+        }
+
+        return node;
+    }
+
+    TaskSystem::ExecutionStatus TaskSystem::executeTaskGraph(TaskSystem::TaskGraph* taskGraph,
+                                                             TaskSystem::CancellationToken *cancellation) {
+        return executeGraph(taskGraph, cancellation, nullptr);
+    }
+
+    TaskSystem::ExecutionStatus TaskSystem::executeTaskGraph(TaskSystem::TaskGraph *taskGraph,
+                                                             std::chrono::steady_clock::time_point deadline,
+                                                             TaskSystem::CancellationToken *cancellation) {
+        //The steady clock is CLOCK_MONOTONIC, the clock of the timed waits
+        long long nanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(deadline.time_since_epoch()).count();
+
+        timespec time;
+        time.tv_sec = (time_t) (nanoseconds / 1000000000);
+        time.tv_nsec = (long) (nanoseconds % 1000000000);
+
+        return executeGraph(taskGraph, cancellation, &time);
+    }
+
+    TaskSystem::ExecutionStatus TaskSystem::executeGraph(TaskSystem::TaskGraph *taskGraph,
+                                                         TaskSystem::CancellationToken *cancellation,
+                                                         const timespec *deadline) {
+        taskGraph->compile();
+
+        ExecutionPlan *plan = taskGraph->plan;
+
+        if (taskGraph->replay != nullptr && !taskGraph->replay->matches(plan))
+            throw ScheduleMismatchException();
+
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        ExecutionStatus status = executePlan(plan, cancellation, deadline, taskGraph->tenant, taskGraph->priority,
+                                             taskGraph->replay);
+        std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+
+        //The caller counts as one more worker when it executed some nodes
+        taskGraph->lastNumWorkers = pThreadPool->getNumWorkerThreads() + (plan->callerParticipated ? 1 : 0);
+        taskGraph->lastExecutionTime = (unsigned long) std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+        taskGraph->lastBusyTime = 0;
+
+        //The times of the nodes of an expired execution are still being written
+        if (plan->profiling && status != DEADLINE_EXPIRED) {
+            for (unsigned int i = 0; i < plan->numNodes; ++i) {
+                taskGraph->lastBusyTime += plan->nodes[i].lastTime;
+            }
+
+            taskGraph->updateProfile();
+        }
+
+        return rethrowFailure(plan, status);
+    }
+
+    TaskSystem::ExecutionStatus TaskSystem::executeGraphTopology(TaskSystem::GraphTopology *topology,
+                                                                 TaskSystem::CancellationToken *cancellation) {
+        if (topology->plan == nullptr)
+            throw GraphTopologyException();
+
+        ExecutionStatus status = executePlan(topology->plan, cancellation, nullptr, nullptr, PThreadPool::NORMAL, nullptr);
+
+        return rethrowFailure(topology->plan, status);
+    }
+
+    TaskSystem::ExecutionStatus TaskSystem::rethrowFailure(TaskSystem::ExecutionPlan *plan, ExecutionStatus status) {
+        //The exception of an expired execution may be written by a task still running
+        if (status != DEADLINE_EXPIRED && plan->failed.load(std::memory_order_acquire)) {
+            std::exception_ptr exception = plan->exception;
+            plan->exception = nullptr;
+
+            std::rethrow_exception(exception);
+        }
+
+        return status;
+    }
+
+    bool TaskSystem::isExecutionCancelled() {
+        return currentPlan != nullptr && currentPlan->isCancelled();
+    }
+
+    TaskSystem::ExecutionStatus TaskSystem::executePlan(TaskSystem::ExecutionPlan *plan,
+                                                        TaskSystem::CancellationToken *cancellation,
+                                                        const timespec *deadline, TaskSystem::Tenant *tenant,
+                                                        PThreadPool::Priority priority, TaskSystem::Schedule *replay) {
+        //The tasks of a previous expired execution still use the nodes
+        if (!plan->waitFunctions(deadline))
+            return DEADLINE_EXPIRED;
+
+        //The queue of an expired execution can hold the nodes released after its return
+        if (plan->readyQueue != nullptr && plan->expired.load(std::memory_order_relaxed)) {
+            delete plan->readyQueue;
+            plan->readyQueue = nullptr;
+        }
+
+        if (plan->readyQueue == nullptr)
+            plan->readyQueue = new ExecutionPlan::NodeQueue();
+
+        ExecutionPlan::NodeQueue *nodeQueue = plan->readyQueue;
+
+        if (plan->affinity || plan->pinned)
+            plan->assignWorkers(pThreadPool->getNumSharedWorkers());
+
+        plan->reset();
+        plan->maxInlineDepth = replay != nullptr ? 0 : maxInlineDepth;
+        plan->cancellation = cancellation;
+        plan->failed.store(false, std::memory_order_relaxed);
+        plan->exception = nullptr;
+        plan->expired.store(false, std::memory_order_relaxed);
+        plan->fairShare = priority == PThreadPool::HIGH || replay != nullptr ? nullptr : fairShare;
+        plan->defaultAccount.weight = 1;
+        plan->account = tenant != nullptr ? &tenant->account : &plan->defaultAccount;
+        plan->callerParticipated = false;
+        plan->callerBusy.store(false, std::memory_order_relaxed);
+        plan->reactor = eventReactor;
+        plan->recordSize.store(0, std::memory_order_relaxed);
+        plan->replaying = replay != nullptr;
+
+        if (replay != nullptr)
+            return replaySchedule(plan, replay, cancellation, deadline);
+
+        if (plan->fairShare != nullptr)
+            fairShare->numExecutions.fetch_add(1, std::memory_order_relaxed);
+
+        //The workers of a tenant are only those of its share, and a caller with a deadline must be free to return
+        bool participate = callerParticipation && tenant == nullptr && deadline == nullptr;
+
+        //The start node is dummy, its successors are released without passing through the queue
+        ExecutionPlan::releaseSuccessors(plan->startNode, nullptr);
 
         while (true) {
-            Task *task = taskQueue.safePop();
+            ExecutionPlan::Node *node;
+
+            if (deadline == nullptr)
+                node = nodeQueue->safePop();
+            else if (!nodeQueue->timedPop(deadline, &node))
+                break;
+
+            if (node == plan->endNode) {
+                //The last completions may still be decrementing the counter
+                plan->waitFunctions(nullptr);
+
+                if (plan->fairShare != nullptr)
+                    fairShare->numExecutions.fetch_sub(1, std::memory_order_relaxed);
+
+                bool cancelled = cancellation != nullptr && cancellation->isCancelled();
+                plan->cancellation = nullptr;
+
+                return cancelled ? CANCELLED : COMPLETED;
+            }
+
+            //The tasks of a cancelled execution are skipped, their nodes only release the successors
+            if (plan->isCancelled()) {
+                ExecutionPlan::releaseSuccessors(node, nullptr);
+                continue;
+            }
+
+            //The caller executes the ready node itself only when no worker can take it right away
+            if (participate && node->preferredWorker < 0) {
+                if (tryDispatchNode(plan, node, priority))
+                    continue;
+
+                //The other ready nodes are given first to the workers that can take them, so they do not wait for
+                //the end of the node of the caller; the end node can not be ready before the node of the caller
+                ExecutionPlan::Node *readyNode;
+
+                while (nodeQueue->tryPop(&readyNode)) {
+                    if (plan->isCancelled()) {
+                        ExecutionPlan::releaseSuccessors(readyNode, nullptr);
+                    } else if (readyNode->preferredWorker >= 0) {
+                        dispatchNode(plan, readyNode, nullptr, priority);
+                    } else if (!tryDispatchNode(plan, readyNode, priority)) {
+                        nodeQueue->safePut(readyNode);
+                        break;
+                    }
+                }
+
+                plan->callerParticipated = true;
+                plan->callerBusy.store(true, std::memory_order_release);
 
-            if(task == nullptr) {
-                std::this_thread::sleep_for(std::chrono::nanoseconds(1000));
+                ExecutionPlan::runNode(node, -1);
+
+                plan->callerBusy.store(false, std::memory_order_relaxed);
+                ExecutionPlan::releaseSuccessors(node, nullptr);
                 continue;
             }
 
-            if (task->getTaskID() == end->getTaskID())
+            if (!dispatchNode(plan, node, deadline, priority))
                 break;
+        }
+
+        if (plan->fairShare != nullptr)
+            fairShare->numExecutions.fetch_sub(1, std::memory_order_relaxed);
+
+        //The deadline passed: the nodes not yet started are skipped by the running tasks that release them
+        plan->expired.store(true, std::memory_order_release);
+
+        return DEADLINE_EXPIRED;
+    }
+
+    bool TaskSystem::tryDispatchNode(TaskSystem::ExecutionPlan *plan, TaskSystem::ExecutionPlan::Node *node,
+                                     PThreadPool::Priority priority) {
+        node->shared = plan->takesShare();
+
+        if (node->shared && !fairShare->tryAcquire(plan->account))
+            return false;
+
+        plan->runningFunctions.fetch_add(1, std::memory_order_relaxed);
+
+        if (pThreadPool->tryExecuteFunction(ExecutionPlan::runNode, node, ExecutionPlan::nodeCompleted, node, priority))
+            return true;
+
+        if (node->shared)
+            fairShare->release(plan->account);
+        plan->runningFunctions.fetch_sub(1, std::memory_order_relaxed);
 
-            task->startTask(pThreadPool, callback, new CBArgs(&taskQueue, task));
+        return false;
+    }
+
+    bool TaskSystem::dispatchNode(TaskSystem::ExecutionPlan *plan, TaskSystem::ExecutionPlan::Node *node,
+                                  const timespec *deadline, PThreadPool::Priority priority) {
+        //A graph without a tenant takes the workers from the share only while other graphs are executed,
+        //so a single execution never locks the share
+        node->shared = plan->takesShare();
+
+        //The graph waits its turn for a worker when the workers are shared with other graphs
+        if (node->shared && !fairShare->acquire(plan->account, deadline))
+            return false;
+
+        plan->runningFunctions.fetch_add(1, std::memory_order_relaxed);
+
+        bool dispatched;
+
+        //A pinned task keeps its worker also in the high lane, the affinity is ignored there
+        if (node->preferredWorker >= 0 && (priority != PThreadPool::HIGH || node->pinnedWorker >= 0))
+            dispatched = pThreadPool->executeFunctionOn((unsigned int) node->preferredWorker, node->pinnedWorker >= 0,
+                                                       ExecutionPlan::runNode, node, ExecutionPlan::nodeCompleted, node,
+                                                       deadline);
+        else if (priority == PThreadPool::HIGH)
+            dispatched = pThreadPool->executeFunctionUntil(deadline, ExecutionPlan::runNode, node,
+                                                           ExecutionPlan::nodeCompleted, node, PThreadPool::HIGH);
+        else if (deadline == nullptr)
+            dispatched = (pThreadPool->executeFunction(ExecutionPlan::runNode, node, ExecutionPlan::nodeCompleted, node), true);
+        else
+            dispatched = pThreadPool->executeFunctionUntil(deadline, ExecutionPlan::runNode, node,
+                                                           ExecutionPlan::nodeCompleted, node);
+
+        if (!dispatched) {
+            if (node->shared)
+                fairShare->release(plan->account);
+            plan->runningFunctions.fetch_sub(1, std::memory_order_relaxed);
         }
+
+        return dispatched;
+    }
+
+    std::string TaskSystem::nextSemaphoreName(const char *prefix) {
+        static pthread_mutex_t idMutex = PTHREAD_MUTEX_INITIALIZER;
+        static int idCont = 0;
+
+        pthread_mutex_lock(&idMutex);
+        std::string name = prefix + std::to_string(idCont++);
+        pthread_mutex_unlock(&idMutex);
+
+        return name;
     }
 
     TaskSystem::TaskSystem() {
         pThreadPool = new PThreadPool();
+        fairShare = new FairShare(pThreadPool->getNumSharedWorkers());
+        eventReactor = new EventReactor();
+        maxInlineDepth = 8;
+        callerParticipation = true;
     }
 
     TaskSystem::TaskSystem(unsigned int numWorkers) {
         pThreadPool = new PThreadPool(numWorkers);
+        fairShare = new FairShare(pThreadPool->getNumSharedWorkers());
+        eventReactor = new EventReactor();
+        maxInlineDepth = 8;
+        callerParticipation = true;
+    }
+
+    TaskSystem::TaskSystem(unsigned int numWorkers, unsigned int numReservedWorkers) {
+        pThreadPool = new PThreadPool(numWorkers, numReservedWorkers);
+        fairShare = new FairShare(pThreadPool->getNumSharedWorkers());
+        eventReactor = new EventReactor();
+        maxInlineDepth = 8;
+        callerParticipation = true;
     }
 
     TaskSystem::~TaskSystem() {
+        //The tasks of the expired executions can still be running, the workers are not cancelled inside them
+        pThreadPool->waitIdle();
+
+        delete eventReactor;
+        eventReactor = nullptr;
+
         delete pThreadPool;
         pThreadPool = nullptr;
+
+        delete fairShare;
+        fairShare = nullptr;
     }
 
     unsigned int TaskSystem::getNumWorkerThreads() {
         return pThreadPool->getNumWorkerThreads();
     }
 
+    void TaskSystem::setCallerParticipation(bool callerParticipation) {
+        TaskSystem::callerParticipation = callerParticipation;
+    }
+
+    bool TaskSystem::isCallerParticipating() {
+        return callerParticipation;
+    }
+
+    void TaskSystem::setMaxInlineDepth(unsigned int maxInlineDepth) {
+        TaskSystem::maxInlineDepth = maxInlineDepth;
+    }
+
+    unsigned int TaskSystem::getMaxInlineDepth() {
+        return maxInlineDepth;
+    }
+
 }
\ No newline at end of file
@@ -6,7 +6,19 @@
 #define CODE_TASKSYSTEM_H
 
 #include "PThreadPool.h"
+#include "TaskSystemArena.h"
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <ctime>
 #include <exception>
+#include <fcntl.h>
+#include <map>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
 
 namespace TaskSystem {
     /**
@@ -16,234 +28,1878 @@ namespace TaskSystem {
     public:
         class CyclicGraphException;
         class Task;
+        class EventTask;
         class TaskGraph;
+        class GraphTopology;
+        class Pipeline;
+        class BlockedRange;
+        class BlockedRange2D;
+        class CancellationToken;
+        class Tenant;
+        class Schedule;
+
+        /** Result of the execution of a TaskGraph
+         */
+        enum ExecutionStatus {
+            /**
+             * All the tasks have been executed
+             */
+            COMPLETED,
+
+            /**
+             * The token has been cancelled, the tasks not yet started have been skipped
+             */
+            CANCELLED,
+
+            /**
+             * The deadline passed before the end of the execution, the tasks not yet started are skipped
+             * and the running ones complete after the return
+             */
+            DEADLINE_EXPIRED
+        };
+
+    private:
+
+        /**
+         * Create a unique name for a named semaphore
+         * @param prefix Prefix of the name
+         */
+        static std::string nextSemaphoreName(const char* prefix);
+
+        /** Blocking queue shared between the dispatcher and the worker callbacks,
+         * Queue can be a std::queue or a std::priority_queue
+         */
+        template<typename T, typename Queue = std::queue<T>>
+        class ThreadSafeQueue {
+            Queue queue;
+
+            pthread_mutex_t mutex;
+            sem_t *sem;
+            std::string semName;
+
+            static inline T first(std::queue<T>& queue) {
+                return queue.front();
+            }
+
+            template<typename Compare>
+            static inline T first(std::priority_queue<T, std::vector<T>, Compare>& queue) {
+                return queue.top();
+            }
+        public:
+            ThreadSafeQueue() {
+                mutex = PTHREAD_MUTEX_INITIALIZER;
+
+                semName = nextSemaphoreName("QueueSem");
+
+                sem = sem_open(semName.c_str(), O_CREAT, 0644, 0);
+                sem_unlink(semName.c_str());
+            }
+
+            virtual ~ThreadSafeQueue() {
+                sem_close(sem);
+            }
+
+            inline void safePut(T element) {
+                pthread_mutex_lock(&mutex);
+                queue.push(element);
+                sem_post(sem);
+                pthread_mutex_unlock(&mutex);
+            }
+
+            /**
+             * Pop an element only if the queue is not empty, without waiting
+             * @return False if the queue is empty
+             */
+            inline bool tryPop(T* element) {
+                if (sem_trywait(sem) != 0)
+                    return false;
+
+                pthread_mutex_lock(&mutex);
+                *element = first(queue);
+                queue.pop();
+                pthread_mutex_unlock(&mutex);
+
+                return true;
+            }
+
+            inline T safePop() {
+                sem_wait(sem);
+                pthread_mutex_lock(&mutex);
+                T element = first(queue);
+                queue.pop();
+                pthread_mutex_unlock(&mutex);
+
+                return element;
+            }
+
+            /**
+             * Pop an element waiting at most until the deadline
+             * @param deadline Absolute time of CLOCK_MONOTONIC
+             * @return False if the queue has been empty until the deadline
+             */
+            inline bool timedPop(const timespec* deadline, T* element) {
+                int result;
+                while ((result = sem_clockwait(sem, CLOCK_MONOTONIC, deadline)) != 0 && errno == EINTR);
+
+                if (result != 0)
+                    return false;
+
+                pthread_mutex_lock(&mutex);
+                *element = first(queue);
+                queue.pop();
+                pthread_mutex_unlock(&mutex);
+
+                return true;
+            }
+        };
+
+        /** Weighted fair share of the workers among the graphs executed at the same time: the dispatcher of
+         * an execution takes a worker from the share before giving it a task, and when more dispatchers wait
+         * the worker goes to the one whose tenant has the lowest pass, advanced at every grant by a stride
+         * inversely proportional to the weight of the tenant
+         */
+        struct FairShare {
+            /**
+             * Pass advanced by a grant to a tenant of weight 1
+             */
+            static const unsigned long STRIDE = 1ul << 20;
+
+            /** State of a tenant in the share
+             */
+            struct Account {
+                unsigned int weight;
+
+                /**
+                 * Maximum number of workers used at the same time, 0 for no limit
+                 */
+                unsigned int maxConcurrency;
+
+                /**
+                 * Workers currently used
+                 */
+                unsigned int running;
+
+                /**
+                 * Virtual time of the next grant
+                 */
+                unsigned long pass;
+            };
+
+            /** Dispatcher waiting for a worker
+             */
+            struct Waiter {
+                Account* account;
+                pthread_cond_t condition;
+                bool granted;
+            };
+
+            pthread_mutex_t mutex;
+
+            /**
+             * Workers not taken by any execution
+             */
+            unsigned int freeWorkers;
+
+            /**
+             * Virtual time of the last grant, the pass of a tenant that was idle starts from it
+             */
+            unsigned long virtualTime;
+
+            std::vector<Waiter*> waiters;
+
+            /**
+             * Number of waiting dispatchers, read without the mutex by the workers to stop the inline execution
+             */
+            std::atomic<unsigned int> numWaiters;
+
+            /**
+             * Executions running that can take part in the share, a graph without a tenant takes its workers
+             * from the share only while it is not the only one
+             */
+            std::atomic<unsigned int> numExecutions;
+
+            explicit FairShare(unsigned int numWorkers);
+
+            ~FairShare();
+
+            /**
+             * Take a worker for a tenant, waiting for its turn
+             * @param deadline Absolute time of CLOCK_MONOTONIC, nullptr to wait without a limit
+             * @return False if the worker has not been granted before the deadline
+             */
+            bool acquire(Account* account, const timespec* deadline);
+
+            /**
+             * Take a worker for a tenant only if it is its turn and a worker is free, without waiting
+             * @return False if the worker has not been granted
+             */
+            bool tryAcquire(Account* account);
+
+            /**
+             * Give back the worker taken by a tenant
+             */
+            void release(Account* account);
+
+            /**
+             * Grant the free workers to the waiting dispatchers in order of pass, called with the mutex locked
+             */
+            void grantWaiters();
+
+            /**
+             * Give a free worker to a tenant and advance its pass, called with the mutex locked
+             */
+            inline void grant(Account* account) {
+                freeWorkers--;
+                account->running++;
+                virtualTime = account->pass;
+                account->pass += STRIDE / account->weight;
+            }
+
+            /**
+             * True if the tenant can take a free worker before the waiting dispatchers, called with the mutex locked
+             */
+            inline bool canGrantNow(Account* account) {
+                //A tenant that was idle does not keep the turns it did not use
+                if (account->running == 0 && account->pass < virtualTime)
+                    account->pass = virtualTime;
+
+                return waiters.empty() && freeWorkers > 0 &&
+                       (account->maxConcurrency == 0 || account->running < account->maxConcurrency);
+            }
+
+            inline bool hasWaiters() {
+                return numWaiters.load(std::memory_order_relaxed) != 0;
+            }
+        };
+
+        /** Execution times of a task measured while its graph is profiled
+         */
+        struct TaskStatistics {
+            /**
+             * Number of recent samples kept to compute the percentiles
+             */
+            static const unsigned int NUM_RECENT_TIMES = 16;
+
+            /**
+             * Exponentially weighted moving average of the execution time in nanoseconds
+             */
+            unsigned long averageTime;
+
+            unsigned long numExecutions;
+
+            /**
+             * Ring of the most recent execution times in nanoseconds
+             */
+            unsigned int recentTimes[NUM_RECENT_TIMES];
+
+            void addSample(unsigned long time);
+
+            /**
+             * @return The 95th percentile of the recent execution times
+             */
+            unsigned long getP95Time();
+        };
+
+        /** Node started during a recorded execution and the worker that started it
+         */
+        struct ScheduleEntry {
+            /**
+             * Index of the node in the plan
+             */
+            unsigned int node;
+
+            /**
+             * Index of the worker in the pool, -1 for the thread that executes the graph
+             */
+            int worker;
+        };
+
+        /** Data of a dependency between two tasks
+         */
+        struct TaskDependency{
+            /** Source task of the dependency
+             */
+            Task* fromTask;
+
+            /** Target task of the dependency
+             */
+            Task* toTask;
+
+            /** Graph whose arena contains the dependency, nullptr if allocated on the heap
+             */
+            TaskGraph* ownerGraph;
+
+            TaskDependency(Task *fromTask, Task *toTask, TaskGraph *ownerGraph);
+        };
+
+        /** Thread that waits with epoll for the events of the event tasks, see EventReactor below
+         */
+        struct EventReactor;
+
+        /** Flat representation of a TaskGraph and of its subgraphs used for the execution,
+         * allocated in the arena of the graph
+         */
+        struct ExecutionPlan {
+            /** Node of the plan; every node fills its own cache lines so that
+             * the completion of a node never invalidates the line of an other node
+             */
+            struct alignas(PThreadPool::CACHE_LINE_SIZE) Node {
+                /**
+                 * Number of already satisfied dependencies
+                 */
+                std::atomic<unsigned int> satisfiedDependencies;
+
+                /**
+                 * Number of dependencies inside the plan
+                 */
+                unsigned int numDependencies;
+
+                /**
+                 * Index of the first successor in the successors array
+                 */
+                unsigned int firstSuccessor;
+
+                unsigned int numSuccessors;
+
+                /**
+                 * Index of the first task of the node in the members array
+                 */
+                unsigned int firstMember;
+
+                /**
+                 * Number of tasks executed in sequence by the node, more than one if the graph is coarsened
+                 */
+                unsigned int numMembers;
+
+                /**
+                 * Index of the worker that executed the node in the last execution, -1 if not executed by a worker
+                 */
+                int lastWorker;
+
+                /**
+                 * Worker that should execute the node in the current execution, -1 for any worker
+                 */
+                int preferredWorker;
+
+                /**
+                 * Worker the node is pinned to, -1 if not pinned
+                 */
+                int pinnedWorker;
+
+                /**
+                 * True if the node is a dummy task, the node is resolved without being dispatched
+                 */
+                bool dummy;
+
+                /**
+                 * True if the worker that executes the node in the current execution has been taken from the FairShare
+                 */
+                bool shared;
+
+                /**
+                 * Event that must happen before the node is dispatched, nullptr for a node that only waits its dependencies
+                 */
+                EventTask* event;
+
+                /**
+                 * Estimated cost of the longest path from the node to the end of the graph,
+                 * the ready nodes with the highest rank are executed first
+                 */
+                unsigned long rank;
+
+                /**
+                 * Time spent executing the tasks of the node in the last execution in nanoseconds, measured only while profiling
+                 */
+                unsigned long lastTime;
+
+                ExecutionPlan* plan;
+            };
+
+            /** Order of the ready queue: when the tasks have deadlines the node that must start first,
+             * otherwise the highest rank first
+             */
+            struct NodeRankLess {
+                inline bool operator()(const Node* a, const Node* b) const {
+                    const unsigned long* latestStarts = a->plan->latestStarts;
+
+                    if (latestStarts != nullptr) {
+                        unsigned long aStart = latestStarts[a - a->plan->nodes];
+                        unsigned long bStart = latestStarts[b - b->plan->nodes];
+
+                        if (aStart != bStart)
+                            return aStart > bStart;
+                    }
+
+                    return a->rank < b->rank;
+                }
+            };
+
+            typedef ThreadSafeQueue<Node*, std::priority_queue<Node*, std::vector<Node*>, NodeRankLess>> NodeQueue;
+
+            /** Function executed by a node
+             */
+            struct Member {
+                /**
+                 * Function to be executed, nullptr for a dummy task
+                 */
+                void (*execute)(void*);
+
+                void* args;
+
+                /**
+                 * Task of the function, nullptr if the plan has been loaded from a GraphTopology
+                 */
+                Task* task;
+            };
+
+            /**
+             * Nodes in topological order
+             */
+            Node* nodes;
+
+            unsigned int numNodes;
+
+            /**
+             * Functions of all the nodes in topological order, the ones of a node are contiguous
+             */
+            Member* members;
+
+            unsigned int numMembers;
+
+            /**
+             * Indexes of the successors of all the nodes, the ones of a node are contiguous
+             */
+            unsigned int* successors;
+
+            unsigned int numSuccessors;
+
+            Node* startNode;
+
+            Node* endNode;
+
+            /**
+             * Queue of the nodes ready to be executed, created by the first execution
+             */
+            NodeQueue* readyQueue;
+
+            /**
+             * Latest time from the start of the execution at which every node can start without missing
+             * the deadlines of its tasks and of their successors, ULONG_MAX without deadlines;
+             * nullptr if no task has a deadline
+             */
+            unsigned long* latestStarts;
+
+            /**
+             * True if the execution times of the tasks are measured
+             */
+            bool profiling;
+
+            /**
+             * True if the nodes prefer the worker that executed them in the previous execution
+             */
+            bool affinity;
+
+            /**
+             * True if at least one node is pinned to a worker
+             */
+            bool pinned;
+
+            /**
+             * Sum of the estimated costs of the tasks when the plan was compiled
+             */
+            unsigned long estimatedWork;
+
+            /**
+             * Maximum number of ready tasks that a worker executes directly
+             * after the one it was given during the current execution
+             */
+            unsigned int maxInlineDepth;
+
+            /**
+             * Token of the current execution, nullptr if it can not be cancelled
+             */
+            CancellationToken* cancellation;
+
+            /**
+             * True if a task has thrown during the current execution
+             */
+            std::atomic<bool> failed;
+
+            /**
+             * First exception thrown by a task during the current execution
+             */
+            std::exception_ptr exception;
+
+            /**
+             * True if the deadline of the last execution passed before its end
+             */
+            std::atomic<bool> expired;
+
+            /**
+             * Nodes in the order they are started by the current execution, nullptr if the graph is not recorded
+             */
+            ScheduleEntry* record;
+
+            std::atomic<unsigned int> recordSize;
+
+            /**
+             * True if the current execution follows a schedule, every node counts its start in replayStarted
+             */
+            bool replaying;
+
+            std::atomic<unsigned int> replayStarted;
+
+            /**
+             * Share of the workers used by the current execution and account of its tenant,
+             * nullptr for an execution in the high lane or replayed that does not take part in the share
+             */
+            FairShare* fairShare;
+
+            FairShare::Account* account;
+
+            /**
+             * Account of the executions of a graph without a tenant
+             */
+            FairShare::Account defaultAccount;
+
+            /**
+             * True if the calling thread executed at least one node of the last execution
+             */
+            bool callerParticipated;
+
+            /**
+             * True while the calling thread executes a node, the ready queue is not dispatched meanwhile
+             * and the workers that complete a node take the ready nodes from it
+             */
+            std::atomic<bool> callerBusy;
+
+            /**
+             * Reactor that waits the events of the nodes during the current execution
+             */
+            EventReactor* reactor;
+
+            /**
+             * Functions given to the pool and events not yet happened, the workers release their share and
+             * an expired execution returns without waiting for them; on its own cache line since every completion writes it
+             */
+            alignas(PThreadPool::CACHE_LINE_SIZE) std::atomic<unsigned int> runningFunctions;
+
+            /**
+             * Wait for the functions of the previous execution still running on the workers
+             * @param deadline Absolute time of CLOCK_MONOTONIC, nullptr to wait without a limit
+             * @return False if they did not complete before the deadline
+             */
+            bool waitFunctions(const timespec* deadline);
+
+            /**
+             * Wait for the running functions and delete the ready queue, called before the memory of the plan is released
+             */
+            void release();
+
+            /**
+             * @return True if a task has thrown or the token has been cancelled, the remaining tasks are skipped
+             */
+            bool isCancelled();
+
+            /**
+             * Record the exception if it is the first one of the execution and cancel the remaining tasks
+             */
+            void fail(std::exception_ptr exception);
+
+            /**
+             * Set the preferred worker of every node from its pinned worker or,
+             * with affinity, from the worker of the previous execution
+             */
+            void assignWorkers(unsigned int numWorkers);
+
+            /**
+             * Set all the dependencies as unsatisfied
+             */
+            void reset();
+
+            /**
+             * @return The nodes of the path from the start node to the end node with the highest estimated cost
+             */
+            std::vector<Node*> getCriticalPath();
+
+            /**
+             * Compute the rank of every node from the estimated costs of its tasks
+             * @return The sum of the estimated costs of all the tasks
+             */
+            unsigned long computeRanks();
+
+            /**
+             * Execute in order the functions of a node
+             * @param worker Index of the worker that executes the node, -1 for the thread that executes the plan
+             */
+            static void runNode(Node* node, int worker);
+
+            /**
+             * Entry point of the nodes given to the workers, execute the node on the current worker
+             */
+            static void runNode(void* args);
+
+            /**
+             * Free the dependencies of the successors of a node; the ready dummy successors are resolved
+             * immediately, the ready node with the highest rank is returned in inlineNode if it is not nullptr,
+             * all the other ready nodes are put in the ready queue
+             */
+            static void releaseSuccessors(Node* node, Node** inlineNode);
+
+            /**
+             * Called after the execution of the task of a node, free the dependencies of its successors
+             * and execute directly the ready ones up to the maximum inline depth
+             */
+            static void nodeCompleted(void* args);
+
+            /**
+             * Take a ready node from the queue for the current worker while the calling thread executes a node
+             * @return nullptr if no node can be executed by the current worker
+             */
+            Node* takeReadyNode();
+
+            /**
+             * True if the worker of a node of the current execution must be taken from the share: always for a graph
+             * with a tenant, only while other graphs are executed for a graph without
+             */
+            inline bool takesShare() {
+                return fairShare != nullptr &&
+                       (account != &defaultAccount || fairShare->numExecutions.load(std::memory_order_relaxed) > 1);
+            }
+        };
+
+        /** Chunk of an array processed by a worker during a parallelMap
+         */
+        struct MapChunk {
+            /**
+             * First and past-the-end indexes of the chunk
+             */
+            long begin;
+            long end;
+
+            void (*kernel)(long, long, void*);
+
+            void* args;
+
+            /**
+             * Number of chunks of the map not yet completed
+             */
+            std::atomic<unsigned int>* remaining;
+
+            /**
+             * Notified by the last completed chunk
+             */
+            ThreadSafeQueue<MapChunk*>* doneQueue;
+
+            static void run(void* args);
+
+            static void completed(void* args);
+        };
+
+        /** Thread that waits with epoll for the fds, timers and user events of the event tasks; the node of an
+         * event task is armed when its dependencies are satisfied and is put in the ready queue of its plan when
+         * the event happens, so no worker is blocked while the input of a graph is not yet available
+         */
+        struct EventReactor {
+            /**
+             * Milliseconds between two checks of the armed nodes of cancelled and expired executions
+             */
+            static const int CANCEL_CHECK_INTERVAL = 10;
+
+            pthread_mutex_t mutex;
+
+            /**
+             * Epoll instance of the armed events and eventfd that wakes up the thread
+             */
+            int epollFd;
+            int wakeFd;
+
+            pthread_t thread;
+
+            /**
+             * True once the thread has been created by the first armed node
+             */
+            bool started;
+
+            bool stopping;
+
+            /**
+             * Nodes waiting for their event
+             */
+            std::vector<ExecutionPlan::Node*> armed;
+
+            EventReactor();
+
+            ~EventReactor();
+
+            /**
+             * Start waiting for the event of a node whose dependencies are satisfied
+             */
+            void arm(ExecutionPlan::Node* node);
+
+            /**
+             * Stop waiting for the event of an armed node and put it in the ready queue, called with the mutex locked
+             */
+            void fire(ExecutionPlan::Node* node);
+
+            static void* run(void* args);
+        };
+
+        /** Ranges of a parallelFor shared by the workers; every worker splits its own ranges in halves
+         * down to the grain size and the ready workers steal the largest halves of the others
+         */
+        struct RangeWork;
+
+        /** Base class of all the elements of a TaskGraph
+         */
+        class TaskElement{
+        protected:
+            /** Parent of a Task or a TaskGraph
+             */
+            TaskGraph* parentGraph;
+
+        public:
+
+            void setParentGraph(TaskGraph* taskGraph);
+
+            TaskGraph* getParentGraph();
+
+            /**
+             * Add a dependency from Task to TaskGraph or from TaskGraph to TaskGraph
+             * @param taskGraph The target TaskGraph
+             */
+            virtual void addDependencyTo(TaskGraph* taskGraph) noexcept(false) = 0;
+
+            /**
+             * Add a dependency from Task to Task or from TaskGraph to Task
+             * @param task
+             */
+            virtual void addDependencyTo(Task* task) noexcept(false) = 0;
+        };
+
+        /** ThreadPool for the execution of the Tasks
+         */
+        PThreadPool* pThreadPool;
+
+        template<typename Context, typename... Tasks>
+        friend class StaticGraph;
+
+        template<typename T>
+        friend class WorkerLocal;
+
+        /** Share of the workers among the graphs executed at the same time
+         */
+        FairShare* fairShare;
+
+        /** Waits for the events of the event tasks, its thread is created by the first event
+         */
+        EventReactor* eventReactor;
+
+        /** Maximum number of ready tasks that a worker executes directly after a completion
+         */
+        unsigned int maxInlineDepth;
+
+        /** True if the thread that executes a graph runs the ready tasks that no worker can take right away
+         */
+        bool callerParticipation;
+
+        /**
+         * Plan of the node executed by the current thread, nullptr outside of the tasks
+         */
+        static thread_local ExecutionPlan* currentPlan;
+
+        /**
+         * Execute all the nodes of a plan and wait for the end node; once the execution is cancelled
+         * the dispatcher resolves the ready nodes itself without executing their tasks
+         * @return True if the execution has been cancelled by the token
+         */
+        ExecutionStatus executePlan(ExecutionPlan* plan, CancellationToken* cancellation, const timespec* deadline,
+                                    Tenant* tenant, PThreadPool::Priority priority, Schedule* replay);
+
+        /**
+         * Give a ready node to the workers, after taking a worker from the share if the plan takes part in it
+         * @param deadline Absolute time of CLOCK_MONOTONIC, nullptr to wait without a limit
+         * @return False if the node has not been given to a worker before the deadline
+         */
+        bool dispatchNode(ExecutionPlan* plan, ExecutionPlan::Node* node, const timespec* deadline,
+                          PThreadPool::Priority priority);
+
+        /**
+         * Give a ready node to a worker only if a worker, and its share, can be taken right away
+         * @return False if no worker can take the node now
+         */
+        bool tryDispatchNode(ExecutionPlan* plan, ExecutionPlan::Node* node, PThreadPool::Priority priority);
+
+        /**
+         * Dispatch the nodes of a prepared plan in the order of a schedule, each one to the worker of the
+         * schedule and only after the previous one has started; the nodes are never executed inline
+         */
+        ExecutionStatus replaySchedule(ExecutionPlan* plan, Schedule* schedule, CancellationToken* cancellation,
+                                       const timespec* deadline);
+
+        /**
+         * Rethrow the first exception thrown by a task of the last execution of the plan, if any
+         * @param status Status returned by executePlan, the exceptions of an expired execution are not rethrown
+         */
+        static ExecutionStatus rethrowFailure(ExecutionPlan* plan, ExecutionStatus status);
+
+        /**
+         * Execute the graph and update its profile
+         * @param deadline Absolute time of CLOCK_MONOTONIC, nullptr for no deadline
+         */
+        ExecutionStatus executeGraph(TaskGraph* taskGraph, CancellationToken* cancellation, const timespec* deadline);
+
+        /**
+         * Execute the range of a parallelFor with the ready workers and the calling thread
+         */
+        void executeRangeWork(RangeWork* work, const BlockedRange2D& range);
+
+    public:
+        struct CyclicGraphException: std::exception{
+        public:
+            CyclicGraphException() {}
+            CyclicGraphException(const CyclicGraphException&) noexcept {}
+            CyclicGraphException& operator= (const CyclicGraphException& ) noexcept{return *this;}
+
+            const char* what() const noexcept {
+                return const_cast<char *>(" A GraphTask must not be cyclic! The dependency has been removed ");
+            }
+        };
+
+        struct TaskElementParentingException : std::exception{
+        public:
+            TaskElementParentingException() {}
+            TaskElementParentingException(const TaskElementParentingException&) noexcept {}
+            TaskElementParentingException& operator= (const TaskElementParentingException& ) noexcept{return *this;}
+
+            const char* what() const noexcept {
+                return const_cast<char *>("Dependency type is not allowed");
+            }
+        };
+
+        struct PipelineConfigurationException : std::exception{
+        public:
+            PipelineConfigurationException() {}
+            PipelineConfigurationException(const PipelineConfigurationException&) noexcept {}
+            PipelineConfigurationException& operator= (const PipelineConfigurationException& ) noexcept{return *this;}
+
+            const char* what() const noexcept {
+                return const_cast<char *>("A Pipeline needs an input stage and at least one in-flight token");
+            }
+        };
+
+        struct GraphTopologyException : std::exception{
+        public:
+            GraphTopologyException() {}
+            GraphTopologyException(const GraphTopologyException&) noexcept {}
+            GraphTopologyException& operator= (const GraphTopologyException& ) noexcept{return *this;}
+
+            const char* what() const noexcept {
+                return const_cast<char *>("Invalid graph topology file or function missing from the function table");
+            }
+        };
+
+        struct EventRegistrationException : std::exception{
+        public:
+            EventRegistrationException() {}
+            EventRegistrationException(const EventRegistrationException&) noexcept {}
+            EventRegistrationException& operator= (const EventRegistrationException& ) noexcept{return *this;}
+
+            const char* what() const noexcept {
+                return const_cast<char *>("The event of an EventTask can not be waited with epoll");
+            }
+        };
+
+        /** Flag shared between the caller of an execution and its tasks to stop it early;
+         * a cancelled token stops the execution of the tasks not yet started, the running ones can poll it
+         */
+        class CancellationToken {
+            std::atomic<bool> cancelled;
+
+        public:
+            CancellationToken() : cancelled(false) {}
+
+            inline void cancel() {
+                cancelled.store(true, std::memory_order_release);
+            }
+
+            inline bool isCancelled() {
+                return cancelled.load(std::memory_order_acquire);
+            }
+
+            /**
+             * Allow the token to be used for an other execution
+             */
+            inline void reset() {
+                cancelled.store(false, std::memory_order_release);
+            }
+        };
+
+        /** Client of the TaskSystem whose graphs get a share of the workers proportional to its weight
+         * while graphs of other tenants are executed at the same time
+         */
+        class Tenant {
+            FairShare::Account account;
+
+            friend class TaskSystem;
+
+        public:
+            /**
+             * @param weight Relative share of the workers, at least 1
+             * @param maxConcurrency Maximum number of workers used at the same time by the graphs of the tenant, 0 for no limit
+             */
+            explicit Tenant(unsigned int weight = 1, unsigned int maxConcurrency = 0);
+
+            unsigned int getWeight();
+
+            unsigned int getMaxConcurrency();
+        };
+
+        struct ScheduleMismatchException : std::exception{
+        public:
+            ScheduleMismatchException() {}
+            ScheduleMismatchException(const ScheduleMismatchException&) noexcept {}
+            ScheduleMismatchException& operator= (const ScheduleMismatchException& ) noexcept{return *this;}
+
+            const char* what() const noexcept {
+                return const_cast<char *>("The schedule does not start every node of the execution plan once");
+            }
+        };
+
+        /** Order in which the nodes of the plan of a TaskGraph have been started by a recorded execution and
+         * the worker of every node; a replayed execution starts the nodes in the same order on the same workers
+         */
+        class Schedule {
+            /**
+             * Number of nodes of the plan of the recorded execution
+             */
+            unsigned int numNodes;
+
+            std::vector<ScheduleEntry> entries;
+
+            /**
+             * True if the schedule starts once every node of the plan that executes tasks
+             */
+            bool matches(ExecutionPlan* plan);
+
+            friend class TaskSystem;
+            friend class TaskGraph;
+
+        public:
+            Schedule();
+
+            /**
+             * @return The number of started nodes
+             */
+            unsigned long size();
+
+            /**
+             * @return The index in the plan of the i-th started node
+             */
+            unsigned int getNode(unsigned long i);
+
+            /**
+             * @return The worker that started the i-th node, -1 for the thread that executed the graph
+             */
+            int getWorker(unsigned long i);
+
+            /**
+             * Write the schedule as text, one node and its worker per line
+             */
+            void save(std::ostream& out);
+
+            /**
+             * Read a schedule written by save
+             * @return False if the stream does not contain a valid schedule, the schedule is not changed
+             */
+            bool load(std::istream& in);
+
+            bool operator==(const Schedule &rhs) const;
+            bool operator!=(const Schedule &rhs) const;
+        };
+
+        /** Work and span of a TaskGraph computed from the estimated costs of its tasks,
+         * together with the times observed in its last execution
+         */
+        struct GraphAnalysis {
+            /**
+             * Sum of the estimated costs of all the tasks in nanoseconds
+             */
+            unsigned long work;
+
+            /**
+             * Estimated cost of the critical path in nanoseconds, the minimum execution time with any number of workers
+             */
+            unsigned long span;
+
+            /**
+             * Average parallelism work / span, the number of workers beyond which the speedup stops growing
+             */
+            double parallelism;
+
+            /**
+             * Number of workers of the last execution, 0 if the graph was never executed
+             */
+            unsigned int lastNumWorkers;
+
+            /**
+             * Duration of the last execution in nanoseconds
+             */
+            unsigned long lastExecutionTime;
+
+            /**
+             * Time spent by the workers executing tasks in the last execution, measured only while profiling
+             */
+            unsigned long lastBusyTime;
+
+            /**
+             * Time the workers did not spend executing tasks in the last execution, measured only while profiling
+             */
+            unsigned long lastIdleTime;
+
+            /**
+             * @return The speedup bound max(work / numWorkers, span) of any scheduling with the given number of workers
+             */
+            double getIdealSpeedup(unsigned int numWorkers);
+
+            /**
+             * @return The speedup guaranteed by a greedy scheduling, work / (work / numWorkers + span)
+             */
+            double getGreedySpeedup(unsigned int numWorkers);
+        };
+
+        /** Define a task that can be executed by the TaskSystem
+        */
+        class Task : public TaskElement {
+        private:
+            /**
+             * Identifier of the task
+             */
+            unsigned int taskID;
+
+            /** True if the task is dummy and it do not execute code
+             */
+            bool dummy;
+
+            /** dependencies that start from this task
+             */
+            std::vector<TaskDependency*> fromTask;
+
+            /**
+             * Dependencies that end in this task
+             */
+            std::vector<TaskDependency *> toTask;
+
+            /** Function to be executed
+             */
+            void (*execute)(void*);
+
+            /** Estimated execution time in nanoseconds, 0 if unknown
+             */
+            unsigned long costHint;
+
+            /** Worker that always executes the task, -1 for any worker
+             */
+            int pinnedWorker;
+
+            /** Time from the start of the execution of the graph by which the task should be completed in nanoseconds, 0 for none
+             */
+            unsigned long deadline;
+
+            /** Measured execution times, allocated in the arena of the parent graph when profiled
+             */
+            TaskStatistics* statistics;
+
+            /** The task itself if it is an EventTask, nullptr otherwise
+             */
+            EventTask* event;
+
+            friend class TaskGraph;
+            friend class TaskSystem;
+            friend class EventTask;
+
+            /**
+             * Mark the graphs that contain the task as changed
+             */
+            void invalidatePlans();
+
+        public:
+            Task();
+
+            Task(bool dummy);
+
+            Task(void (*execute)(void*));
+
+            virtual ~Task();
+
+            void setExecute(void (*execute)(void*));
+
+            /**
+             * Set the estimated execution time of the task, used to coarsen the graph
+             * @param costHint Estimated execution time in nanoseconds, 0 if unknown
+             */
+            void setCostHint(unsigned long costHint);
+
+            unsigned long getCostHint();
+
+            /**
+             * Pin the task to a worker, the task waits for its worker even if other workers are ready.
+             * Pinned tasks are never coarsened with other tasks and are never executed inline by an other worker
+             * @param pinnedWorker Index of the worker modulo the number of workers, -1 for any worker
+             */
+            void setPinnedWorker(int pinnedWorker);
+
+            int getPinnedWorker();
+
+            /**
+             * Set a deadline for the task; the ready tasks that must start first to meet the deadlines of
+             * their own and of their successors, estimated from the costs of the tasks, are executed first
+             * @param deadline Time from the start of the execution of the graph in nanoseconds, 0 for none
+             */
+            void setDeadline(unsigned long deadline);
+
+            unsigned long getDeadline();
+
+            /**
+             * @return The measured average execution time if the task has been profiled, the cost hint otherwise
+             */
+            unsigned long getEstimatedCost();
+
+            /**
+             * @return The exponentially weighted moving average of the measured execution times in nanoseconds,
+             * 0 if the task has never been profiled
+             */
+            unsigned long getAverageTime();
+
+            /**
+             * @return The 95th percentile of the recent measured execution times in nanoseconds,
+             * 0 if the task has never been profiled
+             */
+            unsigned long getP95Time();
+
+            /**
+             * @return The number of profiled executions of the task
+             */
+            unsigned long getNumProfiledExecutions();
+
+            /**
+             * Right call to start the execution of the task
+             */
+            void startTask(PThreadPool* pool,void (*callback)(void*),void* callbackArgs);
+
+            /**
+             * @return True if the task is a dummy task
+             */
+            bool isDummy();
+
+            std::vector<TaskDependency *> getToTask();
+
+            std::vector<TaskDependency *> getFromTask();
+
+            unsigned int getTaskID();
+
+            /**
+             * Add a dependency between two tasks
+             * @param taskStart Start task of the dependency
+             * @param taskEnd End task of the dependency
+             */
+            static TaskDependency* addDependencyBetween(Task* taskStart, Task* taskEnd);
+
+            /**
+             * Remove all the direct dependencies between two tasks if any
+             * @param taskStart Start task of the dependency
+             * @param taskEnd End task of the dependency
+             * @return True if at least one dependency has been removed
+             */
+            static bool removeDependencyBetween(Task* taskStart, Task* taskEnd);
+
+            /**
+             * Check if through the given dependency is possible to reach the given task
+             * @param dependency The dependency to explore
+             * @param task The task to check
+             */
+            static bool checkAcyclicDependency(TaskDependency dependency, Task* task);
+
+
+            bool operator==(const Task &rhs) const;
+            bool operator!=(const Task &rhs) const;
+
+            void addDependencyTo(TaskGraph *taskGraph) noexcept(false) override;
+            void addDependencyTo(Task *task) noexcept(false) override;
+        };
+
+        /** Task that is completed by an event outside of the graph: an fd that becomes readable, a timer or
+         * a signal from user code. After its dependencies the task waits for the event without taking a worker,
+         * then its function is executed by a worker like the one of any other task. Event tasks are never coarsened
+         */
+        class EventTask : public Task {
+        public:
+            enum EventType {
+                /**
+                 * The fd becomes readable
+                 */
+                FD_READABLE,
+
+                /**
+                 * The delay passes after the dependencies of the task are satisfied
+                 */
+                TIMER,
+
+                /**
+                 * signal is called, the signals before the task is armed are not lost
+                 */
+                USER_EVENT
+            };
+
+        private:
+            EventType type;
+
+            /**
+             * Fd waited with epoll and owned by the task: a duplicate of the fd of the user, a timerfd or an eventfd.
+             * The fd of the user is duplicated so that more tasks can wait for it at the same time
+             */
+            int fd;
+
+            /**
+             * Fd passed by the user to an FD_READABLE task, -1 for the other types
+             */
+            int userFd;
+
+            std::chrono::nanoseconds delay;
+
+            friend class TaskSystem;
+
+        public:
+            /**
+             * Create a task completed by signal
+             */
+            EventTask();
+
+            /**
+             * Create a task completed when the fd becomes readable, the fd is not read nor closed by the task;
+             * the task waits for a duplicate of the fd, closed by its destructor
+             */
+            explicit EventTask(int fd);
+
+            /**
+             * Create a task completed when the delay passes after its dependencies are satisfied
+             */
+            explicit EventTask(std::chrono::nanoseconds delay);
+
+            EventTask(const EventTask&) = delete;
+            EventTask& operator=(const EventTask&) = delete;
+
+            ~EventTask() override;
+
+            /**
+             * Complete a USER_EVENT task; it can be called from any thread, also before the task is armed
+             */
+            void signal();
+
+            void setDelay(std::chrono::nanoseconds delay);
+
+            std::chrono::nanoseconds getDelay();
+
+            EventType getType();
+
+            /**
+             * @return The fd passed to the constructor of an FD_READABLE task, the timerfd or the eventfd of the others
+             */
+            int getFd();
+        };
+
+
+        /** Graph of tasks to be executed
+        */
+        class TaskGraph : public TaskElement{
+
+            class DummyStartEndTask : public Task{
+            public:
+                DummyStartEndTask() : Task(true){
+                }
+
+            private:
+            };
+
+            /** Subgraphs contained in this Graph
+             */
+            std::vector<TaskGraph*> subGraphs;
+
+            /** Tasks directlly in this graph
+             */
+            std::vector<Task*> tasks;
+
+            /** Start and End dummy tasks
+             */
+            DummyStartEndTask start;
+            DummyStartEndTask end;
+
+            friend class Task;
+            friend class TaskSystem;
+
+            /** Memory of the dependencies created inside this graph and of the statistics of its tasks
+             */
+            GraphArena graphArena;
+
+            /** Dependencies removed from this graph that can be reused
+             */
+            std::vector<TaskDependency*> freeDependencies;
+
+            /** Memory of the execution plan, released every time the plan is compiled again
+             */
+            GraphArena planArena;
+
+            /** Plan for the execution of this graph, nullptr if the graph changed since the last compile
+             */
+            ExecutionPlan* plan;
+
+            /** Plan invalidated by a change of the graph, released by the next compile
+             */
+            ExecutionPlan* retiredPlan;
+
+            /** Maximum estimated cost of a group of tasks merged in a single node, 0 disable the coarsening
+             */
+            unsigned long coarseningGrain;
+
+            /** True if the execution times of the tasks are measured
+             */
+            bool profiling;
+
+            /** True if the tasks prefer the worker that executed them in the previous execution
+             */
+            bool affinity;
+
+            /** Tenant of the executions of the graph, nullptr to give every execution its own share of weight 1
+             */
+            Tenant* tenant;
+
+            /** Lane of the pool in which the tasks of the graph are executed
+             */
+            PThreadPool::Priority priority;
+
+            /** True if the order in which the nodes are started is recorded
+             */
+            bool recording;
+
+            /** Schedule forced on the executions of the graph, nullptr to schedule them freely
+             */
+            Schedule* replay;
+
+            /** Number of workers, duration and busy time of the last execution
+             */
+            unsigned int lastNumWorkers;
+            unsigned long lastExecutionTime;
+            unsigned long lastBusyTime;
+
+            /**
+             * Update the plan with the execution times measured during the last execution
+             */
+            void updateProfile();
+
+            /**
+             * Group the tasks of the plan in coarser nodes without violating the dependencies
+             * @param groupOf Filled with the node of every task
+             * @return The number of nodes
+             */
+            unsigned int coarsen(std::vector<Task*>& planTasks, std::vector<std::vector<unsigned int>>& taskSuccessors,
+                                 std::vector<unsigned int>& numPredecessors, std::vector<unsigned int>& order,
+                                 std::vector<unsigned int>* groupOf);
+
+            TaskDependency* newDependency(Task* fromTask, Task* toTask);
+
+            void deleteDependency(TaskDependency* dependency);
+
+            /**
+             * Discard the plan of this graph and of all its parents
+             */
+            void invalidatePlan();
+
+            /**
+             * Collect all the tasks of this graph and of its subgraphs
+             */
+            void collectTasks(std::vector<Task*>* out);
+
+            /**
+             * Write the tasks of this graph and, recursively, its subgraphs as nested clusters
+             */
+            void writeDotCluster(std::ostream& out, std::unordered_map<Task*, ExecutionPlan::Node*>& taskNodes,
+                                 std::unordered_map<Task*, unsigned int>& criticalTasks, bool annotate, unsigned int depth);
+
+            /**
+             * Write this graph and, recursively, its subgraphs as nested JSON objects
+             */
+            void writeJSONGraph(std::ostream& out, std::unordered_map<Task*, ExecutionPlan::Node*>& taskNodes,
+                                std::unordered_map<Task*, unsigned int>& criticalTasks, bool annotate);
+
+            /**
+             * Map every task to its node of the plan and every task of the critical path to its position on the path
+             */
+            void mapPlanTasks(std::unordered_map<Task*, ExecutionPlan::Node*>* taskNodes,
+                              std::unordered_map<Task*, unsigned int>* criticalTasks);
+
+        public:
+            TaskGraph();
+
+            ~TaskGraph();
+
+            /**
+             * Add the new task to the taskGraph
+             * @param task
+             */
+            void addTask(Task* task) noexcept (false);
+
+            void addSubGraph(TaskGraph* subGraph) noexcept (false);
+
+            void addDependencyTo(TaskGraph* taskGraph) noexcept(false) override;
+            void addDependencyTo(Task* task) noexcept(false) override;
+
+            /**
+             * Build the execution plan of the graph if it changed since the last compile;
+             * the execution compiles the graph when needed
+             */
+            void compile();
+
+            /**
+             * Enable the coarsening of the plan: chains of tasks and tasks with the same predecessor and
+             * successor are merged in nodes executed by a single worker, up to the given estimated cost.
+             * Tasks without a cost estimate are never merged
+             * @param coarseningGrain Maximum estimated cost of a node in nanoseconds, 0 disable the coarsening
+             */
+            void setCoarseningGrain(unsigned long coarseningGrain);
 
-    private:
+            unsigned long getCoarseningGrain();
 
-        /** Data of a dependency between two tasks
-         */
-        struct TaskDependency{
-            /** Source task of the dependency
+            /**
+             * Measure the execution time of every task at every execution. The measured times replace the
+             * cost hints in the ordering of the ready tasks and in the coarsening of the following executions
+             * @param profiling True to enable the profiling
              */
-            Task* fromTask;
+            void setProfiling(bool profiling);
 
-            /** Target task of the dependency
+            bool isProfiling();
+
+            /**
+             * Execute every task preferably on the worker that executed it in the previous execution, so that
+             * the data it uses is still in the cache of that worker; a task is executed by an other worker
+             * only if its worker is busy while an other one is ready
+             * @param affinity True to enable the affinity
              */
-            Task* toTask;
+            void setAffinity(bool affinity);
 
-            TaskDependency(Task *fromTask, Task *toTask);
+            bool hasAffinity();
 
-            virtual ~TaskDependency();
-        };
+            /**
+             * Execute the graph on behalf of a tenant; the tenant must live as long as the executions of the graph
+             * @param tenant The tenant, nullptr to give every execution its own share of weight 1
+             */
+            void setTenant(Tenant* tenant);
 
-        /** Base class of all the elements of a TaskGraph
-         */
-        class TaskElement{
-        protected:
-            /** Parent of a Task or a TaskGraph
+            Tenant* getTenant();
+
+            /**
+             * Execute the tasks of the graph in a lane of the pool; the tasks of a HIGH graph take the workers
+             * reserved to the high lane and the first shared workers that complete, without waiting for the share
+             * of a tenant and without preferring the workers of the affinity
+             * @param priority The lane, NORMAL by default
              */
-            TaskGraph* parentGraph;
+            void setPriority(PThreadPool::Priority priority);
 
-        public:
+            PThreadPool::Priority getPriority();
 
-            void setParentGraph(TaskGraph* taskGraph);
+            /**
+             * Allocate the compiled plan from 2MB huge pages and fault its pages at compile time,
+             * so that the first execution after a compile takes no page fault and every execution fewer TLB misses;
+             * meant for graphs of many tasks, the plan takes at least 2MB
+             */
+            void setHugePages(bool hugePages);
 
-            TaskGraph* getParentGraph();
+            bool isHugePages();
 
             /**
-             * Add a dependency from Task to TaskGraph or from TaskGraph to TaskGraph
-             * @param taskGraph The target TaskGraph
+             * Record at every execution the order in which the nodes of the plan are started and their workers,
+             * with an atomic increment per node; a change of the plan, like a new coarsening, changes the nodes
+             * @param recording True to enable the recording
              */
-            virtual void addDependencyTo(TaskGraph* taskGraph) noexcept(false) = 0;
+            void setRecording(bool recording);
+
+            bool isRecording();
 
             /**
-             * Add a dependency from Task to Task or from TaskGraph to Task
-             * @param task
+             * @return The schedule recorded by the last execution, empty if the graph is not recorded
              */
-            virtual void addDependencyTo(Task* task) noexcept(false) = 0;
-        };
+            Schedule getLastSchedule();
 
-        /** ThreadPool for the execution of the Tasks
-         */
-        PThreadPool* pThreadPool;
+            /**
+             * Force a schedule on the following executions: every node is started in the order of the schedule on its
+             * worker, after the previous one, and no node is executed inline. The executions throw a
+             * ScheduleMismatchException if the plan changed since the recording. Tenant and priority are ignored
+             * @param replay The schedule, it must live as long as it is set; nullptr to schedule the executions freely
+             */
+            void setReplay(Schedule* replay);
 
-    public:
-        struct CyclicGraphException: std::exception{
-        public:
-            CyclicGraphException() {}
-            CyclicGraphException(const CyclicGraphException&) noexcept {}
-            CyclicGraphException& operator= (const CyclicGraphException& ) noexcept{return *this;}
+            Schedule* getReplay();
 
-            const char* what() const noexcept {
-                return const_cast<char *>(" A GraphTask must not be cyclic! The dependency has been removed ");
-            }
-        };
+            /**
+             * @return The number of nodes of the compiled plan, compile the graph if needed
+             */
+            unsigned int getNumPlanNodes();
 
-        struct TaskElementParentingException : std::exception{
-        public:
-            TaskElementParentingException() {}
-            TaskElementParentingException(const TaskElementParentingException&) noexcept {}
-            TaskElementParentingException& operator= (const TaskElementParentingException& ) noexcept{return *this;}
+            /**
+             * Compute work, span and parallelism from the cost hints or the measured times of the tasks,
+             * compile the graph if needed
+             * @return The analysis with the times observed in the last execution
+             */
+            GraphAnalysis analyze();
 
-            const char* what() const noexcept {
-                return const_cast<char *>("Dependency type is not allowed");
-            }
+            /**
+             * Save the topology of the compiled plan to a file that can be loaded by a GraphTopology.
+             * The functions of the tasks are saved as indexes in the function table
+             * @param path Path of the file
+             * @param functionTable Functions of the tasks of the graph
+             * @param numFunctions Number of functions in the table
+             * @param memberTasks If not nullptr, filled with the task of every function in the order of the file
+             */
+            void saveTopology(const char* path, void (**functionTable)(void*), unsigned int numFunctions,
+                              std::vector<Task*>* memberTasks = nullptr) noexcept(false);
+
+            /**
+             * Write the graph in the GraphViz DOT format, every subgraph is a cluster and the dependencies
+             * created by addTask and addSubGraph with the start and end tasks are included. Compile the graph if needed
+             * @param out Stream where the graph is written
+             * @param annotate True to add the estimated and measured times, the critical path and
+             * the worker that executed every task in the last execution
+             */
+            void exportDot(std::ostream& out, bool annotate = true);
+
+            /**
+             * Write the graph in JSON, with the same information of exportDot
+             * @param out Stream where the graph is written
+             * @param annotate True to add the estimated and measured times, the critical path and
+             * the worker that executed every task in the last execution
+             */
+            void exportJSON(std::ostream& out, bool annotate = true);
+
+            DummyStartEndTask* getStart();
+
+            DummyStartEndTask* getEnd();
         };
 
-        /** Define a task that can be executed by the TaskSystem
-        */
-        class Task : public TaskElement {
+
+        /** Topology of a compiled TaskGraph loaded from a file. The file is mapped in memory and its arrays
+         * are used directly by the execution, binding the functions does not need any parsing
+         */
+        class GraphTopology {
         private:
-            /**
-             * Identifier of the task
+            friend class TaskSystem;
+            friend class TaskGraph;
+
+            /** Header of the file, followed by the arrays nodeFirstSuccessor[numNodes + 1],
+             * nodeFirstMember[numNodes + 1], memberFunctions[numMembers] and successors[numSuccessors]
              */
-            unsigned int taskID;
+            struct FileHeader {
+                char magic[8];
+                unsigned int version;
+                unsigned int numNodes;
+                unsigned int numMembers;
+                unsigned int numSuccessors;
+                unsigned int startNode;
+                unsigned int endNode;
+            };
 
-            /** True if the task is dummy and it do not execute code
+            static constexpr unsigned int VERSION = 1;
+
+            /** Function index of the dummy tasks
              */
-            bool dummy;
+            static constexpr unsigned int NO_FUNCTION = 0xFFFFFFFF;
 
-            /** dependencies that start from this task
+            static const char MAGIC[8];
+
+            void* mapping;
+
+            size_t mappingSize;
+
+            const FileHeader* header;
+
+            const unsigned int* nodeFirstSuccessor;
+
+            const unsigned int* nodeFirstMember;
+
+            const unsigned int* memberFunctions;
+
+            const unsigned int* successors;
+
+            /** Memory of the nodes and of the functions of the plan
              */
-            std::vector<TaskDependency*> fromTask;
+            GraphArena planArena;
+
+            /** Plan for the execution, nullptr if the functions are not bound
+             */
+            ExecutionPlan* plan;
+
+            void unload();
+
+        public:
+            GraphTopology();
+
+            virtual ~GraphTopology();
 
             /**
-             * Dependencies that end in this task
+             * Map in memory a file saved by TaskGraph::saveTopology
+             * @param path Path of the file
              */
-            std::vector<TaskDependency *> toTask;
+            void load(const char* path) noexcept(false);
 
             /**
-             * Mutex used for the join call
+             * Build the plan for the execution with the given functions
+             * @param functionTable Table of functions used to save the topology
+             * @param numFunctions Number of functions in the table
+             * @param memberArgs Argument of every function in the order of the file, nullptr to pass nullptr to all
              */
-            pthread_mutex_t dependencyMutex;
+            void bind(void (**functionTable)(void*), unsigned int numFunctions, void** memberArgs) noexcept(false);
+
+            unsigned int getNumNodes();
+
+            unsigned int getNumMembers();
 
             /**
-             * Number of already satisfied dependencies
+             * Allocate the plans built from now on from 2MB huge pages and fault their pages when they are bound,
+             * like TaskGraph::setHugePages
              */
-            unsigned int satisfiedDependencies;
+            void setHugePages(bool hugePages);
 
-            /** Function to be executed
+            bool isHugePages();
+        };
+
+
+        /** Range of indexes [begin, end) that can be split in halves down to a grain size
+         */
+        class BlockedRange {
+        private:
+            long begin;
+            long end;
+
+            /**
+             * Maximum size of a range that is not split
              */
-            void (*execute)(void*);
+            long grainSize;
 
         public:
-            Task();
+            BlockedRange();
 
-            Task(bool dummy);
+            BlockedRange(long begin, long end, long grainSize = 1);
 
-            Task(void (*execute)(void*));
+            long getBegin() const;
 
-            virtual ~Task();
+            long getEnd() const;
 
-            void setExecute(void (*execute)(void*));
+            long getGrainSize() const;
+
+            long size() const;
+
+            bool empty() const;
 
             /**
-             * Right call to start the execution of the task
+             * @return True if the range is larger than the grain size
              */
-            void startTask(PThreadPool* pool,void (*callback)(void*),void* callbackArgs);
+            bool isDivisible() const;
 
             /**
-             * @return True if the task is a dummy task
+             * Split the range in halves, this range keeps the first half
+             * @return The second half
              */
-            bool isDummy();
+            BlockedRange split();
+        };
+
+        /** Tile of rows and columns split along the dimension with more grains,
+         * so that the tiles stay close to square for the cache blocking of 2D kernels
+         */
+        class BlockedRange2D {
+        private:
+            BlockedRange rows;
+            BlockedRange cols;
+
+        public:
+            BlockedRange2D();
+
+            BlockedRange2D(const BlockedRange& rows, const BlockedRange& cols);
+
+            BlockedRange2D(long rowBegin, long rowEnd, long rowGrainSize, long colBegin, long colEnd, long colGrainSize);
+
+            const BlockedRange& getRows() const;
+
+            const BlockedRange& getCols() const;
 
             /**
-             * Free one dependency of the task
-             * @return True if all the dependencies of the task are free
+             * @return The number of elements of the tile
              */
-            bool freeDependency();
+            long size() const;
+
+            bool empty() const;
+
+            bool isDivisible() const;
 
             /**
-             * Reset the number of satisfied dependencies
+             * Split the tile in halves along the dimension with more grains, this tile keeps the first half
+             * @return The second half
              */
-            void resetSatDependencies();
+            BlockedRange2D split();
+        };
 
-            std::vector<TaskDependency *> getToTask();
 
-            std::vector<TaskDependency *> getFromTask();
+        /** Stream of items that flow through a sequence of stages.
+         * Different items can be in different stages at the same time
+         */
+        class Pipeline {
+        public:
+            /** Execution mode of a stage
+             */
+            enum StageMode {
+                /** One item at a time, in the order produced by the input stage
+                 */
+                SERIAL_IN_ORDER,
+
+                /** One item at a time, in any order
+                 */
+                SERIAL_OUT_OF_ORDER,
+
+                /** Any number of items at the same time
+                 */
+                PARALLEL
+            };
 
-            unsigned int getTaskID();
+        private:
+            friend class TaskSystem;
 
-            /**
-             * Add a dependency between two tasks
-             * @param taskStart Start task of the dependency
-             * @param taskEnd End task of the dependency
+            /** Item moving through the pipeline
              */
-            static TaskDependency* addDependencyBetween(Task* taskStart, Task* taskEnd);
+            struct Token {
+                /** Current item, nullptr before the input stage
+                 */
+                void* item;
 
-            /**
-             * Remove all the direct dependencies between two tasks if any
-             * @param taskStart Start task of the dependency
-             * @param taskEnd End task of the dependency
-             * @return True if at least one dependency has been removed
+                /** Position of the item in the input stream
+                 */
+                unsigned long sequence;
+
+                /** Index of the stage the token is running, 0 is the input stage
+                 */
+                unsigned int stage;
+
+                Pipeline* pipeline;
+            };
+
+            /** Stage definition and serialization state of a stage
              */
-            static bool removeDependencyBetween(Task* taskStart, Task* taskEnd);
+            struct Stage {
+                StageMode mode;
+
+                void* (*func)(void*, void*);
+
+                void* args;
+
+                /** True while a serial stage is running an item
+                 */
+                bool busy;
+
+                /** Sequence number expected by a serial in order stage
+                 */
+                unsigned long nextSequence;
+
+                /** Tokens waiting for a serial in order stage, sorted by sequence number
+                 */
+                std::map<unsigned long, Token*> waitingInOrder;
+
+                /** Tokens waiting for a serial out of order stage
+                 */
+                std::queue<Token*> waitingOutOfOrder;
+            };
+
+            /** Produce the next item, nullptr at the end of the stream
+             */
+            void* (*input)(void*);
+
+            void* inputArgs;
+
+            std::vector<Stage> stages;
 
             /**
-             * Check if through the given dependency is possible to reach the given task
-             * @param dependency The dependency to explore
-             * @param task The task to check
+             * Mutex that protect the execution state
              */
-            static bool checkAcyclicDependency(TaskDependency dependency, Task* task);
+            pthread_mutex_t stateMutex;
 
+            /** Maximum number of tokens in flight
+             */
+            unsigned int maxTokens;
 
-            bool operator==(const Task &rhs) const;
-            bool operator!=(const Task &rhs) const;
+            /** Number of tokens currently in flight
+             */
+            unsigned int inFlight;
 
-            void addDependencyTo(TaskGraph *taskGraph) noexcept(false) override;
-            void addDependencyTo(Task *task) noexcept(false) override;
-        };
+            /** True while the input stage is running
+             */
+            bool inputBusy;
 
+            /** True when the input stage returned nullptr
+             */
+            bool inputDone;
 
-        /** Graph of tasks to be executed
-        */
-        class TaskGraph : public TaskElement{
+            unsigned long nextInputSequence;
 
-            class DummyStartEndTask : public Task{
-            public:
-                DummyStartEndTask() : Task(true){
-                }
+            /** Tokens that can be reused
+             */
+            std::vector<Token*> freeTokens;
 
-            private:
-            };
+            /** Queue of the tokens ready to be dispatched, nullptr ends the execution
+             */
+            ThreadSafeQueue<Token*>* readyQueue;
 
-            /** Subgraphs contained in this Graph
+            void resetState(unsigned int maxTokens, ThreadSafeQueue<Token*>* readyQueue);
+
+            /** Start a new input token if allowed, the state mutex must be held
              */
-            std::vector<TaskGraph*> subGraphs;
+            void tryStartInput();
 
-            /** Tasks directlly in this graph
+            /** Move a token to its next stage, the state mutex must be held
              */
-            std::vector<Task*> tasks;
+            void advanceToken(Token* token);
 
-            /** Start and End dummy tasks
+            /** Move a token in the given stage or in its waiting list, the state mutex must be held
              */
-            DummyStartEndTask start;
-            DummyStartEndTask end;
+            void enterStage(Token* token);
 
-        public:
-            TaskGraph();
+            /** Let the next waiting token enter a serial stage, the state mutex must be held
+             */
+            void releaseStage(Stage* stage);
 
-            ~TaskGraph();
+            /** Execute the current stage of a token
+             */
+            static void runToken(void* args);
 
-            /**
-             * Add the new task to the taskGraph
-             * @param task
+            /** Called after the execution of a stage of a token
              */
-            void addTask(Task* task) noexcept (false);
+            static void tokenCompleted(void* args);
 
-            void addSubGraph(TaskGraph* subGraph) noexcept (false);
+        public:
+            Pipeline();
 
-            void addDependencyTo(TaskGraph* taskGraph) noexcept(false) override;
-            void addDependencyTo(Task* task) noexcept(false) override;
+            virtual ~Pipeline();
 
             /**
-             * Reset all the dependencies to unsatisfied
+             * Set the input stage of the pipeline; it always runs one item at a time
+             * @param input Function that returns the next item or nullptr at the end of the stream
+             * @param args Argument passed to the input function
              */
-            void resetDependencies();
+            void setInput(void* (*input)(void*), void* args);
 
-            DummyStartEndTask* getStart();
+            /**
+             * Add a stage at the end of the pipeline
+             * @param mode Execution mode of the stage
+             * @param func Function called with the item and args, return the item for the next stage
+             * @param args Second argument passed to the function
+             */
+            void addStage(StageMode mode, void* (*func)(void*, void*), void* args);
 
-            DummyStartEndTask* getEnd();
+            unsigned long getNumStages();
         };
 
 
@@ -252,15 +1908,105 @@ namespace TaskSystem {
 
         TaskSystem(unsigned int numWorkers);
 
+        /**
+         * @param numReservedWorkers Number of workers that execute only the graphs of HIGH priority
+         */
+        TaskSystem(unsigned int numWorkers, unsigned int numReservedWorkers);
+
         virtual ~TaskSystem();
 
         /**
-         * Execute the TaskGraph passed as parameter
+         * Execute the TaskGraph passed as parameter. If a task throws, the tasks not yet started are skipped,
+         * the token is cancelled and the first exception is rethrown once the running tasks have completed
          * @param taskGraph The graph to be executed
+         * @param cancellation Token that stops the execution when cancelled, nullptr if not needed
+         * @return CANCELLED if the token has been cancelled before the end of the execution
+         */
+        ExecutionStatus executeTaskGraph(TaskGraph* taskGraph, CancellationToken* cancellation = nullptr) noexcept(false);
+
+        /**
+         * Execute the TaskGraph, returning DEADLINE_EXPIRED as soon as the deadline passes: the dispatcher
+         * waits for ready tasks and workers with timed waits, so the deadline costs no system call for each task.
+         * The tasks still running after the deadline see the execution as cancelled and complete in the background,
+         * the graph waits for them before being executed again, compiled again or destroyed,
+         * and the token must live until then
+         * @param deadline Time by which the execution should complete
+         */
+        ExecutionStatus executeTaskGraph(TaskGraph* taskGraph, std::chrono::steady_clock::time_point deadline,
+                                         CancellationToken* cancellation = nullptr) noexcept(false);
+
+        /**
+         * Execute a topology loaded from a file, like executeTaskGraph
+         * @param topology The topology to be executed, its functions must be bound
+         */
+        ExecutionStatus executeGraphTopology(GraphTopology* topology, CancellationToken* cancellation = nullptr) noexcept(false);
+
+        /**
+         * Called by a running task to know if the rest of its execution is useless
+         * @return True if an other task of the same execution has thrown or its token has been cancelled
+         */
+        static bool isExecutionCancelled();
+
+        /**
+         * Stream all the items produced by the input of the pipeline through its stages
+         * @param pipeline The pipeline to be executed
+         * @param maxTokens Maximum number of items in flight at the same time
+         */
+        void executePipeline(Pipeline* pipeline, unsigned int maxTokens) noexcept(false);
+
+        /**
+         * Apply a kernel in parallel to the chunks of a contiguous array and wait for all of them.
+         * The bounds between the chunks fall on the cache lines of the array, so that adjacent chunks
+         * never share a line and every chunk but the first and the last starts and ends on a full line,
+         * a multiple of the SIMD width of any vector kernel
+         * @param data First element of the array, used only to align the chunks
+         * @param elementSize Size in bytes of an element
+         * @param size Number of elements of the array
+         * @param kernel Function called with the first and the past-the-end indexes of a chunk and args
+         * @param args Argument passed to the kernel
+         * @param numChunks Number of chunks, 0 for one chunk for each worker
+         */
+        void parallelMap(const void* data, unsigned int elementSize, long size,
+                         void (*kernel)(long begin, long end, void* args), void* args, unsigned int numChunks = 0);
+
+        /**
+         * Execute the body on the whole range and wait for its completion. Every worker splits its ranges in halves
+         * until they are not larger than the grain size and executes them starting from the smallest, the workers
+         * without ranges steal the largest half left by the others
+         * @param range Range of indexes
+         * @param body Function called with a range not larger than the grain size and args
+         * @param args Argument passed to the body
+         */
+        void parallelFor(const BlockedRange& range, void (*body)(BlockedRange* range, void* args), void* args);
+
+        /**
+         * Execute the body on all the tiles of the 2D range, like the 1D parallelFor
+         * @param range Rows and columns of indexes
+         * @param body Function called with a tile not larger than the grain sizes and args
+         * @param args Argument passed to the body
          */
-        void executeTaskGraph(TaskGraph* taskGraph);
+        void parallelFor(const BlockedRange2D& range, void (*body)(BlockedRange2D* range, void* args), void* args);
 
         unsigned int getNumWorkerThreads();
+
+        /**
+         * Set how many ready tasks a worker can execute directly after the completion of a task,
+         * without passing through the dispatcher; 0 always dispatch the tasks to the pool
+         * @param maxInlineDepth Maximum number of consecutive tasks executed directly
+         */
+        void setMaxInlineDepth(unsigned int maxInlineDepth);
+
+        unsigned int getMaxInlineDepth();
+
+        /**
+         * Let the thread that executes a graph run, while it waits for the end, the ready tasks that no worker
+         * can take right away, so that the caller counts as one more worker; enabled by default.
+         * The graphs of a tenant, the executions with a deadline and the tasks with a preferred worker
+         * are only executed by the workers
+         */
+        void setCallerParticipation(bool callerParticipation);
+
+        bool isCallerParticipating();
     };
 
 }
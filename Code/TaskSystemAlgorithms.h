@@ -0,0 +1,232 @@
+//
+// Created by agent on 18/10/26.
+//
+
+#ifndef CODE_TASKSYSTEMALGORITHMS_H
+#define CODE_TASKSYSTEMALGORITHMS_H
+
+#include <algorithm>
+#include <functional>
+#include <iterator>
+#include <vector>
+#include "TaskSystem.h"
+
+namespace TaskSystem{
+
+    /**
+     * Number of elements taken from the first range among the first k elements of the stable merge of two sorted ranges
+     * @param k Number of elements of the merged range
+     */
+    template<typename RandomIt1, typename RandomIt2, typename Compare>
+    inline long mergeCoRank(long k, RandomIt1 first1, long size1, RandomIt2 first2, long size2, Compare cmp){
+        long low = std::max(0l, k - size2);
+        long high = std::min(k, size1);
+
+        //The merge takes the element of the first range on equal elements
+        while(low < high){
+            long middle = low + (high - low) / 2;
+
+            if(!cmp(first2[k - middle - 1], first1[middle]))
+                low = middle + 1;
+            else
+                high = middle;
+        }
+
+        return low;
+    }
+
+    /**
+     * Arguments of the body of a parallelMerge
+     */
+    template<typename RandomIt1, typename RandomIt2, typename OutputIt, typename Compare>
+    struct MergeArgs {
+        RandomIt1 first1;
+        long size1;
+        RandomIt2 first2;
+        long size2;
+        OutputIt out;
+        Compare cmp;
+
+        /**
+         * Merge the elements [begin, end) of the output
+         */
+        static void body(TaskSystem::BlockedRange* range, void* args){
+            MergeArgs* merge = (MergeArgs*) args;
+
+            long begin1 = mergeCoRank(range->getBegin(), merge->first1, merge->size1, merge->first2, merge->size2, merge->cmp);
+            long end1 = mergeCoRank(range->getEnd(), merge->first1, merge->size1, merge->first2, merge->size2, merge->cmp);
+            long begin2 = range->getBegin() - begin1;
+            long end2 = range->getEnd() - end1;
+
+            std::merge(merge->first1 + begin1, merge->first1 + end1, merge->first2 + begin2, merge->first2 + end2,
+                       merge->out + range->getBegin(), merge->cmp);
+        }
+    };
+
+    /**
+     * Merge in parallel two sorted ranges; every worker computes with a binary search the part of the
+     * two ranges that forms its part of the output, the merge is stable
+     * @param out Beginning of the output, it must not overlap the input ranges
+     * @param grainSize Number of output elements merged by a worker without splitting
+     */
+    template<typename RandomIt1, typename RandomIt2, typename OutputIt, typename Compare>
+    void parallelMerge(TaskSystem* taskSystem, RandomIt1 first1, RandomIt1 last1, RandomIt2 first2, RandomIt2 last2,
+                       OutputIt out, Compare cmp, long grainSize = 4096){
+        MergeArgs<RandomIt1, RandomIt2, OutputIt, Compare> args = {first1, (long) (last1 - first1),
+                                                                   first2, (long) (last2 - first2), out, cmp};
+
+        taskSystem->parallelFor(TaskSystem::BlockedRange(0, args.size1 + args.size2, grainSize),
+                                MergeArgs<RandomIt1, RandomIt2, OutputIt, Compare>::body, &args);
+    }
+
+    template<typename RandomIt1, typename RandomIt2, typename OutputIt>
+    void parallelMerge(TaskSystem* taskSystem, RandomIt1 first1, RandomIt1 last1, RandomIt2 first2, RandomIt2 last2,
+                       OutputIt out){
+        parallelMerge(taskSystem, first1, last1, first2, last2, out,
+                      std::less<typename std::iterator_traits<RandomIt1>::value_type>());
+    }
+
+    /**
+     * Arguments of the steps of a parallelSort
+     */
+    template<typename RandomIt, typename Compare>
+    struct SortArgs {
+        typedef typename std::iterator_traits<RandomIt>::value_type Value;
+
+        RandomIt first;
+        long size;
+        Compare cmp;
+
+        /**
+         * Elements sorted with std::sort before the first merge pass
+         */
+        long grainSize;
+
+        /**
+         * Size of the sorted runs merged in pairs by the current pass
+         */
+        long runSize;
+
+        /**
+         * Scratch buffer of the merge passes, the passes merge the runs back and forth between the range and it
+         */
+        Value* buffer;
+
+        /**
+         * True if the runs of the current pass are in the buffer, false if they are in the range
+         */
+        bool inBuffer;
+
+        /**
+         * Sort the blocks [begin, end) of grainSize elements
+         */
+        static void sortBlocks(TaskSystem::BlockedRange* range, void* args){
+            SortArgs* sort = (SortArgs*) args;
+
+            for (long block = range->getBegin(); block < range->getEnd(); ++block) {
+                long begin = block * sort->grainSize;
+                long end = std::min(begin + sort->grainSize, sort->size);
+
+                std::sort(sort->first + begin, sort->first + end, sort->cmp);
+            }
+        }
+
+        /**
+         * Merge the elements [begin, end) of the output of a pass from the runs in from to out,
+         * the range can span more pairs of runs
+         */
+        template<typename FromIt, typename ToIt>
+        void mergePass(TaskSystem::BlockedRange* range, FromIt from, ToIt out){
+            long k = range->getBegin();
+
+            while(k < range->getEnd()){
+                long pairBegin = k - k % (2 * runSize);
+                long middle = std::min(pairBegin + runSize, size);
+                long pairEnd = std::min(pairBegin + 2 * runSize, size);
+                long end = std::min(pairEnd, range->getEnd());
+
+                FromIt first1 = from + pairBegin;
+                FromIt first2 = from + middle;
+                long size1 = middle - pairBegin;
+                long size2 = pairEnd - middle;
+
+                long begin1 = mergeCoRank(k - pairBegin, first1, size1, first2, size2, cmp);
+                long end1 = mergeCoRank(end - pairBegin, first1, size1, first2, size2, cmp);
+                long begin2 = k - pairBegin - begin1;
+                long end2 = end - pairBegin - end1;
+
+                std::merge(std::make_move_iterator(first1 + begin1), std::make_move_iterator(first1 + end1),
+                           std::make_move_iterator(first2 + begin2), std::make_move_iterator(first2 + end2),
+                           out + k, cmp);
+
+                k = end;
+            }
+        }
+
+        static void mergeRuns(TaskSystem::BlockedRange* range, void* args){
+            SortArgs* sort = (SortArgs*) args;
+
+            if(sort->inBuffer)
+                sort->mergePass(range, sort->buffer, sort->first);
+            else
+                sort->mergePass(range, sort->first, sort->buffer);
+        }
+
+        /**
+         * Move the elements [begin, end) of the buffer back to the sorted range
+         */
+        static void moveBack(TaskSystem::BlockedRange* range, void* args){
+            SortArgs* sort = (SortArgs*) args;
+
+            std::move(sort->buffer + range->getBegin(), sort->buffer + range->getEnd(), sort->first + range->getBegin());
+        }
+    };
+
+    /**
+     * Sort in parallel the range with a merge sort: blocks of grainSize elements are sorted with std::sort,
+     * then the sorted runs are merged in pairs until a single run is left, every pass merged in parallel.
+     * Ranges not larger than grainSize are sorted with std::sort by the calling thread. The sort is not stable
+     * @param grainSize Number of elements sorted by std::sort and merged by a worker without splitting
+     */
+    template<typename RandomIt, typename Compare>
+    void parallelSort(TaskSystem* taskSystem, RandomIt first, RandomIt last, Compare cmp, long grainSize = 4096){
+        typedef typename std::iterator_traits<RandomIt>::value_type Value;
+
+        long size = (long) (last - first);
+
+        if(grainSize < 1)
+            grainSize = 1;
+
+        if(size <= grainSize){
+            std::sort(first, last, cmp);
+            return;
+        }
+
+        SortArgs<RandomIt, Compare> args = {first, size, cmp, grainSize, grainSize, nullptr, false};
+
+        long numBlocks = (size + grainSize - 1) / grainSize;
+        taskSystem->parallelFor(TaskSystem::BlockedRange(0, numBlocks, 1), SortArgs<RandomIt, Compare>::sortBlocks, &args);
+
+        //The buffer is built from the sorted blocks, so the elements need not be default constructible
+        std::vector<Value> buffer(std::make_move_iterator(first), std::make_move_iterator(last));
+
+        args.buffer = buffer.data();
+        args.inBuffer = true;
+
+        for (args.runSize = grainSize; args.runSize < size; args.runSize *= 2) {
+            taskSystem->parallelFor(TaskSystem::BlockedRange(0, size, grainSize), SortArgs<RandomIt, Compare>::mergeRuns, &args);
+
+            args.inBuffer = !args.inBuffer;
+        }
+
+        if(args.inBuffer)
+            taskSystem->parallelFor(TaskSystem::BlockedRange(0, size, grainSize), SortArgs<RandomIt, Compare>::moveBack, &args);
+    }
+
+    template<typename RandomIt>
+    void parallelSort(TaskSystem* taskSystem, RandomIt first, RandomIt last){
+        parallelSort(taskSystem, first, last, std::less<typename std::iterator_traits<RandomIt>::value_type>());
+    }
+}
+
+#endif //CODE_TASKSYSTEMALGORITHMS_H
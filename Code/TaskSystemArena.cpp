@@ -0,0 +1,119 @@
+//
+// Created by agent on 18/10/26.
+//
+
+#include "TaskSystemArena.h"
+
+#include <cstdlib>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace TaskSystem {
+
+    GraphArena::GraphArena() : GraphArena(64 * 1024) {}
+
+    GraphArena::GraphArena(std::size_t chunkSize) : chunks(nullptr), current(nullptr), limit(nullptr),
+                                                    chunkSize(chunkSize), usedBytes(0),
+                                                    hugePages(false) {}
+
+    GraphArena::~GraphArena() {
+        release();
+    }
+
+    void GraphArena::newChunk(std::size_t minSize) {
+        std::size_t size = sizeof(Chunk) + (minSize > chunkSize ? minSize : chunkSize);
+        Chunk* chunk = nullptr;
+
+        if (hugePages) {
+            size = (size + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+            chunk = static_cast<Chunk*>(mapHugeChunk(size));
+        }
+
+        bool mapped = chunk != nullptr;
+
+        if (!mapped)
+            chunk = static_cast<Chunk*>(std::malloc(size));
+
+        if (chunk == nullptr)
+            throw std::bad_alloc();
+
+        chunk->next = chunks;
+        chunk->size = size;
+        chunk->mapped = mapped;
+        chunks = chunk;
+
+        current = reinterpret_cast<char*>(chunk + 1);
+        limit = reinterpret_cast<char*>(chunk) + size;
+    }
+
+    void GraphArena::release() {
+        while (chunks != nullptr) {
+            Chunk* next = chunks->next;
+
+            if (chunks->mapped)
+                munmap(chunks, chunks->size);
+            else
+                std::free(chunks);
+
+            chunks = next;
+        }
+
+        current = nullptr;
+        limit = nullptr;
+        usedBytes = 0;
+    }
+
+    std::size_t GraphArena::getUsedBytes() {
+        return usedBytes;
+    }
+
+    void *GraphArena::mapHugeChunk(std::size_t size) {
+        void* memory = MAP_FAILED;
+
+#ifdef MAP_HUGETLB
+        //Reserved huge pages are faulted by the mapping itself
+        memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_POPULATE,
+                      -1, 0);
+
+        if (memory != MAP_FAILED)
+            return memory;
+#endif
+
+        //Transparent huge pages need a mapping aligned to the huge page size, the excess is unmapped
+        char* region = static_cast<char*>(mmap(nullptr, size + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE,
+                                               MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+
+        if (region == MAP_FAILED)
+            return nullptr;
+
+        std::size_t head = (HUGE_PAGE_SIZE - reinterpret_cast<std::size_t>(region) % HUGE_PAGE_SIZE) % HUGE_PAGE_SIZE;
+
+        if (head > 0)
+            munmap(region, head);
+
+        munmap(region + head + size, HUGE_PAGE_SIZE - head);
+
+        char* chunk = region + head;
+
+#ifdef MADV_HUGEPAGE
+        madvise(chunk, size, MADV_HUGEPAGE);
+#endif
+
+        //The pages are faulted now, with a huge page the first write maps all the 2MB
+        long pageSize = sysconf(_SC_PAGESIZE);
+
+        for (std::size_t offset = 0; offset < size; offset += pageSize) {
+            static_cast<volatile char*>(static_cast<void*>(chunk))[offset] = 0;
+        }
+
+        return chunk;
+    }
+
+    void GraphArena::setHugePages(bool hugePages) {
+        GraphArena::hugePages = hugePages;
+    }
+
+    bool GraphArena::isHugePages() {
+        return hugePages;
+    }
+}
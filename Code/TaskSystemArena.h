@@ -0,0 +1,144 @@
+//
+// Created by agent on 18/10/26.
+//
+
+#ifndef CODE_TASKSYSTEMARENA_H
+#define CODE_TASKSYSTEMARENA_H
+
+#include <cstddef>
+#include <new>
+
+namespace TaskSystem {
+
+    /**
+     * Bump allocator that keeps the memory of a TaskGraph close together;
+     * the memory is released all at once when the arena is released or destroyed
+     */
+    class GraphArena {
+    public:
+        /**
+         * Size of a huge page, the chunks of an arena with huge pages are multiples of it
+         */
+        static constexpr std::size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+    private:
+        /**
+         * Header placed at the beginning of every block of memory obtained from the system
+         */
+        struct Chunk {
+            Chunk* next;
+            std::size_t size;
+
+            /**
+             * True if the chunk has been mapped with mmap instead of allocated with malloc
+             */
+            bool mapped;
+        };
+
+        /**
+         * Last allocated chunk, the others are reachable through the next pointers
+         */
+        Chunk* chunks;
+
+        /**
+         * First free byte of the current chunk
+         */
+        char* current;
+
+        /**
+         * End of the current chunk
+         */
+        char* limit;
+
+        /**
+         * Size of the chunks requested to the system
+         */
+        std::size_t chunkSize;
+
+        /**
+         * Total number of bytes handed out since the last release
+         */
+        std::size_t usedBytes;
+
+        /**
+         * True if the new chunks are backed by huge pages and prefaulted
+         */
+        bool hugePages;
+
+        /**
+         * Get a new chunk able to contain at least minSize bytes
+         */
+        void newChunk(std::size_t minSize);
+
+        /**
+         * Map a chunk of size bytes, a multiple of HUGE_PAGE_SIZE, from the reserved huge pages or, if none is
+         * available, from transparent huge pages, and touch all its pages
+         * @return nullptr if the memory could not be mapped
+         */
+        static void* mapHugeChunk(std::size_t size);
+
+    public:
+        GraphArena();
+
+        GraphArena(std::size_t chunkSize);
+
+        GraphArena(const GraphArena&) = delete;
+        GraphArena& operator=(const GraphArena&) = delete;
+
+        virtual ~GraphArena();
+
+        /**
+         * Allocate size bytes aligned to alignment, the memory is not initialized
+         */
+        inline void* allocate(std::size_t size, std::size_t alignment) {
+            std::size_t misalignment = reinterpret_cast<std::size_t>(current) & (alignment - 1);
+            std::size_t padding = misalignment == 0 ? 0 : alignment - misalignment;
+
+            if (current == nullptr || current + padding + size > limit) {
+                newChunk(size + alignment);
+
+                misalignment = reinterpret_cast<std::size_t>(current) & (alignment - 1);
+                padding = misalignment == 0 ? 0 : alignment - misalignment;
+            }
+
+            char* result = current + padding;
+            current = result + size;
+            usedBytes += size;
+
+            return result;
+        }
+
+        /**
+         * Allocate and default construct an array of elements
+         * @param n Number of elements
+         */
+        template<typename T>
+        inline T* allocateArray(std::size_t n) {
+            T* array = static_cast<T*>(allocate(sizeof(T) * n, alignof(T)));
+
+            for (std::size_t i = 0; i < n; ++i) {
+                new(&array[i]) T();
+            }
+
+            return array;
+        }
+
+        /**
+         * Return all the memory to the system; destructors of the allocated objects are not called
+         */
+        void release();
+
+        std::size_t getUsedBytes();
+
+        /**
+         * Back the chunks allocated from now on with 2MB huge pages, and fault all their pages when they are
+         * allocated instead of at the first access; the chunks are rounded up to HUGE_PAGE_SIZE.
+         * Where huge pages are not available the chunks are regular pages, still prefaulted
+         */
+        void setHugePages(bool hugePages);
+
+        bool isHugePages();
+    };
+}
+
+#endif //CODE_TASKSYSTEMARENA_H
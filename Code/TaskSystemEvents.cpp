@@ -0,0 +1,223 @@
+//
+// Created by agent on 18/10/26.
+//
+
+#include <algorithm>
+#include <cstdint>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+#include "TaskSystem.h"
+
+namespace TaskSystem {
+
+    TaskSystem::EventTask::EventTask() : Task(false), type(USER_EVENT), userFd(-1), delay(0) {
+        event = this;
+        fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    }
+
+    TaskSystem::EventTask::EventTask(int fd) : Task(false), type(FD_READABLE), userFd(fd), delay(0) {
+        event = this;
+
+        //epoll registers an fd only once, every task waits for its own duplicate
+        EventTask::fd = fd >= 0 ? fcntl(fd, F_DUPFD_CLOEXEC, 0) : -1;
+    }
+
+    TaskSystem::EventTask::EventTask(std::chrono::nanoseconds delay) : Task(false), type(TIMER), userFd(-1), delay(delay) {
+        event = this;
+        fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    }
+
+    TaskSystem::EventTask::~EventTask() {
+        if (fd >= 0)
+            close(fd);
+    }
+
+    void TaskSystem::EventTask::signal() {
+        uint64_t value = 1;
+
+        if (write(fd, &value, sizeof(value)) < 0)
+            return;
+    }
+
+    void TaskSystem::EventTask::setDelay(std::chrono::nanoseconds delay) {
+        EventTask::delay = delay;
+    }
+
+    std::chrono::nanoseconds TaskSystem::EventTask::getDelay() {
+        return delay;
+    }
+
+    TaskSystem::EventTask::EventType TaskSystem::EventTask::getType() {
+        return type;
+    }
+
+    int TaskSystem::EventTask::getFd() {
+        return type == FD_READABLE ? userFd : fd;
+    }
+
+    TaskSystem::EventReactor::EventReactor() {
+        mutex = PTHREAD_MUTEX_INITIALIZER;
+        epollFd = epoll_create1(EPOLL_CLOEXEC);
+        wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        started = false;
+        stopping = false;
+
+        epoll_event wake;
+        wake.events = EPOLLIN;
+        wake.data.ptr = nullptr;
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeFd, &wake);
+    }
+
+    TaskSystem::EventReactor::~EventReactor() {
+        pthread_mutex_lock(&mutex);
+        stopping = true;
+        pthread_mutex_unlock(&mutex);
+
+        uint64_t value = 1;
+        if (write(wakeFd, &value, sizeof(value)) < 0)
+            value = 0;
+
+        if (started)
+            pthread_join(thread, nullptr);
+
+        //The nodes still armed belong to expired executions, they are released so that their plans can be deleted
+        while (!armed.empty()) {
+            fire(armed.back());
+        }
+
+        close(wakeFd);
+        close(epollFd);
+        pthread_mutex_destroy(&mutex);
+    }
+
+    void TaskSystem::EventReactor::arm(TaskSystem::ExecutionPlan::Node *node) {
+        ExecutionPlan *plan = node->plan;
+        EventTask *event = node->event;
+
+        //The plan is not released while one of its nodes is armed
+        plan->runningFunctions.fetch_add(1, std::memory_order_relaxed);
+
+        pthread_mutex_lock(&mutex);
+
+        bool registered = epollFd >= 0 && event->fd >= 0;
+
+        if (registered && !started) {
+            started = pthread_create(&thread, nullptr, run, this) == 0;
+            registered = started;
+        }
+
+        if (registered && event->type == EventTask::TIMER) {
+            //A zero timer would never fire
+            long long nanoseconds = event->delay.count() > 0 ? event->delay.count() : 1;
+
+            itimerspec timer = {};
+            timer.it_value.tv_sec = (time_t) (nanoseconds / 1000000000);
+            timer.it_value.tv_nsec = (long) (nanoseconds % 1000000000);
+
+            registered = timerfd_settime(event->fd, 0, &timer, nullptr) == 0;
+        }
+
+        if (registered) {
+            epoll_event watched;
+            watched.events = EPOLLIN | EPOLLONESHOT;
+            watched.data.ptr = node;
+
+            registered = epoll_ctl(epollFd, EPOLL_CTL_ADD, event->fd, &watched) == 0;
+        }
+
+        if (!registered) {
+            pthread_mutex_unlock(&mutex);
+
+            //The execution fails, the node is released as the skipped ones
+            plan->fail(std::make_exception_ptr(EventRegistrationException()));
+            plan->readyQueue->safePut(node);
+            plan->runningFunctions.fetch_sub(1, std::memory_order_release);
+
+            return;
+        }
+
+        //The thread waits without a timeout while no node is armed
+        bool wake = armed.empty();
+        armed.push_back(node);
+
+        pthread_mutex_unlock(&mutex);
+
+        if (wake) {
+            uint64_t value = 1;
+            if (write(wakeFd, &value, sizeof(value)) < 0)
+                return;
+        }
+    }
+
+    void TaskSystem::EventReactor::fire(TaskSystem::ExecutionPlan::Node *node) {
+        ExecutionPlan *plan = node->plan;
+        EventTask *event = node->event;
+
+        epoll_ctl(epollFd, EPOLL_CTL_DEL, event->fd, nullptr);
+
+        //Consume the event so that the task can be armed again by the next execution
+        if (event->type != EventTask::FD_READABLE) {
+            if (event->type == EventTask::TIMER) {
+                itimerspec disarmed = {};
+                timerfd_settime(event->fd, 0, &disarmed, nullptr);
+            }
+
+            uint64_t value;
+            if (read(event->fd, &value, sizeof(value)) < 0)
+                value = 0;
+        }
+
+        armed.erase(std::find(armed.begin(), armed.end(), node));
+
+        //The queue of an expired execution is deleted only after the counter reaches zero
+        plan->readyQueue->safePut(node);
+        plan->runningFunctions.fetch_sub(1, std::memory_order_release);
+    }
+
+    void *TaskSystem::EventReactor::run(void *args) {
+        EventReactor *reactor = (EventReactor *) args;
+        epoll_event events[64];
+
+        while (true) {
+            pthread_mutex_lock(&reactor->mutex);
+            bool stopping = reactor->stopping;
+            int timeout = reactor->armed.empty() ? -1 : CANCEL_CHECK_INTERVAL;
+            pthread_mutex_unlock(&reactor->mutex);
+
+            if (stopping)
+                break;
+
+            int numEvents = epoll_wait(reactor->epollFd, events, 64, timeout);
+
+            pthread_mutex_lock(&reactor->mutex);
+
+            for (int i = 0; i < numEvents; ++i) {
+                ExecutionPlan::Node *node = (ExecutionPlan::Node *) events[i].data.ptr;
+
+                if (node == nullptr) {
+                    uint64_t value;
+                    if (read(reactor->wakeFd, &value, sizeof(value)) < 0)
+                        value = 0;
+                } else if (std::find(reactor->armed.begin(), reactor->armed.end(), node) != reactor->armed.end()) {
+                    reactor->fire(node);
+                }
+            }
+
+            //The nodes of cancelled and expired executions are released without their event, their tasks are skipped
+            for (unsigned long i = reactor->armed.size(); i > 0; --i) {
+                ExecutionPlan::Node *node = reactor->armed[i - 1];
+
+                if (node->plan->isCancelled())
+                    reactor->fire(node);
+            }
+
+            pthread_mutex_unlock(&reactor->mutex);
+        }
+
+        return nullptr;
+    }
+
+}
@@ -0,0 +1,211 @@
+//
+// Created by agent on 18/10/26.
+//
+
+#include "TaskSystem.h"
+
+namespace TaskSystem {
+
+    void TaskSystem::TaskGraph::mapPlanTasks(std::unordered_map<Task *, ExecutionPlan::Node *> *taskNodes,
+                                             std::unordered_map<Task *, unsigned int> *criticalTasks) {
+        compile();
+
+        for (unsigned int i = 0; i < plan->numNodes; ++i) {
+            ExecutionPlan::Node *node = &plan->nodes[i];
+
+            for (unsigned int j = 0; j < node->numMembers; ++j) {
+                (*taskNodes)[plan->members[node->firstMember + j].task] = node;
+            }
+        }
+
+        //The tasks of a coarsened node are executed in sequence, all of them are on the path
+        std::vector<ExecutionPlan::Node *> path = plan->getCriticalPath();
+        unsigned int position = 0;
+
+        for (std::vector<ExecutionPlan::Node *>::iterator it = path.begin(); it != path.end(); it++) {
+            for (unsigned int j = 0; j < (*it)->numMembers; ++j) {
+                (*criticalTasks)[plan->members[(*it)->firstMember + j].task] = position++;
+            }
+        }
+    }
+
+    void TaskSystem::TaskGraph::writeDotCluster(std::ostream &out,
+                                                std::unordered_map<Task *, ExecutionPlan::Node *> &taskNodes,
+                                                std::unordered_map<Task *, unsigned int> &criticalTasks,
+                                                bool annotate, unsigned int depth) {
+        std::string indent(depth * 4, ' ');
+
+        out << indent << "subgraph cluster_" << start.getTaskID() << " {\n";
+        out << indent << "    label=\"graph " << start.getTaskID() << "\";\n";
+
+        for (std::vector<Task *>::iterator it = tasks.begin(); it != tasks.end(); it++) {
+            Task *task = *it;
+
+            out << indent << "    t" << task->getTaskID() << " [label=\"";
+
+            if (task == &start)
+                out << "start";
+            else if (task == &end)
+                out << "end";
+            else
+                out << "task " << task->getTaskID();
+
+            if (annotate && !task->isDummy()) {
+                out << "\\ncost " << task->getEstimatedCost() << " ns";
+
+                if (task->getNumProfiledExecutions() > 0)
+                    out << "\\navg " << task->getAverageTime() << " ns, p95 " << task->getP95Time() << " ns";
+
+                if (taskNodes[task]->lastWorker >= 0)
+                    out << "\\nworker " << taskNodes[task]->lastWorker;
+            }
+
+            out << "\"";
+
+            if (task->isDummy())
+                out << ", shape=point";
+
+            if (annotate && criticalTasks.count(task) > 0)
+                out << ", color=red";
+
+            out << "];\n";
+        }
+
+        for (std::vector<TaskGraph *>::iterator it = subGraphs.begin(); it != subGraphs.end(); it++) {
+            (*it)->writeDotCluster(out, taskNodes, criticalTasks, annotate, depth + 1);
+        }
+
+        out << indent << "}\n";
+    }
+
+    void TaskSystem::TaskGraph::exportDot(std::ostream &out, bool annotate) {
+        std::unordered_map<Task *, ExecutionPlan::Node *> taskNodes;
+        std::unordered_map<Task *, unsigned int> criticalTasks;
+        mapPlanTasks(&taskNodes, &criticalTasks);
+
+        out << "digraph TaskGraph {\n";
+
+        writeDotCluster(out, taskNodes, criticalTasks, annotate, 1);
+
+        std::vector<Task *> graphTasks;
+        collectTasks(&graphTasks);
+
+        for (std::vector<Task *>::iterator it = graphTasks.begin(); it != graphTasks.end(); it++) {
+            std::vector<TaskDependency *> &dependencies = (*it)->toTask;
+
+            for (std::vector<TaskDependency *>::iterator dep = dependencies.begin(); dep != dependencies.end(); dep++) {
+                Task *toTask = (*dep)->toTask;
+
+                //Dependencies toward the parents of this graph are not part of it
+                if (taskNodes.count(toTask) == 0)
+                    continue;
+
+                out << "    t" << (*it)->getTaskID() << " -> t" << toTask->getTaskID();
+
+                std::unordered_map<Task *, unsigned int>::iterator from = criticalTasks.find(*it);
+                std::unordered_map<Task *, unsigned int>::iterator to = criticalTasks.find(toTask);
+
+                if (annotate && from != criticalTasks.end() && to != criticalTasks.end() && from->second + 1 == to->second)
+                    out << " [color=red, penwidth=2]";
+
+                out << ";\n";
+            }
+        }
+
+        out << "}\n";
+    }
+
+    void TaskSystem::TaskGraph::writeJSONGraph(std::ostream &out,
+                                               std::unordered_map<Task *, ExecutionPlan::Node *> &taskNodes,
+                                               std::unordered_map<Task *, unsigned int> &criticalTasks,
+                                               bool annotate) {
+        out << "{\"id\":" << start.getTaskID() << ",\"start\":" << start.getTaskID()
+            << ",\"end\":" << end.getTaskID() << ",\"tasks\":[";
+
+        for (std::vector<Task *>::iterator it = tasks.begin(); it != tasks.end(); it++) {
+            Task *task = *it;
+
+            if (it != tasks.begin())
+                out << ",";
+
+            out << "{\"id\":" << task->getTaskID() << ",\"dummy\":" << (task->isDummy() ? "true" : "false");
+
+            if (annotate) {
+                out << ",\"cost\":" << task->getEstimatedCost()
+                    << ",\"executions\":" << task->getNumProfiledExecutions()
+                    << ",\"averageTime\":" << task->getAverageTime()
+                    << ",\"p95Time\":" << task->getP95Time()
+                    << ",\"worker\":" << taskNodes[task]->lastWorker
+                    << ",\"critical\":" << (criticalTasks.count(task) > 0 ? "true" : "false");
+            }
+
+            out << "}";
+        }
+
+        out << "],\"subGraphs\":[";
+
+        for (std::vector<TaskGraph *>::iterator it = subGraphs.begin(); it != subGraphs.end(); it++) {
+            if (it != subGraphs.begin())
+                out << ",";
+
+            (*it)->writeJSONGraph(out, taskNodes, criticalTasks, annotate);
+        }
+
+        out << "]}";
+    }
+
+    void TaskSystem::TaskGraph::exportJSON(std::ostream &out, bool annotate) {
+        std::unordered_map<Task *, ExecutionPlan::Node *> taskNodes;
+        std::unordered_map<Task *, unsigned int> criticalTasks;
+        mapPlanTasks(&taskNodes, &criticalTasks);
+
+        out << "{\"graph\":";
+
+        writeJSONGraph(out, taskNodes, criticalTasks, annotate);
+
+        out << ",\"dependencies\":[";
+
+        bool first = true;
+        std::vector<Task *> graphTasks;
+        collectTasks(&graphTasks);
+
+        for (std::vector<Task *>::iterator it = graphTasks.begin(); it != graphTasks.end(); it++) {
+            std::vector<TaskDependency *> &dependencies = (*it)->toTask;
+
+            for (std::vector<TaskDependency *>::iterator dep = dependencies.begin(); dep != dependencies.end(); dep++) {
+                if (taskNodes.count((*dep)->toTask) == 0)
+                    continue;
+
+                if (!first)
+                    out << ",";
+                first = false;
+
+                out << "{\"from\":" << (*it)->getTaskID() << ",\"to\":" << (*dep)->toTask->getTaskID() << "}";
+            }
+        }
+
+        out << "]";
+
+        if (annotate) {
+            std::vector<Task *> path(criticalTasks.size());
+            for (std::unordered_map<Task *, unsigned int>::iterator it = criticalTasks.begin(); it != criticalTasks.end(); it++) {
+                path[it->second] = it->first;
+            }
+
+            out << ",\"criticalPathCost\":" << plan->startNode->rank
+                << ",\"criticalPath\":[";
+
+            for (std::vector<Task *>::iterator it = path.begin(); it != path.end(); it++) {
+                if (it != path.begin())
+                    out << ",";
+
+                out << (*it)->getTaskID();
+            }
+
+            out << "]";
+        }
+
+        out << "}\n";
+    }
+
+}
@@ -0,0 +1,131 @@
+//
+// Created by agent on 18/10/26.
+//
+
+#include <algorithm>
+#include "TaskSystem.h"
+
+namespace TaskSystem {
+
+    TaskSystem::FairShare::FairShare(unsigned int numWorkers) : numWaiters(0), numExecutions(0) {
+        mutex = PTHREAD_MUTEX_INITIALIZER;
+        freeWorkers = numWorkers;
+        virtualTime = 0;
+    }
+
+    TaskSystem::FairShare::~FairShare() {
+        pthread_mutex_destroy(&mutex);
+    }
+
+    bool TaskSystem::FairShare::acquire(TaskSystem::FairShare::Account *account, const timespec *deadline) {
+        pthread_mutex_lock(&mutex);
+
+        if (canGrantNow(account)) {
+            grant(account);
+
+            pthread_mutex_unlock(&mutex);
+            return true;
+        }
+
+        Waiter waiter;
+        waiter.account = account;
+        waiter.granted = false;
+
+        pthread_condattr_t attributes;
+        pthread_condattr_init(&attributes);
+        pthread_condattr_setclock(&attributes, CLOCK_MONOTONIC);
+        pthread_cond_init(&waiter.condition, &attributes);
+        pthread_condattr_destroy(&attributes);
+
+        waiters.push_back(&waiter);
+        numWaiters.store((unsigned int) waiters.size(), std::memory_order_relaxed);
+
+        grantWaiters();
+
+        while (!waiter.granted) {
+            if (deadline == nullptr) {
+                pthread_cond_wait(&waiter.condition, &mutex);
+            } else if (pthread_cond_timedwait(&waiter.condition, &mutex, deadline) == ETIMEDOUT && !waiter.granted) {
+                waiters.erase(std::find(waiters.begin(), waiters.end(), &waiter));
+                numWaiters.store((unsigned int) waiters.size(), std::memory_order_relaxed);
+                break;
+            }
+        }
+
+        bool granted = waiter.granted;
+
+        pthread_mutex_unlock(&mutex);
+        pthread_cond_destroy(&waiter.condition);
+
+        return granted;
+    }
+
+    bool TaskSystem::FairShare::tryAcquire(TaskSystem::FairShare::Account *account) {
+        pthread_mutex_lock(&mutex);
+
+        bool granted = canGrantNow(account);
+
+        if (granted)
+            grant(account);
+
+        pthread_mutex_unlock(&mutex);
+
+        return granted;
+    }
+
+    void TaskSystem::FairShare::release(TaskSystem::FairShare::Account *account) {
+        pthread_mutex_lock(&mutex);
+
+        account->running--;
+        freeWorkers++;
+
+        if (!waiters.empty())
+            grantWaiters();
+
+        pthread_mutex_unlock(&mutex);
+    }
+
+    void TaskSystem::FairShare::grantWaiters() {
+        while (freeWorkers > 0) {
+            std::vector<Waiter *>::iterator next = waiters.end();
+
+            for (std::vector<Waiter *>::iterator it = waiters.begin(); it != waiters.end(); it++) {
+                Account *account = (*it)->account;
+
+                if (account->maxConcurrency != 0 && account->running >= account->maxConcurrency)
+                    continue;
+
+                if (next == waiters.end() || account->pass < (*next)->account->pass)
+                    next = it;
+            }
+
+            if (next == waiters.end())
+                return;
+
+            Waiter *waiter = *next;
+            waiters.erase(next);
+            numWaiters.store((unsigned int) waiters.size(), std::memory_order_relaxed);
+
+            grant(waiter->account);
+            waiter->granted = true;
+
+            pthread_cond_signal(&waiter->condition);
+        }
+    }
+
+    TaskSystem::Tenant::Tenant(unsigned int weight, unsigned int maxConcurrency) {
+        account.weight = std::max(weight, 1u);
+        account.maxConcurrency = maxConcurrency;
+        account.running = 0;
+        account.pass = 0;
+    }
+
+    unsigned int TaskSystem::Tenant::getWeight() {
+        return account.weight;
+    }
+
+    unsigned int TaskSystem::Tenant::getMaxConcurrency() {
+        return account.maxConcurrency;
+    }
+
+}
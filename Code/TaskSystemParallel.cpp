@@ -0,0 +1,400 @@
+//
+// Created by agent on 18/10/26.
+//
+
+#include <cstdint>
+#include <deque>
+#include <sched.h>
+#include <time.h>
+#include "TaskSystem.h"
+#include "TaskSystemUtility.h"
+
+namespace TaskSystem {
+
+    void TaskSystem::MapChunk::run(void *args) {
+        MapChunk *chunk = (MapChunk *) args;
+
+        chunk->kernel(chunk->begin, chunk->end, chunk->args);
+    }
+
+    void TaskSystem::MapChunk::completed(void *args) {
+        MapChunk *chunk = (MapChunk *) args;
+
+        //Read the queue before the decrement, the chunks are released as soon as the last one is notified
+        ThreadSafeQueue<MapChunk *> *doneQueue = chunk->doneQueue;
+
+        if (chunk->remaining->fetch_sub(1, std::memory_order_acq_rel) == 1)
+            doneQueue->safePut(chunk);
+    }
+
+    void TaskSystem::parallelMap(const void *data, unsigned int elementSize, long size,
+                                 void (*kernel)(long, long, void *), void *args, unsigned int numChunks) {
+        if (size <= 0)
+            return;
+
+        if (numChunks == 0)
+            numChunks = pThreadPool->getNumWorkerThreads();
+
+        //Bounds on the cache lines of the array when an element never crosses a line, on any element otherwise
+        uintptr_t address = (uintptr_t) data;
+        long headSize = 0;
+        long blockSize = 1;
+
+        if (elementSize > 0 && elementSize <= PThreadPool::CACHE_LINE_SIZE && PThreadPool::CACHE_LINE_SIZE % elementSize == 0
+                && address % elementSize == 0) {
+            blockSize = PThreadPool::CACHE_LINE_SIZE / elementSize;
+            headSize = (long) ((PThreadPool::CACHE_LINE_SIZE - address % PThreadPool::CACHE_LINE_SIZE) % PThreadPool::CACHE_LINE_SIZE) / elementSize;
+        }
+
+        std::vector<std::pair<long, long>> bounds;
+        splitAligned(size, (int) numChunks, headSize, blockSize, &bounds);
+
+        std::vector<MapChunk> chunks;
+        chunks.reserve(numChunks);
+
+        for (std::vector<std::pair<long, long>>::iterator it = bounds.begin(); it != bounds.end(); it++) {
+            if (it->first > it->second)
+                continue;
+
+            chunks.push_back({it->first, it->second + 1, kernel, args, nullptr, nullptr});
+        }
+
+        std::atomic<unsigned int> remaining((unsigned int) chunks.size());
+        ThreadSafeQueue<MapChunk *> doneQueue;
+        std::vector<MapChunk *> callerChunks;
+
+        //Only the ready workers take a chunk, the calling thread executes the others so that a parallelMap
+        //nested in a task never waits for busy workers
+        for (std::vector<MapChunk>::iterator it = chunks.begin(); it != chunks.end(); it++) {
+            it->remaining = &remaining;
+            it->doneQueue = &doneQueue;
+
+            if (!pThreadPool->tryExecuteFunction(MapChunk::run, &*it, MapChunk::completed, &*it))
+                callerChunks.push_back(&*it);
+        }
+
+        for (std::vector<MapChunk *>::iterator it = callerChunks.begin(); it != callerChunks.end(); it++) {
+            MapChunk::run(*it);
+            MapChunk::completed(*it);
+        }
+
+        doneQueue.safePop();
+    }
+
+    TaskSystem::BlockedRange::BlockedRange() : BlockedRange(0, 0, 1) {}
+
+    TaskSystem::BlockedRange::BlockedRange(long begin, long end, long grainSize) : begin(begin), end(end),
+                                                                                  grainSize(grainSize > 0 ? grainSize : 1) {}
+
+    long TaskSystem::BlockedRange::getBegin() const {
+        return begin;
+    }
+
+    long TaskSystem::BlockedRange::getEnd() const {
+        return end;
+    }
+
+    long TaskSystem::BlockedRange::getGrainSize() const {
+        return grainSize;
+    }
+
+    long TaskSystem::BlockedRange::size() const {
+        return end > begin ? end - begin : 0;
+    }
+
+    bool TaskSystem::BlockedRange::empty() const {
+        return end <= begin;
+    }
+
+    bool TaskSystem::BlockedRange::isDivisible() const {
+        return size() > grainSize;
+    }
+
+    TaskSystem::BlockedRange TaskSystem::BlockedRange::split() {
+        long middle = begin + size() / 2;
+        BlockedRange second(middle, end, grainSize);
+
+        end = middle;
+
+        return second;
+    }
+
+    TaskSystem::BlockedRange2D::BlockedRange2D() {}
+
+    TaskSystem::BlockedRange2D::BlockedRange2D(const TaskSystem::BlockedRange &rows,
+                                               const TaskSystem::BlockedRange &cols) : rows(rows), cols(cols) {}
+
+    TaskSystem::BlockedRange2D::BlockedRange2D(long rowBegin, long rowEnd, long rowGrainSize,
+                                               long colBegin, long colEnd, long colGrainSize)
+            : rows(rowBegin, rowEnd, rowGrainSize), cols(colBegin, colEnd, colGrainSize) {}
+
+    const TaskSystem::BlockedRange &TaskSystem::BlockedRange2D::getRows() const {
+        return rows;
+    }
+
+    const TaskSystem::BlockedRange &TaskSystem::BlockedRange2D::getCols() const {
+        return cols;
+    }
+
+    long TaskSystem::BlockedRange2D::size() const {
+        return rows.size() * cols.size();
+    }
+
+    bool TaskSystem::BlockedRange2D::empty() const {
+        return rows.empty() || cols.empty();
+    }
+
+    bool TaskSystem::BlockedRange2D::isDivisible() const {
+        return rows.isDivisible() || cols.isDivisible();
+    }
+
+    TaskSystem::BlockedRange2D TaskSystem::BlockedRange2D::split() {
+        //Compare the number of grains of the two dimensions, rows * colGrain against cols * rowGrain
+        bool splitRows = rows.isDivisible() &&
+                (!cols.isDivisible() || rows.size() * cols.getGrainSize() >= cols.size() * rows.getGrainSize());
+
+        if (splitRows)
+            return BlockedRange2D(rows.split(), cols);
+
+        return BlockedRange2D(rows, cols.split());
+    }
+
+    struct TaskSystem::RangeWork {
+        /** Ranges of a worker; the oldest, and largest, are at the front and are the ones stolen,
+         * the owner takes the newest from the back
+         */
+        struct alignas(PThreadPool::CACHE_LINE_SIZE) Slot {
+            pthread_mutex_t mutex;
+
+            std::deque<BlockedRange2D> ranges;
+        };
+
+        /**
+         * Empty retries of a worker spent yielding before it starts sleeping
+         */
+        static const unsigned int MAX_YIELDS = 16;
+
+        /**
+         * First sleep of a worker that backs off, doubled at every empty retry up to 2^MAX_SLEEP_SHIFT times
+         */
+        static const long MIN_SLEEP_NS = 1000;
+
+        static const unsigned int MAX_SLEEP_SHIFT = 5;
+
+        std::vector<Slot> slots;
+
+        /**
+         * Body of a 1D parallelFor, executed on the rows of the ranges
+         */
+        void (*body)(BlockedRange*, void*);
+
+        void (*body2D)(BlockedRange2D*, void*);
+
+        void* args;
+
+        /**
+         * Number of elements not yet executed, the workers stop when it reaches 0
+         */
+        std::atomic<long> pendingElements;
+
+        /**
+         * Index of the slot of the next worker that joins
+         */
+        std::atomic<unsigned int> nextSlot;
+
+        /**
+         * Number of workers not yet completed
+         */
+        std::atomic<unsigned int> remaining;
+
+        /**
+         * Notified by the last completed worker, the caller waits on it
+         */
+        ThreadSafeQueue<RangeWork*>* doneQueue;
+
+        RangeWork(unsigned int numSlots) : slots(numSlots) {
+            for (std::vector<Slot>::iterator it = slots.begin(); it != slots.end(); it++) {
+                it->mutex = PTHREAD_MUTEX_INITIALIZER;
+            }
+        }
+
+        bool popOwn(Slot* slot, BlockedRange2D* range) {
+            pthread_mutex_lock(&slot->mutex);
+
+            bool found = !slot->ranges.empty();
+            if (found) {
+                *range = slot->ranges.back();
+                slot->ranges.pop_back();
+            }
+
+            pthread_mutex_unlock(&slot->mutex);
+
+            return found;
+        }
+
+        /**
+         * Take the largest range at the front of the slots of the other workers
+         * @return False if all the slots of the other workers are empty
+         */
+        bool steal(Slot* own, BlockedRange2D* range) {
+            while (true) {
+                Slot* victim = nullptr;
+                long victimSize = 0;
+
+                for (std::vector<Slot>::iterator it = slots.begin(); it != slots.end(); it++) {
+                    if (&*it == own)
+                        continue;
+
+                    pthread_mutex_lock(&it->mutex);
+                    long size = it->ranges.empty() ? 0 : it->ranges.front().size();
+                    pthread_mutex_unlock(&it->mutex);
+
+                    if (size > victimSize) {
+                        victim = &*it;
+                        victimSize = size;
+                    }
+                }
+
+                if (victim == nullptr)
+                    return false;
+
+                pthread_mutex_lock(&victim->mutex);
+
+                bool found = !victim->ranges.empty();
+                if (found) {
+                    *range = victim->ranges.front();
+                    victim->ranges.pop_front();
+                }
+
+                pthread_mutex_unlock(&victim->mutex);
+
+                if (found)
+                    return true;
+
+                //The range has been taken by its owner in the meantime, look for another victim
+            }
+        }
+
+        /**
+         * Execute the ranges of the own slot and steal the others until every element is executed.
+         * A worker that finds nothing to take, at the start or while the others split their ranges,
+         * backs off and retries: first yielding, then sleeping for a doubling time
+         */
+        static void participate(void* args) {
+            RangeWork* work = (RangeWork*) args;
+            Slot* slot = &work->slots[work->nextSlot.fetch_add(1, std::memory_order_relaxed)];
+            BlockedRange2D range;
+            unsigned int misses = 0;
+
+            while (work->pendingElements.load(std::memory_order_acquire) > 0) {
+                if (!work->popOwn(slot, &range) && !work->steal(slot, &range)) {
+                    backOff(misses++);
+                    continue;
+                }
+
+                misses = 0;
+
+                while (range.isDivisible()) {
+                    BlockedRange2D second = range.split();
+
+                    pthread_mutex_lock(&slot->mutex);
+                    slot->ranges.push_back(second);
+                    pthread_mutex_unlock(&slot->mutex);
+                }
+
+                if (work->body != nullptr) {
+                    BlockedRange rows = range.getRows();
+                    work->body(&rows, work->args);
+                } else {
+                    work->body2D(&range, work->args);
+                }
+
+                work->pendingElements.fetch_sub(range.size(), std::memory_order_acq_rel);
+            }
+        }
+
+        /**
+         * Wait before the next retry of a worker that found nothing to take for the given number of times
+         */
+        static void backOff(unsigned int misses) {
+            if (misses < MAX_YIELDS) {
+                sched_yield();
+                return;
+            }
+
+            unsigned int shift = misses - MAX_YIELDS;
+            long sleepNs = MIN_SLEEP_NS << (shift < MAX_SLEEP_SHIFT ? shift : MAX_SLEEP_SHIFT);
+            timespec sleepTime = {0, sleepNs};
+
+            nanosleep(&sleepTime, nullptr);
+        }
+
+        static void completed(void* args) {
+            RangeWork* work = (RangeWork*) args;
+
+            //Read the queue before the decrement, the work is released as soon as the last worker is notified
+            ThreadSafeQueue<RangeWork *> *doneQueue = work->doneQueue;
+
+            if (work->remaining.fetch_sub(1, std::memory_order_acq_rel) == 1)
+                doneQueue->safePut(work);
+        }
+    };
+
+    void TaskSystem::executeRangeWork(TaskSystem::RangeWork *work, const TaskSystem::BlockedRange2D &range) {
+        ThreadSafeQueue<RangeWork *> doneQueue;
+
+        work->pendingElements.store(range.size());
+        work->nextSlot.store(0);
+        work->doneQueue = &doneQueue;
+        work->slots[0].ranges.push_back(range);
+
+        //The calling thread always takes part, the work is given only to the workers that are ready
+        //so that a parallelFor nested in a task never waits for busy workers
+        unsigned int numJoined = 0;
+        work->remaining.store((unsigned int) work->slots.size());
+
+        for (unsigned int i = 1; i < work->slots.size(); ++i) {
+            if (!pThreadPool->tryExecuteFunction(RangeWork::participate, work, RangeWork::completed, work))
+                break;
+
+            numJoined++;
+        }
+
+        //The slots of the workers that did not join are never used
+        unsigned int notJoined = (unsigned int) work->slots.size() - 1 - numJoined;
+        work->remaining.fetch_sub(notJoined, std::memory_order_acq_rel);
+
+        RangeWork::participate(work);
+
+        //The workers still running their last range or backing off are waited before the work is released
+        if (work->remaining.fetch_sub(1, std::memory_order_acq_rel) != 1)
+            doneQueue.safePop();
+    }
+
+    void TaskSystem::parallelFor(const TaskSystem::BlockedRange &range, void (*body)(TaskSystem::BlockedRange *, void *),
+                                 void *args) {
+        if (range.empty())
+            return;
+
+        RangeWork work(pThreadPool->getNumWorkerThreads() + 1);
+        work.body = body;
+        work.body2D = nullptr;
+        work.args = args;
+
+        //A 1D range is a tile of a single column
+        executeRangeWork(&work, BlockedRange2D(range, BlockedRange(0, 1, 1)));
+    }
+
+    void TaskSystem::parallelFor(const TaskSystem::BlockedRange2D &range,
+                                 void (*body)(TaskSystem::BlockedRange2D *, void *), void *args) {
+        if (range.empty())
+            return;
+
+        RangeWork work(pThreadPool->getNumWorkerThreads() + 1);
+        work.body = nullptr;
+        work.body2D = body;
+        work.args = args;
+
+        executeRangeWork(&work, range);
+    }
+}
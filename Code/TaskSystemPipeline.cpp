@@ -0,0 +1,220 @@
+//
+// Created by agent on 18/10/26.
+//
+
+#include "TaskSystem.h"
+
+namespace TaskSystem {
+
+    TaskSystem::Pipeline::Pipeline() {
+        input = nullptr;
+        inputArgs = nullptr;
+
+        stateMutex = PTHREAD_MUTEX_INITIALIZER;
+
+        readyQueue = nullptr;
+    }
+
+    TaskSystem::Pipeline::~Pipeline() {
+        for (std::vector<Token *>::iterator it = freeTokens.begin(); it != freeTokens.end(); it++) {
+            delete *it;
+        }
+    }
+
+    void TaskSystem::Pipeline::setInput(void *(*input)(void *), void *args) {
+        this->input = input;
+        this->inputArgs = args;
+    }
+
+    void TaskSystem::Pipeline::addStage(TaskSystem::Pipeline::StageMode mode, void *(*func)(void *, void *),
+                                        void *args) {
+        Stage stage;
+        stage.mode = mode;
+        stage.func = func;
+        stage.args = args;
+
+        stages.push_back(stage);
+    }
+
+    unsigned long TaskSystem::Pipeline::getNumStages() {
+        return stages.size();
+    }
+
+    void TaskSystem::Pipeline::resetState(unsigned int maxTokens,
+                                          TaskSystem::ThreadSafeQueue<TaskSystem::Pipeline::Token *> *readyQueue) {
+        this->maxTokens = maxTokens;
+        this->readyQueue = readyQueue;
+
+        inFlight = 0;
+        inputBusy = false;
+        inputDone = false;
+        nextInputSequence = 0;
+
+        for (std::vector<Stage>::iterator it = stages.begin(); it != stages.end(); it++) {
+            it->busy = false;
+            it->nextSequence = 0;
+        }
+    }
+
+    void TaskSystem::Pipeline::tryStartInput() {
+        if (inputBusy || inputDone || inFlight >= maxTokens)
+            return;
+
+        Token *token;
+        if (freeTokens.empty()) {
+            token = new Token();
+        } else {
+            token = freeTokens.back();
+            freeTokens.pop_back();
+        }
+
+        token->item = nullptr;
+        token->sequence = nextInputSequence++;
+        token->stage = 0;
+        token->pipeline = this;
+
+        inputBusy = true;
+        inFlight++;
+
+        readyQueue->safePut(token);
+    }
+
+    void TaskSystem::Pipeline::advanceToken(TaskSystem::Pipeline::Token *token) {
+        token->stage++;
+
+        if (token->stage > stages.size()) {
+            freeTokens.push_back(token);
+            inFlight--;
+            return;
+        }
+
+        enterStage(token);
+    }
+
+    void TaskSystem::Pipeline::enterStage(TaskSystem::Pipeline::Token *token) {
+        Stage *stage = &stages[token->stage - 1];
+
+        switch (stage->mode) {
+            case PARALLEL:
+                readyQueue->safePut(token);
+                break;
+
+            case SERIAL_OUT_OF_ORDER:
+                if (stage->busy) {
+                    stage->waitingOutOfOrder.push(token);
+                } else {
+                    stage->busy = true;
+                    readyQueue->safePut(token);
+                }
+                break;
+
+            case SERIAL_IN_ORDER:
+                if (stage->busy || stage->nextSequence != token->sequence) {
+                    stage->waitingInOrder[token->sequence] = token;
+                } else {
+                    stage->busy = true;
+                    readyQueue->safePut(token);
+                }
+                break;
+        }
+    }
+
+    void TaskSystem::Pipeline::releaseStage(TaskSystem::Pipeline::Stage *stage) {
+        stage->busy = false;
+
+        if (stage->mode == SERIAL_OUT_OF_ORDER) {
+            if (stage->waitingOutOfOrder.empty())
+                return;
+
+            Token *next = stage->waitingOutOfOrder.front();
+            stage->waitingOutOfOrder.pop();
+
+            stage->busy = true;
+            readyQueue->safePut(next);
+
+        } else if (stage->mode == SERIAL_IN_ORDER) {
+            stage->nextSequence++;
+
+            std::map<unsigned long, Token *>::iterator it = stage->waitingInOrder.find(stage->nextSequence);
+            if (it == stage->waitingInOrder.end())
+                return;
+
+            Token *next = it->second;
+            stage->waitingInOrder.erase(it);
+
+            stage->busy = true;
+            readyQueue->safePut(next);
+        }
+    }
+
+    void TaskSystem::Pipeline::runToken(void *args) {
+        Token *token = (Token *) args;
+        Pipeline *pipeline = token->pipeline;
+
+        if (token->stage == 0) {
+            token->item = pipeline->input(pipeline->inputArgs);
+        } else {
+            Stage *stage = &pipeline->stages[token->stage - 1];
+            token->item = stage->func(token->item, stage->args);
+        }
+    }
+
+    void TaskSystem::Pipeline::tokenCompleted(void *args) {
+        Token *token = (Token *) args;
+        Pipeline *pipeline = token->pipeline;
+
+        pthread_mutex_lock(&pipeline->stateMutex);
+
+        if (token->stage == 0) {
+            pipeline->inputBusy = false;
+
+            if (token->item == nullptr) {
+                pipeline->inputDone = true;
+
+                pipeline->freeTokens.push_back(token);
+                pipeline->inFlight--;
+            } else {
+                pipeline->advanceToken(token);
+            }
+        } else {
+            Stage *stage = &pipeline->stages[token->stage - 1];
+
+            if (stage->mode != PARALLEL)
+                pipeline->releaseStage(stage);
+
+            pipeline->advanceToken(token);
+        }
+
+        pipeline->tryStartInput();
+
+        bool finished = pipeline->inputDone && pipeline->inFlight == 0;
+        ThreadSafeQueue<Token *> *readyQueue = pipeline->readyQueue;
+
+        pthread_mutex_unlock(&pipeline->stateMutex);
+
+        //The pipeline can be destroyed as soon as the dispatcher receives the end marker
+        if (finished)
+            readyQueue->safePut(nullptr);
+    }
+
+    void TaskSystem::executePipeline(TaskSystem::Pipeline *pipeline, unsigned int maxTokens) noexcept(false) {
+        if (pipeline->input == nullptr || maxTokens == 0)
+            throw PipelineConfigurationException();
+
+        ThreadSafeQueue<Pipeline::Token *> tokenQueue;
+
+        pthread_mutex_lock(&pipeline->stateMutex);
+        pipeline->resetState(maxTokens, &tokenQueue);
+        pipeline->tryStartInput();
+        pthread_mutex_unlock(&pipeline->stateMutex);
+
+        while (true) {
+            Pipeline::Token *token = tokenQueue.safePop();
+
+            if (token == nullptr)
+                break;
+
+            pThreadPool->executeFunction(Pipeline::runToken, token, Pipeline::tokenCompleted, token);
+        }
+    }
+}
@@ -0,0 +1,216 @@
+//
+// Created by agent on 18/10/26.
+//
+
+#include <thread>
+#include "TaskSystem.h"
+
+namespace TaskSystem {
+
+    TaskSystem::Schedule::Schedule() : numNodes(0) {}
+
+    unsigned long TaskSystem::Schedule::size() {
+        return entries.size();
+    }
+
+    unsigned int TaskSystem::Schedule::getNode(unsigned long i) {
+        return entries[i].node;
+    }
+
+    int TaskSystem::Schedule::getWorker(unsigned long i) {
+        return entries[i].worker;
+    }
+
+    bool TaskSystem::Schedule::matches(TaskSystem::ExecutionPlan *plan) {
+        if (numNodes != plan->numNodes)
+            return false;
+
+        //The dummy nodes are resolved without being started
+        std::vector<bool> started(numNodes, false);
+        unsigned long numStarted = 0;
+
+        for (unsigned int i = 0; i < numNodes; ++i) {
+            if (plan->nodes[i].dummy)
+                started[i] = true;
+            else
+                numStarted++;
+        }
+
+        if (entries.size() != numStarted)
+            return false;
+
+        for (std::vector<ScheduleEntry>::iterator it = entries.begin(); it != entries.end(); it++) {
+            if (it->node >= numNodes || started[it->node])
+                return false;
+
+            started[it->node] = true;
+        }
+
+        return true;
+    }
+
+    void TaskSystem::Schedule::save(std::ostream &out) {
+        out << numNodes << " " << entries.size() << "\n";
+
+        for (std::vector<ScheduleEntry>::iterator it = entries.begin(); it != entries.end(); it++) {
+            out << it->node << " " << it->worker << "\n";
+        }
+    }
+
+    bool TaskSystem::Schedule::load(std::istream &in) {
+        unsigned int loadedNodes;
+        unsigned long numEntries;
+
+        if (!(in >> loadedNodes >> numEntries))
+            return false;
+
+        //A node is started at most once, a larger count is not a schedule and is not allocated
+        if (numEntries > loadedNodes)
+            return false;
+
+        std::vector<ScheduleEntry> loadedEntries;
+
+        for (unsigned long i = 0; i < numEntries; ++i) {
+            ScheduleEntry entry;
+
+            if (!(in >> entry.node >> entry.worker) || entry.node >= loadedNodes || entry.worker < -1)
+                return false;
+
+            loadedEntries.push_back(entry);
+        }
+
+        numNodes = loadedNodes;
+        entries.swap(loadedEntries);
+
+        return true;
+    }
+
+    bool TaskSystem::Schedule::operator==(const TaskSystem::Schedule &rhs) const {
+        if (numNodes != rhs.numNodes || entries.size() != rhs.entries.size())
+            return false;
+
+        for (unsigned long i = 0; i < entries.size(); ++i) {
+            if (entries[i].node != rhs.entries[i].node || entries[i].worker != rhs.entries[i].worker)
+                return false;
+        }
+
+        return true;
+    }
+
+    bool TaskSystem::Schedule::operator!=(const TaskSystem::Schedule &rhs) const {
+        return !(rhs == *this);
+    }
+
+    void TaskSystem::TaskGraph::setRecording(bool recording) {
+        TaskGraph::recording = recording;
+
+        invalidatePlan();
+    }
+
+    bool TaskSystem::TaskGraph::isRecording() {
+        return recording;
+    }
+
+    TaskSystem::Schedule TaskSystem::TaskGraph::getLastSchedule() {
+        Schedule schedule;
+
+        if (plan == nullptr || plan->record == nullptr)
+            return schedule;
+
+        schedule.numNodes = plan->numNodes;
+        schedule.entries.assign(plan->record, plan->record + plan->recordSize.load(std::memory_order_acquire));
+
+        return schedule;
+    }
+
+    void TaskSystem::TaskGraph::setReplay(TaskSystem::Schedule *replay) {
+        TaskGraph::replay = replay;
+    }
+
+    TaskSystem::Schedule *TaskSystem::TaskGraph::getReplay() {
+        return replay;
+    }
+
+    TaskSystem::ExecutionStatus TaskSystem::replaySchedule(TaskSystem::ExecutionPlan *plan,
+                                                           TaskSystem::Schedule *schedule,
+                                                           TaskSystem::CancellationToken *cancellation,
+                                                           const timespec *deadline) {
+        ExecutionPlan::NodeQueue *nodeQueue = plan->readyQueue;
+
+        //The nodes that become ready before their turn wait here
+        std::vector<bool> ready(plan->numNodes, false);
+        unsigned int numStarted = 0;
+
+        plan->replayStarted.store(0, std::memory_order_relaxed);
+
+        ExecutionPlan::releaseSuccessors(plan->startNode, nullptr);
+
+        for (std::vector<ScheduleEntry>::iterator it = schedule->entries.begin(); it != schedule->entries.end(); it++) {
+            //The recorded order is a topological order, the node becomes ready once the previous ones complete
+            while (!ready[it->node]) {
+                ExecutionPlan::Node *node;
+
+                if (deadline == nullptr) {
+                    node = nodeQueue->safePop();
+                } else if (!nodeQueue->timedPop(deadline, &node)) {
+                    plan->expired.store(true, std::memory_order_release);
+                    return DEADLINE_EXPIRED;
+                }
+
+                ready[node - plan->nodes] = true;
+            }
+
+            ExecutionPlan::Node *node = &plan->nodes[it->node];
+
+            if (plan->isCancelled()) {
+                ExecutionPlan::releaseSuccessors(node, nullptr);
+                continue;
+            }
+
+            numStarted++;
+
+            if (it->worker < 0) {
+                ExecutionPlan::runNode(node, -1);
+                ExecutionPlan::releaseSuccessors(node, nullptr);
+                continue;
+            }
+
+            plan->runningFunctions.fetch_add(1, std::memory_order_relaxed);
+
+            if (!pThreadPool->executeFunctionOn((unsigned int) it->worker, true, ExecutionPlan::runNode, node,
+                                               ExecutionPlan::nodeCompleted, node, deadline)) {
+                plan->runningFunctions.fetch_sub(1, std::memory_order_relaxed);
+                plan->expired.store(true, std::memory_order_release);
+                return DEADLINE_EXPIRED;
+            }
+
+            //The next node is given only after this one has started, so the start order is the recorded one
+            while (plan->replayStarted.load(std::memory_order_acquire) != numStarted) {
+                std::this_thread::yield();
+            }
+        }
+
+        while (true) {
+            ExecutionPlan::Node *node;
+
+            if (deadline == nullptr) {
+                node = nodeQueue->safePop();
+            } else if (!nodeQueue->timedPop(deadline, &node)) {
+                plan->expired.store(true, std::memory_order_release);
+                return DEADLINE_EXPIRED;
+            }
+
+            if (node == plan->endNode)
+                break;
+        }
+
+        //The last completions may still be decrementing the counter
+        plan->waitFunctions(nullptr);
+
+        bool cancelled = cancellation != nullptr && cancellation->isCancelled();
+        plan->cancellation = nullptr;
+
+        return cancelled ? CANCELLED : COMPLETED;
+    }
+
+}
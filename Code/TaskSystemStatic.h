@@ -0,0 +1,275 @@
+//
+// Created by agent on 18/10/26.
+//
+
+#ifndef CODE_TASKSYSTEMSTATIC_H
+#define CODE_TASKSYSTEMSTATIC_H
+
+#include <array>
+#include <atomic>
+#include <cxxabi.h>
+#include <exception>
+#include <utility>
+#include "TaskSystem.h"
+
+namespace TaskSystem {
+
+    /**
+     * Task of a StaticGraph: the function called with the context of the execution and the indexes, in the
+     * graph, of the tasks it depends on; a task can only depend on the tasks listed before it
+     * @tparam Function Function void(Context*), called directly so that the compiler can inline it
+     */
+    template<auto Function, unsigned int... Predecessors>
+    struct StaticTask {
+        static constexpr unsigned int NUM_PREDECESSORS = sizeof...(Predecessors);
+
+        static constexpr std::array<unsigned int, sizeof...(Predecessors)> PREDECESSORS = {{Predecessors...}};
+
+        template<typename Context>
+        static inline void run(Context* context) {
+            Function(context);
+        }
+    };
+
+    /**
+     * Graph whose shape is fixed at compile time; the dependency counts and the successor tables are computed by
+     * the compiler, an execution keeps its counters on the stack of the caller and the tasks are dispatched
+     * to the workers of a TaskSystem without virtual calls and without allocating memory.
+     * The caller executes the tasks that no worker can take right away
+     * @tparam Context Type of the argument passed to the functions of the tasks
+     * @tparam Tasks StaticTask of every task, its index in the list is the one used by the dependencies
+     */
+    template<typename Context, typename... Tasks>
+    class StaticGraph {
+    public:
+        static constexpr unsigned int NUM_TASKS = sizeof...(Tasks);
+
+        static constexpr unsigned int NUM_DEPENDENCIES = (0u + ... + Tasks::NUM_PREDECESSORS);
+
+        static_assert(NUM_TASKS > 0, "A StaticGraph must contain at least one task");
+
+    private:
+        /**
+         * Dependency counts and successors of the tasks in compressed rows, successors of i are
+         * successors[firstSuccessor[i]] to successors[firstSuccessor[i + 1]]
+         */
+        struct Tables {
+            std::array<unsigned int, NUM_TASKS> numDependencies;
+            std::array<unsigned int, NUM_TASKS + 1> firstSuccessor;
+            std::array<unsigned int, NUM_DEPENDENCIES == 0 ? 1 : NUM_DEPENDENCIES> successors;
+
+            /**
+             * False if a task depends on a task that is not listed before it
+             */
+            bool ordered;
+        };
+
+        static constexpr Tables buildTables() {
+            Tables tables = {};
+            tables.ordered = true;
+
+            const unsigned int* predecessors[] = {Tasks::PREDECESSORS.data()...};
+            const unsigned int numPredecessors[] = {Tasks::NUM_PREDECESSORS...};
+
+            //Count the successors of every task, then fill the rows in order of successor
+            std::array<unsigned int, NUM_TASKS + 1> position = {};
+
+            for (unsigned int task = 0; task < NUM_TASKS; ++task) {
+                tables.numDependencies[task] = numPredecessors[task];
+
+                for (unsigned int i = 0; i < numPredecessors[task]; ++i) {
+                    if (predecessors[task][i] >= task)
+                        tables.ordered = false;
+                    else
+                        position[predecessors[task][i] + 1]++;
+                }
+            }
+
+            for (unsigned int task = 0; task < NUM_TASKS; ++task) {
+                position[task + 1] += position[task];
+            }
+
+            tables.firstSuccessor = position;
+
+            for (unsigned int task = 0; task < NUM_TASKS; ++task) {
+                for (unsigned int i = 0; i < numPredecessors[task]; ++i) {
+                    if (predecessors[task][i] < task)
+                        tables.successors[position[predecessors[task][i]]++] = task;
+                }
+            }
+
+            return tables;
+        }
+
+        static constexpr Tables TABLES = buildTables();
+
+        static_assert(TABLES.ordered, "A StaticTask can only depend on the tasks listed before it");
+
+        /**
+         * State of one execution, on the stack of the caller of execute
+         */
+        struct Execution {
+            Context* context;
+            PThreadPool* pool;
+            std::array<std::atomic<unsigned int>, NUM_TASKS> satisfied;
+
+            /**
+             * Tasks not yet completed, the one that completes the last wakes up the caller
+             */
+            std::atomic<unsigned int> remaining;
+
+            /**
+             * Set by the first task that throws, the functions of the tasks not yet started are skipped
+             */
+            std::atomic<bool> failed;
+            std::exception_ptr exception;
+
+            pthread_mutex_t mutex;
+            pthread_cond_t condition;
+            bool completed;
+        };
+
+        /**
+         * Call the function of the task index
+         */
+        template<unsigned int... Indexes>
+        static inline void runFunction(unsigned int index, Context* context, std::integer_sequence<unsigned int, Indexes...>) {
+            //Every function is called directly in its own branch
+            (void) ((index == Indexes ? (Tasks::template run<Context>(context), true) : false) || ...);
+        }
+
+        /**
+         * Execute the task index and, one after the other, the first ready successor of every completed task;
+         * the other ready successors are given to the ready workers or executed right after
+         */
+        static void runFrom(Execution* execution, unsigned int index) {
+            while (true) {
+                if (!execution->failed.load(std::memory_order_relaxed)) {
+                    try {
+                        runFunction(index, execution->context, std::make_integer_sequence<unsigned int, NUM_TASKS>());
+                    } catch (abi::__forced_unwind&) {
+                        //The cancellation of the worker thread must unwind it
+                        throw;
+                    } catch (...) {
+                        pthread_mutex_lock(&execution->mutex);
+                        if (!execution->failed.exchange(true, std::memory_order_relaxed))
+                            execution->exception = std::current_exception();
+                        pthread_mutex_unlock(&execution->mutex);
+                    }
+                }
+
+                unsigned int next = NUM_TASKS;
+
+                for (unsigned int i = TABLES.firstSuccessor[index]; i < TABLES.firstSuccessor[index + 1]; ++i) {
+                    unsigned int successor = TABLES.successors[i];
+
+                    if (execution->satisfied[successor].fetch_add(1, std::memory_order_acq_rel) + 1 !=
+                        TABLES.numDependencies[successor])
+                        continue;
+
+                    if (next == NUM_TASKS)
+                        next = successor;
+                    else
+                        dispatch(execution, successor);
+                }
+
+                taskCompleted(execution);
+
+                if (next == NUM_TASKS)
+                    return;
+
+                index = next;
+            }
+        }
+
+        template<unsigned int Index>
+        static void runTask(void* args) {
+            runFrom((Execution*) args, Index);
+        }
+
+        /**
+         * Entry point of every task for the workers of the pool
+         */
+        template<unsigned int... Indexes>
+        static constexpr std::array<void (*)(void*), NUM_TASKS> entryTable(std::integer_sequence<unsigned int, Indexes...>) {
+            return {{&runTask<Indexes>...}};
+        }
+
+        static constexpr std::array<void (*)(void*), NUM_TASKS> ENTRIES =
+                entryTable(std::make_integer_sequence<unsigned int, NUM_TASKS>());
+
+        static inline void dispatch(Execution* execution, unsigned int index) {
+            if (!execution->pool->tryExecuteFunction(ENTRIES[index], execution, nullptr, nullptr))
+                runFrom(execution, index);
+        }
+
+        static inline void taskCompleted(Execution* execution) {
+            if (execution->remaining.fetch_sub(1, std::memory_order_acq_rel) != 1)
+                return;
+
+            pthread_mutex_lock(&execution->mutex);
+            execution->completed = true;
+            pthread_cond_signal(&execution->condition);
+            pthread_mutex_unlock(&execution->mutex);
+        }
+
+    public:
+        /**
+         * Execute all the tasks of the graph on the workers of the TaskSystem and wait for their end.
+         * If a task throws, the functions of the tasks not yet started are skipped and the first exception
+         * is rethrown once all the tasks are completed
+         * @param context Argument passed to the function of every task
+         */
+        static void execute(TaskSystem* taskSystem, Context* context) {
+            Execution execution;
+            execution.context = context;
+            execution.pool = taskSystem->pThreadPool;
+            execution.remaining.store(NUM_TASKS, std::memory_order_relaxed);
+            execution.failed.store(false, std::memory_order_relaxed);
+            execution.mutex = PTHREAD_MUTEX_INITIALIZER;
+            execution.condition = PTHREAD_COND_INITIALIZER;
+            execution.completed = false;
+
+            for (unsigned int i = 0; i < NUM_TASKS; ++i) {
+                execution.satisfied[i].store(0, std::memory_order_relaxed);
+            }
+
+            //The caller keeps the first root for itself
+            unsigned int first = NUM_TASKS;
+
+            for (unsigned int i = 0; i < NUM_TASKS; ++i) {
+                if (TABLES.numDependencies[i] != 0)
+                    continue;
+
+                if (first == NUM_TASKS)
+                    first = i;
+                else
+                    dispatch(&execution, i);
+            }
+
+            runFrom(&execution, first);
+
+            pthread_mutex_lock(&execution.mutex);
+            while (!execution.completed) {
+                pthread_cond_wait(&execution.condition, &execution.mutex);
+            }
+            pthread_mutex_unlock(&execution.mutex);
+
+            pthread_cond_destroy(&execution.condition);
+            pthread_mutex_destroy(&execution.mutex);
+
+            if (execution.exception != nullptr)
+                std::rethrow_exception(execution.exception);
+        }
+
+        static constexpr unsigned int getNumDependencies(unsigned int index) {
+            return TABLES.numDependencies[index];
+        }
+
+        static constexpr unsigned int getNumSuccessors(unsigned int index) {
+            return TABLES.firstSuccessor[index + 1] - TABLES.firstSuccessor[index];
+        }
+    };
+}
+
+#endif //CODE_TASKSYSTEMSTATIC_H
@@ -0,0 +1,266 @@
+//
+// Created by agent on 18/10/26.
+//
+
+#include <cstdio>
+#include <cstring>
+#include <unordered_map>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "TaskSystem.h"
+
+namespace TaskSystem {
+
+    const char TaskSystem::GraphTopology::MAGIC[8] = {'T', 'S', 'K', 'T', 'O', 'P', 'O', '1'};
+
+    void TaskSystem::TaskGraph::saveTopology(const char *path, void (**functionTable)(void *),
+                                             unsigned int numFunctions, std::vector<Task *> *memberTasks) {
+        compile();
+
+        std::unordered_map<void (*)(void *), unsigned int> functionIndexes;
+        for (unsigned int i = 0; i < numFunctions; ++i) {
+            functionIndexes.emplace(functionTable[i], i);
+        }
+
+        GraphTopology::FileHeader header;
+        memcpy(header.magic, GraphTopology::MAGIC, sizeof(header.magic));
+        header.version = GraphTopology::VERSION;
+        header.numNodes = plan->numNodes;
+        header.numMembers = plan->numMembers;
+        header.numSuccessors = plan->numSuccessors;
+        header.startNode = static_cast<unsigned int>(plan->startNode - plan->nodes);
+        header.endNode = static_cast<unsigned int>(plan->endNode - plan->nodes);
+
+        std::vector<unsigned int> nodeFirstSuccessor(plan->numNodes + 1);
+        std::vector<unsigned int> nodeFirstMember(plan->numNodes + 1);
+        for (unsigned int i = 0; i < plan->numNodes; ++i) {
+            nodeFirstSuccessor[i] = plan->nodes[i].firstSuccessor;
+            nodeFirstMember[i] = plan->nodes[i].firstMember;
+        }
+        nodeFirstSuccessor[plan->numNodes] = plan->numSuccessors;
+        nodeFirstMember[plan->numNodes] = plan->numMembers;
+
+        //The events of the event tasks can not be described by a file
+        for (unsigned int i = 0; i < plan->numNodes; ++i) {
+            if (plan->nodes[i].event != nullptr)
+                throw GraphTopologyException();
+        }
+
+        std::vector<unsigned int> memberFunctions(plan->numMembers);
+        for (unsigned int i = 0; i < plan->numMembers; ++i) {
+            ExecutionPlan::Member *member = &plan->members[i];
+
+            if (member->execute == nullptr) {
+                memberFunctions[i] = GraphTopology::NO_FUNCTION;
+                continue;
+            }
+
+            std::unordered_map<void (*)(void *), unsigned int>::iterator function = functionIndexes.find(member->execute);
+            if (function == functionIndexes.end())
+                throw GraphTopologyException();
+
+            memberFunctions[i] = function->second;
+        }
+
+        FILE *file = fopen(path, "wb");
+        if (file == nullptr)
+            throw GraphTopologyException();
+
+        bool written = fwrite(&header, sizeof(header), 1, file) == 1 &&
+                       fwrite(nodeFirstSuccessor.data(), sizeof(unsigned int), nodeFirstSuccessor.size(), file) == nodeFirstSuccessor.size() &&
+                       fwrite(nodeFirstMember.data(), sizeof(unsigned int), nodeFirstMember.size(), file) == nodeFirstMember.size() &&
+                       fwrite(memberFunctions.data(), sizeof(unsigned int), memberFunctions.size(), file) == memberFunctions.size() &&
+                       fwrite(plan->successors, sizeof(unsigned int), plan->numSuccessors, file) == plan->numSuccessors;
+
+        if (fclose(file) != 0 || !written)
+            throw GraphTopologyException();
+
+        if (memberTasks != nullptr) {
+            memberTasks->clear();
+
+            for (unsigned int i = 0; i < plan->numMembers; ++i) {
+                memberTasks->push_back(plan->members[i].task);
+            }
+        }
+    }
+
+    TaskSystem::GraphTopology::GraphTopology() {
+        mapping = nullptr;
+        mappingSize = 0;
+        header = nullptr;
+        nodeFirstSuccessor = nullptr;
+        nodeFirstMember = nullptr;
+        memberFunctions = nullptr;
+        successors = nullptr;
+        plan = nullptr;
+    }
+
+    TaskSystem::GraphTopology::~GraphTopology() {
+        unload();
+    }
+
+    void TaskSystem::GraphTopology::unload() {
+        if (plan != nullptr)
+            plan->release();
+
+        if (mapping != nullptr)
+            munmap(mapping, mappingSize);
+
+        mapping = nullptr;
+        mappingSize = 0;
+        header = nullptr;
+        plan = nullptr;
+
+        planArena.release();
+    }
+
+    void TaskSystem::GraphTopology::load(const char *path) {
+        unload();
+
+        int fd = open(path, O_RDONLY);
+        if (fd < 0)
+            throw GraphTopologyException();
+
+        struct stat fileStat;
+        if (fstat(fd, &fileStat) != 0 || (size_t) fileStat.st_size < sizeof(FileHeader)) {
+            close(fd);
+            throw GraphTopologyException();
+        }
+
+        size_t size = (size_t) fileStat.st_size;
+        void *address = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+
+        if (address == MAP_FAILED)
+            throw GraphTopologyException();
+
+        const FileHeader *fileHeader = static_cast<const FileHeader *>(address);
+
+        //Size of the arrays computed in 64 bits, the counts of a corrupted file can not overflow it
+        unsigned long long expectedSize = sizeof(FileHeader) + sizeof(unsigned int) *
+                ((unsigned long long) fileHeader->numNodes * 2 + 2 + fileHeader->numMembers + fileHeader->numSuccessors);
+
+        if (memcmp(fileHeader->magic, MAGIC, sizeof(MAGIC)) != 0 || fileHeader->version != VERSION ||
+            expectedSize != size || fileHeader->startNode >= fileHeader->numNodes ||
+            fileHeader->endNode >= fileHeader->numNodes) {
+            munmap(address, size);
+            throw GraphTopologyException();
+        }
+
+        mapping = address;
+        mappingSize = size;
+        header = fileHeader;
+        nodeFirstSuccessor = reinterpret_cast<const unsigned int *>(header + 1);
+        nodeFirstMember = nodeFirstSuccessor + header->numNodes + 1;
+        memberFunctions = nodeFirstMember + header->numNodes + 1;
+        successors = memberFunctions + header->numMembers;
+    }
+
+    void TaskSystem::GraphTopology::bind(void (**functionTable)(void *), unsigned int numFunctions, void **memberArgs) {
+        if (header == nullptr)
+            throw GraphTopologyException();
+
+        if (plan != nullptr)
+            plan->release();
+
+        plan = nullptr;
+        planArena.release();
+
+        unsigned int numNodes = header->numNodes;
+
+        ExecutionPlan *newPlan = planArena.allocateArray<ExecutionPlan>(1);
+        newPlan->numNodes = numNodes;
+        newPlan->nodes = planArena.allocateArray<ExecutionPlan::Node>(numNodes);
+        newPlan->numMembers = header->numMembers;
+        newPlan->members = planArena.allocateArray<ExecutionPlan::Member>(header->numMembers);
+        newPlan->numSuccessors = header->numSuccessors;
+        //The successors are never written by the execution, the mapped array is used directly
+        newPlan->successors = const_cast<unsigned int *>(successors);
+        newPlan->startNode = &newPlan->nodes[header->startNode];
+        newPlan->endNode = &newPlan->nodes[header->endNode];
+        newPlan->readyQueue = nullptr;
+        newPlan->profiling = false;
+        newPlan->affinity = false;
+        newPlan->pinned = false;
+
+        for (unsigned int i = 0; i < header->numMembers; ++i) {
+            ExecutionPlan::Member *member = &newPlan->members[i];
+            unsigned int function = memberFunctions[i];
+
+            if (function != NO_FUNCTION && function >= numFunctions)
+                throw GraphTopologyException();
+
+            member->execute = function == NO_FUNCTION ? nullptr : functionTable[function];
+            member->args = memberArgs == nullptr ? nullptr : memberArgs[i];
+            member->task = nullptr;
+        }
+
+        //The nodes of the file are in topological order: every successor must follow its node,
+        //this also guarantees that the topology is acyclic
+        if (nodeFirstSuccessor[numNodes] != header->numSuccessors || nodeFirstMember[numNodes] != header->numMembers)
+            throw GraphTopologyException();
+
+        for (unsigned int i = 0; i < numNodes; ++i) {
+            ExecutionPlan::Node *node = &newPlan->nodes[i];
+
+            if (nodeFirstSuccessor[i] > nodeFirstSuccessor[i + 1] || nodeFirstMember[i] >= nodeFirstMember[i + 1])
+                throw GraphTopologyException();
+
+            node->firstSuccessor = nodeFirstSuccessor[i];
+            node->numSuccessors = nodeFirstSuccessor[i + 1] - nodeFirstSuccessor[i];
+            node->firstMember = nodeFirstMember[i];
+            node->numMembers = nodeFirstMember[i + 1] - nodeFirstMember[i];
+            node->dummy = node->numMembers == 1 && newPlan->members[node->firstMember].execute == nullptr;
+            node->shared = false;
+            node->plan = newPlan;
+            node->lastWorker = -1;
+            node->preferredWorker = -1;
+            node->pinnedWorker = -1;
+            node->event = nullptr;
+
+            for (unsigned int j = 0; j < node->numMembers; ++j) {
+                if (!node->dummy && newPlan->members[node->firstMember + j].execute == nullptr)
+                    throw GraphTopologyException();
+            }
+
+            for (unsigned int j = node->firstSuccessor; j < node->firstSuccessor + node->numSuccessors; ++j) {
+                if (successors[j] <= i || successors[j] >= numNodes)
+                    throw GraphTopologyException();
+
+                newPlan->nodes[successors[j]].numDependencies++;
+            }
+        }
+
+        //Every node must be reached from the start node and must reach the end node
+        for (unsigned int i = 0; i < numNodes; ++i) {
+            ExecutionPlan::Node *node = &newPlan->nodes[i];
+            bool start = node == newPlan->startNode;
+            bool end = node == newPlan->endNode;
+
+            if ((node->numDependencies == 0) != start || (node->numSuccessors == 0) != end || ((start || end) && !node->dummy))
+                throw GraphTopologyException();
+        }
+
+        newPlan->computeRanks();
+
+        plan = newPlan;
+    }
+
+    unsigned int TaskSystem::GraphTopology::getNumNodes() {
+        return header == nullptr ? 0 : header->numNodes;
+    }
+
+    unsigned int TaskSystem::GraphTopology::getNumMembers() {
+        return header == nullptr ? 0 : header->numMembers;
+    }
+
+    void TaskSystem::GraphTopology::setHugePages(bool hugePages) {
+        planArena.setHugePages(hugePages);
+    }
+
+    bool TaskSystem::GraphTopology::isHugePages() {
+        return planArena.isHugePages();
+    }
+
+}
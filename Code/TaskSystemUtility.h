@@ -16,21 +16,22 @@ namespace TaskSystem{
      * @param numWorkers Number of available workers
      * @param out std::vector of pairs of indexes that contain the bounds of the i-th worker
      */
-    inline void splitEqually(long totWork, int numWorkers, std::vector<std::pair<long, long>>* out){
+    template<typename Index>
+    inline void splitEqually(long totWork, int numWorkers, std::vector<std::pair<Index, Index>>* out){
         long minWork = totWork / numWorkers;
         int residWork = static_cast<int>(totWork - numWorkers * minWork);
 
         long minWorkP1 = minWork + 1;
 
-        if(out->size() != numWorkers)
-            out->reserve(numWorkers);
+        if(out->size() != (size_t) numWorkers)
+            out->resize(numWorkers);
 
         long sum = 0;
         for (int i = 0; i < residWork; ++i) {
-            unsigned long oldSum = sum;
+            long oldSum = sum;
             sum += minWorkP1;
 
-            (*out)[i] = std::pair<long, long>(oldSum, sum - 1);
+            (*out)[i] = std::pair<Index, Index>(oldSum, sum - 1);
         }
 
 
@@ -39,7 +40,44 @@ namespace TaskSystem{
 
             sum += minWork;
 
-            (*out)[j] = std::pair<long, long>(oldSum, sum - 1);
+            (*out)[j] = std::pair<Index, Index>(oldSum, sum - 1);
+        }
+    }
+
+    /**
+     * Split the total ammount of work for the number of workers passed as argument so that every bound
+     * between two workers falls after the first headSize elements on a multiple of blockSize elements.
+     * Used to align the chunks of an array to the cache lines: only the first chunk contains the elements
+     * before the first line and only the last one the elements after the last full line
+     * @param totWork Total ammount of work
+     * @param numWorkers Number of available workers
+     * @param headSize Number of elements before the first block
+     * @param blockSize Number of elements of a block
+     * @param out std::vector of pairs of indexes that contain the bounds of the i-th worker,
+     * the i-th worker has no work if the first index is greater than the second
+     */
+    template<typename Index>
+    inline void splitAligned(long totWork, int numWorkers, long headSize, long blockSize,
+                             std::vector<std::pair<Index, Index>>* out){
+        if(headSize > totWork)
+            headSize = totWork;
+
+        long numBlocks = (totWork - headSize + blockSize - 1) / blockSize;
+
+        std::vector<std::pair<long, long>> blocks;
+        splitEqually(numBlocks, numWorkers, &blocks);
+
+        if(out->size() != (size_t) numWorkers)
+            out->resize(numWorkers);
+
+        for (int i = 0; i < numWorkers; ++i) {
+            long begin = i == 0 ? 0 : headSize + blocks[i].first * blockSize;
+            long end = i == numWorkers - 1 ? totWork : headSize + (blocks[i].second + 1) * blockSize;
+
+            if(end > totWork)
+                end = totWork;
+
+            (*out)[i] = std::pair<Index, Index>(begin, end - 1);
         }
     }
 }
@@ -0,0 +1,192 @@
+//
+// Created by agent on 18/10/26.
+//
+
+#ifndef CODE_TASKSYSTEMWORKERLOCAL_H
+#define CODE_TASKSYSTEMWORKERLOCAL_H
+
+#include <pthread.h>
+#include <utility>
+#include <vector>
+#include "TaskSystem.h"
+
+namespace TaskSystem {
+
+    /**
+     * Value of type T for every thread that executes the tasks of a TaskSystem, like the scratch buffers of the
+     * task bodies or the partial results of a reduction. The value of a worker is found by its index without
+     * locks and is kept across the tasks and the executions, so a buffer is allocated once per worker;
+     * the threads that are not workers of the TaskSystem, like the callers that take part in an execution,
+     * get their own value under a mutex. The values are created from the exemplar by their thread on first use
+     * @tparam T Type of the values, copy constructible
+     */
+    template<typename T>
+    class WorkerLocal {
+        /**
+         * Value of a worker, on its own cache line so that the workers never write the same line
+         */
+        struct alignas(PThreadPool::CACHE_LINE_SIZE) Slot {
+            T* value;
+        };
+
+        PThreadPool* pool;
+
+        Slot* slots;
+
+        unsigned int numSlots;
+
+        T exemplar;
+
+        pthread_mutex_t mutex;
+
+        /**
+         * Values of the threads that are not workers of the pool
+         */
+        std::vector<std::pair<pthread_t, T*>> threadValues;
+
+    public:
+        /**
+         * @param exemplar Value copied in the value of every thread on its first use
+         */
+        explicit WorkerLocal(TaskSystem* taskSystem, const T& exemplar = T()) : exemplar(exemplar) {
+            pool = taskSystem->pThreadPool;
+            numSlots = pool->getNumWorkerThreads();
+            slots = new Slot[numSlots];
+            mutex = PTHREAD_MUTEX_INITIALIZER;
+
+            for (unsigned int i = 0; i < numSlots; ++i) {
+                slots[i].value = nullptr;
+            }
+        }
+
+        WorkerLocal(const WorkerLocal&) = delete;
+        WorkerLocal& operator=(const WorkerLocal&) = delete;
+
+        ~WorkerLocal() {
+            clear();
+
+            delete[] slots;
+            pthread_mutex_destroy(&mutex);
+        }
+
+        /**
+         * @return The value of the calling thread, created from the exemplar if it is its first use
+         */
+        inline T& local() {
+            if (PThreadPool::getCurrentPool() == pool) {
+                Slot* slot = &slots[PThreadPool::getCurrentWorkerIndex()];
+
+                if (slot->value == nullptr)
+                    slot->value = new T(exemplar);
+
+                return *slot->value;
+            }
+
+            pthread_t self = pthread_self();
+
+            pthread_mutex_lock(&mutex);
+
+            for (typename std::vector<std::pair<pthread_t, T*>>::iterator it = threadValues.begin();
+                 it != threadValues.end(); it++) {
+                if (pthread_equal(it->first, self)) {
+                    T* value = it->second;
+
+                    pthread_mutex_unlock(&mutex);
+                    return *value;
+                }
+            }
+
+            T* value = new T(exemplar);
+            threadValues.push_back(std::pair<pthread_t, T*>(self, value));
+
+            pthread_mutex_unlock(&mutex);
+
+            return *value;
+        }
+
+        /**
+         * Call the function on the value of every thread that used it; it must not be called while tasks use the values
+         * @param function Function void(T&)
+         */
+        template<typename Function>
+        void forEach(Function function) {
+            for (unsigned int i = 0; i < numSlots; ++i) {
+                if (slots[i].value != nullptr)
+                    function(*slots[i].value);
+            }
+
+            pthread_mutex_lock(&mutex);
+
+            for (typename std::vector<std::pair<pthread_t, T*>>::iterator it = threadValues.begin();
+                 it != threadValues.end(); it++) {
+                function(*it->second);
+            }
+
+            pthread_mutex_unlock(&mutex);
+        }
+
+        /**
+         * Combine the values of all the threads that used it; it must not be called while tasks use the values
+         * @param combine Function T(const T&, const T&)
+         * @return The combination of the values, the exemplar if no thread used it
+         */
+        template<typename Combine>
+        T combine(Combine combine) {
+            T* result = nullptr;
+            T accumulator(exemplar);
+
+            forEach([&result, &accumulator, &combine](T& value) {
+                if (result == nullptr) {
+                    accumulator = value;
+                    result = &accumulator;
+                } else {
+                    accumulator = combine(accumulator, value);
+                }
+            });
+
+            return accumulator;
+        }
+
+        /**
+         * @return The number of threads that used it
+         */
+        unsigned int size() {
+            unsigned int count = 0;
+
+            for (unsigned int i = 0; i < numSlots; ++i) {
+                if (slots[i].value != nullptr)
+                    count++;
+            }
+
+            pthread_mutex_lock(&mutex);
+            count += (unsigned int) threadValues.size();
+            pthread_mutex_unlock(&mutex);
+
+            return count;
+        }
+
+        /**
+         * Delete the values of all the threads, the next use creates them again from the exemplar;
+         * it must not be called while tasks use the values
+         */
+        void clear() {
+            for (unsigned int i = 0; i < numSlots; ++i) {
+                delete slots[i].value;
+                slots[i].value = nullptr;
+            }
+
+            pthread_mutex_lock(&mutex);
+
+            for (typename std::vector<std::pair<pthread_t, T*>>::iterator it = threadValues.begin();
+                 it != threadValues.end(); it++) {
+                delete it->second;
+            }
+
+            threadValues.clear();
+
+            pthread_mutex_unlock(&mutex);
+        }
+    };
+}
+
+#endif //CODE_TASKSYSTEMWORKERLOCAL_H
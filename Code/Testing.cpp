@@ -8,9 +8,16 @@
 
 #include "TaskSystem.h"
 #include "TaskSystemUtility.h"
+#include "TaskSystemAlgorithms.h"
+#include "TaskSystemStatic.h"
+#include "TaskSystemWorkerLocal.h"
 
+#include <atomic>
 #include <pthread.h>
+#include <sstream>
+#include <stdexcept>
 #include <thread>
+#include <unistd.h>
 
 /****************************************************************
  *  TASK TO TASK TESTS
@@ -24,7 +31,7 @@ BOOST_AUTO_TEST_CASE(test_case_empty){
         TaskSystem::TaskSystem::TaskGraph taskGraph;
         TaskSystem::TaskSystem taskSystem;
 
-        taskSystem.executeTaskGraph(taskGraph);
+        taskSystem.executeTaskGraph(&taskGraph);
 
     }catch(std::exception exe){
         BOOST_TEST(false);
@@ -54,7 +61,7 @@ BOOST_AUTO_TEST_CASE(test_case_single_task){
 
         taskGraph.addTask(&myTask);
 
-        taskSystem.executeTaskGraph(taskGraph);
+        taskSystem.executeTaskGraph(&taskGraph);
 
     }catch(std::exception exe){
         BOOST_TEST(false);
@@ -110,7 +117,7 @@ BOOST_AUTO_TEST_CASE(test_case_two_parallel_tasks){
         taskGraph.addTask(&mutexTask1);
         taskGraph.addTask(&mutexTask2);
 
-        taskSystem.executeTaskGraph(taskGraph);
+        taskSystem.executeTaskGraph(&taskGraph);
     }catch(std::exception exe){
         BOOST_TEST(false);
     }
@@ -164,7 +171,7 @@ BOOST_AUTO_TEST_CASE(test_case_two_serial_tasks){
 
         myTask1.addDependencyTo(&myTask2);
 
-        taskSystem.executeTaskGraph(taskGraph);
+        taskSystem.executeTaskGraph(&taskGraph);
 
     }catch(std::exception exe){
         BOOST_TEST(false);
@@ -227,7 +234,7 @@ BOOST_AUTO_TEST_CASE(test_case_multiple_into_one_dependency){
         task3.addDependencyTo(&taskF);
         task4.addDependencyTo(&taskF);
 
-        taskSystem.executeTaskGraph(taskGraph);
+        taskSystem.executeTaskGraph(&taskGraph);
 
     }catch(std::exception exe){
         BOOST_TEST(false);
@@ -258,7 +265,7 @@ BOOST_AUTO_TEST_CASE(test_case_cyclic_exception_still_executable){
     }
     catch(TaskSystem::TaskSystem::CyclicGraphException& exe){
         try {
-            taskSystem.executeTaskGraph(taskGraph);
+            taskSystem.executeTaskGraph(&taskGraph);
         }catch (std::exception& exe){
             BOOST_TEST(false);
         }
@@ -299,7 +306,7 @@ BOOST_AUTO_TEST_CASE(test_case_a_task_cant_be_added_twice){
     }
     catch (TaskSystem::TaskSystem::TaskElementParentingException &exe) {
         try {
-            taskSystem.executeTaskGraph(taskGraph);
+            taskSystem.executeTaskGraph(&taskGraph);
         }catch(std::exception& exe){
             BOOST_TEST(false);
         }
@@ -355,7 +362,7 @@ BOOST_AUTO_TEST_CASE(test_case_a_task_cant_depend_by_itself){
     }
     catch(TaskSystem::TaskSystem::CyclicGraphException& exe){
         try {
-            taskSystem.executeTaskGraph(taskGraph);
+            taskSystem.executeTaskGraph(&taskGraph);
         }catch (std::exception& exe){
             BOOST_TEST(false);
         }
@@ -369,6 +376,63 @@ BOOST_AUTO_TEST_CASE(test_case_a_task_cant_depend_by_itself){
 }
 
 
+/**
+ * Test that a graph can be executed again after it has been changed
+ * and that the dependencies added in between are respected
+ */
+BOOST_AUTO_TEST_CASE(test_case_execute_again_after_change){
+    std::atomic<int> counter(0);
+
+    class MyTask : public TaskSystem::TaskSystem::Task{
+    public:
+        std::atomic<int>* counter;
+        int order;
+        int runs;
+        MyTask(std::atomic<int> *counter) : counter(counter), order(-1), runs(0) {}
+    } task1(&counter), task2(&counter), task3(&counter);
+
+    void (*func)(void*) = [](void* arg){
+        MyTask* context = (MyTask*) arg;
+        context->order = (*context->counter)++;
+        context->runs++;
+    };
+
+    task1.setExecute(func);
+    task2.setExecute(func);
+    task3.setExecute(func);
+
+    try {
+        TaskSystem::TaskSystem::TaskGraph taskGraph;
+        TaskSystem::TaskSystem taskSystem(2);
+
+        taskGraph.addTask(&task1);
+        taskGraph.addTask(&task2);
+
+        task2.addDependencyTo(&task1);
+
+        taskSystem.executeTaskGraph(&taskGraph);
+
+        BOOST_TEST(task2.order < task1.order);
+
+        taskGraph.addTask(&task3);
+        task1.addDependencyTo(&task3);
+
+        counter = 0;
+        taskSystem.executeTaskGraph(&taskGraph);
+
+    }catch(std::exception& exe){
+        BOOST_TEST(false);
+    }
+
+    BOOST_TEST(task1.runs == 2);
+    BOOST_TEST(task2.runs == 2);
+    BOOST_TEST(task3.runs == 1);
+    BOOST_TEST(task2.order == 0);
+    BOOST_TEST(task1.order == 1);
+    BOOST_TEST(task3.order == 2);
+}
+
+
 /****************************************************************
  *  MISC TASK TO GRAPH AND GRAPH TO TASK TESTS
  ****************************************************************/
@@ -422,7 +486,7 @@ BOOST_AUTO_TEST_CASE(test_case_two_parallel_two_graphs){
 
         taskGraph1.addSubGraph(&taskGraph2);
 
-        taskSystem.executeTaskGraph(taskGraph1);
+        taskSystem.executeTaskGraph(&taskGraph1);
 
     }catch(std::exception exe){
         BOOST_TEST(false);
@@ -479,7 +543,7 @@ BOOST_AUTO_TEST_CASE(test_case_two_serial_two_graphs){
 
         myTask1.addDependencyTo(&taskGraph2);
 
-        taskSystem.executeTaskGraph(taskGraph1);
+        taskSystem.executeTaskGraph(&taskGraph1);
 
     }catch(std::exception exe){
         BOOST_TEST(false);
@@ -539,7 +603,7 @@ BOOST_AUTO_TEST_CASE(test_case_two_serial_two_graphs_reverse){
 
         taskGraph1.addDependencyTo(&myTask2);
 
-        taskSystem.executeTaskGraph(taskGraph2);
+        taskSystem.executeTaskGraph(&taskGraph2);
     }catch(std::exception exe){
         BOOST_TEST(false);
     }
@@ -593,7 +657,7 @@ BOOST_AUTO_TEST_CASE(test_case_two_linked_graphs){
 
         taskGraph1.addDependencyTo(&taskGraph2);
 
-        taskSystem.executeTaskGraph(taskGraph3);
+        taskSystem.executeTaskGraph(&taskGraph3);
 
     }catch(std::exception exe){
         BOOST_TEST(false);
@@ -666,7 +730,7 @@ BOOST_AUTO_TEST_CASE(test_case_no_cyclic_dependency_through_graph_dependencies){
         BOOST_TEST(true);
 
         try{
-            taskSystem.executeTaskGraph(taskGraph0);
+            taskSystem.executeTaskGraph(&taskGraph0);
         }catch(std::exception exe) {
             BOOST_TEST(false);
         }
@@ -680,44 +744,2335 @@ BOOST_AUTO_TEST_CASE(test_case_no_cyclic_dependency_through_graph_dependencies){
 }
 
 
-/****************************************************************
- *  UTILITY TESTS
- ****************************************************************/
+/**
+ * Test that a chain of tasks is executed in order when the worker that completes a task
+ * executes the next one directly, and that the inline depth limits the consecutive tasks
+ * executed by the same worker
+ */
+BOOST_AUTO_TEST_CASE(test_case_chain_inline_execution){
+    class ChainTask : public TaskSystem::TaskSystem::Task{
+    public:
+        std::atomic<int>* counter;
+        int order;
+        pthread_t thread;
+        ChainTask() : counter(nullptr), order(-1) {}
+    };
+
+    std::atomic<int> counter(0);
+    std::vector<ChainTask> tasks(100);
+
+    try {
+        TaskSystem::TaskSystem::TaskGraph taskGraph;
+        TaskSystem::TaskSystem taskSystem(2);
+
+        taskSystem.setMaxInlineDepth(4);
+
+        for (int i = 0; i < 100; ++i) {
+            tasks[i].counter = &counter;
+            tasks[i].setExecute([](void* arg){
+                ChainTask* context = (ChainTask*) arg;
+                context->order = (*context->counter)++;
+                context->thread = pthread_self();
+            });
+
+            taskGraph.addTask(&tasks[i]);
+
+            if (i > 0)
+                tasks[i - 1].addDependencyTo(&tasks[i]);
+        }
+
+        taskSystem.executeTaskGraph(&taskGraph);
+
+    }catch(std::exception& exe){
+        BOOST_TEST(false);
+    }
+
+    int threadSwitches = 0;
+    for (int i = 0; i < 100; ++i) {
+        BOOST_TEST(tasks[i].order == i);
+
+        if (i > 0 && !pthread_equal(tasks[i].thread, tasks[i - 1].thread))
+            threadSwitches++;
+    }
+
+    BOOST_TEST(threadSwitches <= 20);
+}
 
 /**
- * Test that the spliEqually function work with a number of workers multiple
- * of the total work
+ * Test that deeply nested subgraphs, whose start and end tasks are resolved without
+ * being dispatched, still respect the dependencies between the nested graphs
  */
-BOOST_AUTO_TEST_CASE(test_case_split_equally_work_multiple_of_workers){
+BOOST_AUTO_TEST_CASE(test_case_deeply_nested_graphs){
+    class MyTask : public TaskSystem::TaskSystem::Task{
+    public:
+        std::atomic<int>* counter;
+        int order;
+        MyTask() : counter(nullptr), order(-1) {}
+    };
 
-    std::vector<std::pair<unsigned long, unsigned long>> pairs;
+    std::atomic<int> counter(0);
+    std::vector<TaskSystem::TaskSystem::TaskGraph> graphs(32);
+    std::vector<MyTask> tasks(32);
+    MyTask lastTask;
 
-    TaskSystem::splitEqually(100,5,&pairs);
+    try {
+        TaskSystem::TaskSystem taskSystem(2);
 
-    for (int i = 0; i < 5; ++i) {
-        unsigned long diff = pairs.at(i).second - pairs.at(i).first;
+        for (int i = 0; i < 32; ++i) {
+            tasks[i].counter = &counter;
+            tasks[i].setExecute([](void* arg){
+                MyTask* context = (MyTask*) arg;
+                context->order = (*context->counter)++;
+            });
 
-        BOOST_TEST(diff == 100 / 5 - 1);
+            graphs[i].addTask(&tasks[i]);
+
+            if (i > 0)
+                graphs[i - 1].addSubGraph(&graphs[i]);
+        }
+
+        //Every task waits for the tasks of all the graphs nested into its graph
+        for (int i = 0; i < 31; ++i) {
+            graphs[i + 1].addDependencyTo(&tasks[i]);
+        }
+
+        lastTask.counter = &counter;
+        lastTask.setExecute([](void* arg){
+            MyTask* context = (MyTask*) arg;
+            context->order = (*context->counter)++;
+        });
+        graphs[31].addTask(&lastTask);
+        lastTask.addDependencyTo(&tasks[31]);
+
+        taskSystem.executeTaskGraph(&graphs[0]);
+
+    }catch(std::exception& exe){
+        BOOST_TEST(false);
+    }
+
+    BOOST_TEST(lastTask.order == 0);
+    for (int i = 0; i < 32; ++i) {
+        BOOST_TEST(tasks[i].order == 32 - i);
     }
 }
 
+
 /**
- * Test that the spliEqually function work with a number of workers that is not
- * multiple of the total work
+ * Test that the coarsening merges small sibling tasks and chains of small tasks,
+ * that every task is still executed once and that the dependencies are respected
  */
-BOOST_AUTO_TEST_CASE(test_case_split_equally_work_not_multiple_of_workers){
+BOOST_AUTO_TEST_CASE(test_case_coarsening){
+    class MyTask : public TaskSystem::TaskSystem::Task{
+    public:
+        std::atomic<int>* counter;
+        int order;
+        int runs;
+        MyTask() : counter(nullptr), order(-1), runs(0) {}
+    };
 
-    std::vector<std::pair<unsigned long, unsigned long>> pairs;
+    std::atomic<int> counter(0);
+    std::vector<MyTask> siblings(1000);
+    std::vector<MyTask> chain(50);
 
-    TaskSystem::splitEqually(100,6,&pairs);
+    void (*func)(void*) = [](void* arg){
+        MyTask* context = (MyTask*) arg;
+        context->order = (*context->counter)++;
+        context->runs++;
+    };
 
-    for (int i = 0; i < 6; ++i) {
-        unsigned long diff = pairs.at(i).second - pairs.at(i).first;
+    try {
+        TaskSystem::TaskSystem::TaskGraph taskGraph, chainGraph;
+        TaskSystem::TaskSystem taskSystem(2);
 
-        if (i < 100 % 6)
-            BOOST_TEST(diff == 100 / 6);
-        else
-            BOOST_TEST(diff == 100 / 6 - 1);
+        for (int i = 0; i < 1000; ++i) {
+            siblings[i].counter = &counter;
+            siblings[i].setExecute(func);
+            siblings[i].setCostHint(100);
+
+            taskGraph.addTask(&siblings[i]);
+        }
+
+        for (int i = 0; i < 50; ++i) {
+            chain[i].counter = &counter;
+            chain[i].setExecute(func);
+            chain[i].setCostHint(100);
+
+            chainGraph.addTask(&chain[i]);
+
+            if (i > 0)
+                chain[i - 1].addDependencyTo(&chain[i]);
+        }
+
+        taskGraph.addSubGraph(&chainGraph);
+
+        unsigned int fineNodes = taskGraph.getNumPlanNodes();
+
+        taskGraph.setCoarseningGrain(1000);
+
+        BOOST_TEST(fineNodes == 1000 + 50 + 4);
+        BOOST_TEST(taskGraph.getNumPlanNodes() == 100 + 5 + 4);
+
+        taskSystem.executeTaskGraph(&taskGraph);
+
+    }catch(std::exception& exe){
+        BOOST_TEST(false);
+    }
+
+    for (int i = 0; i < 1000; ++i) {
+        BOOST_TEST(siblings[i].runs == 1);
+    }
+
+    for (int i = 0; i < 50; ++i) {
+        BOOST_TEST(chain[i].runs == 1);
+
+        if (i > 0)
+            BOOST_TEST(chain[i - 1].order < chain[i].order);
+    }
+}
+
+
+/**
+ * Test that the execution times of the tasks of a profiled graph are measured and that,
+ * once measured, the longest chain of tasks is started first
+ */
+BOOST_AUTO_TEST_CASE(test_case_profile_guided_ordering){
+    class SleepTask : public TaskSystem::TaskSystem::Task{
+    public:
+        std::atomic<int>* counter;
+        int sleepMs;
+        int order;
+        SleepTask(std::atomic<int>* counter, int sleepMs) : counter(counter), sleepMs(sleepMs), order(-1) {}
+    };
+
+    std::atomic<int> counter(0);
+    SleepTask shortTask(&counter, 1), longTask(&counter, 20), longSuccessor(&counter, 1);
+
+    void (*func)(void*) = [](void* arg){
+        SleepTask* context = (SleepTask*) arg;
+        context->order = (*context->counter)++;
+        std::this_thread::sleep_for(std::chrono::milliseconds(context->sleepMs));
+    };
+
+    shortTask.setExecute(func);
+    longTask.setExecute(func);
+    longSuccessor.setExecute(func);
+
+    try {
+        TaskSystem::TaskSystem::TaskGraph taskGraph;
+        TaskSystem::TaskSystem taskSystem(1);
+        //The start order is the one of the single worker
+        taskSystem.setCallerParticipation(false);
+
+        taskGraph.addTask(&shortTask);
+        taskGraph.addTask(&longTask);
+        taskGraph.addTask(&longSuccessor);
+        longTask.addDependencyTo(&longSuccessor);
+
+        taskGraph.setProfiling(true);
+
+        for (int i = 0; i < 3; ++i) {
+            counter = 0;
+            taskSystem.executeTaskGraph(&taskGraph);
+        }
+
+    }catch(std::exception& exe){
+        BOOST_TEST(false);
+    }
+
+    BOOST_TEST(longTask.getNumProfiledExecutions() == 3);
+    BOOST_TEST(longTask.getAverageTime() >= 20000000ul);
+    BOOST_TEST(longTask.getP95Time() >= 20000000ul);
+    BOOST_TEST(shortTask.getAverageTime() < longTask.getAverageTime());
+    BOOST_TEST(longTask.order == 0);
+}
+
+
+/**
+ * Test that the topology of a graph saved to a file is loaded, bound to the same functions
+ * and executed respecting the dependencies, and that a function missing from the table is refused
+ */
+BOOST_AUTO_TEST_CASE(test_case_graph_topology_round_trip){
+    class OrderTask : public TaskSystem::TaskSystem::Task{
+    public:
+        std::atomic<int>* counter;
+        int order;
+        int runs;
+        OrderTask(std::atomic<int>* counter) : counter(counter), order(-1), runs(0) {}
+    };
+
+    std::atomic<int> counter(0);
+    OrderTask first(&counter), left(&counter), right(&counter), last(&counter);
+
+    void (*func)(void*) = [](void* arg){
+        OrderTask* context = (OrderTask*) arg;
+        context->order = (*context->counter)++;
+        context->runs++;
+    };
+    void (*other)(void*) = [](void* arg){
+        OrderTask* context = (OrderTask*) arg;
+        context->order = (*context->counter)++;
+        context->runs += 10;
+    };
+
+    first.setExecute(func);
+    left.setExecute(func);
+    right.setExecute(other);
+    last.setExecute(func);
+
+    const char* path = "/tmp/test_case_graph_topology_round_trip.topo";
+    void (*functionTable[])(void*) = {func, other};
+
+    try {
+        TaskSystem::TaskSystem::TaskGraph taskGraph;
+        TaskSystem::TaskSystem taskSystem(2);
+
+        taskGraph.addTask(&first);
+        taskGraph.addTask(&left);
+        taskGraph.addTask(&right);
+        taskGraph.addTask(&last);
+        first.addDependencyTo(&left);
+        first.addDependencyTo(&right);
+        left.addDependencyTo(&last);
+        right.addDependencyTo(&last);
+
+        std::vector<TaskSystem::TaskSystem::Task*> memberTasks;
+        taskGraph.saveTopology(path, functionTable, 2, &memberTasks);
+
+        std::vector<void*> memberArgs(memberTasks.begin(), memberTasks.end());
+
+        TaskSystem::TaskSystem::GraphTopology topology;
+        topology.load(path);
+        topology.bind(functionTable, 2, memberArgs.data());
+
+        BOOST_TEST(topology.getNumNodes() == taskGraph.getNumPlanNodes());
+        BOOST_TEST(topology.getNumMembers() == memberTasks.size());
+
+        for (int i = 0; i < 2; ++i) {
+            counter = 0;
+            taskSystem.executeGraphTopology(&topology);
+        }
+
+        bool refused = false;
+        try {
+            taskGraph.saveTopology(path, functionTable, 1);
+        }catch(TaskSystem::TaskSystem::GraphTopologyException& exe){
+            refused = true;
+        }
+        BOOST_TEST(refused);
+
+    }catch(std::exception& exe){
+        BOOST_TEST(false);
+    }
+
+    unlink(path);
+
+    BOOST_TEST(first.runs == 2);
+    BOOST_TEST(left.runs == 2);
+    BOOST_TEST(right.runs == 20);
+    BOOST_TEST(last.runs == 2);
+    BOOST_TEST(first.order == 0);
+    BOOST_TEST(last.order == 3);
+}
+
+
+/**
+ * Test that the DOT and JSON exports contain the subgraphs, the dependencies,
+ * the critical path and the workers of the last execution
+ */
+BOOST_AUTO_TEST_CASE(test_case_export_dot_json){
+    TaskSystem::TaskSystem::Task first, second, other;
+
+    first.setCostHint(100);
+    second.setCostHint(100);
+    other.setCostHint(10);
+
+    std::string dot, json;
+
+    try {
+        TaskSystem::TaskSystem::TaskGraph taskGraph, subGraph;
+        TaskSystem::TaskSystem taskSystem(2);
+
+        taskGraph.addTask(&first);
+        taskGraph.addTask(&second);
+        first.addDependencyTo(&second);
+
+        subGraph.addTask(&other);
+        taskGraph.addSubGraph(&subGraph);
+
+        taskSystem.executeTaskGraph(&taskGraph);
+
+        std::ostringstream dotStream, jsonStream;
+        taskGraph.exportDot(dotStream);
+        taskGraph.exportJSON(jsonStream);
+
+        dot = dotStream.str();
+        json = jsonStream.str();
+
+    }catch(std::exception& exe){
+        BOOST_TEST(false);
+    }
+
+    std::string criticalEdge = "t" + std::to_string(first.getTaskID()) + " -> t" +
+                               std::to_string(second.getTaskID()) + " [color=red";
+
+    BOOST_TEST(dot.find("digraph TaskGraph") == 0);
+    BOOST_TEST(dot.find("subgraph cluster_") != dot.rfind("subgraph cluster_"));
+    BOOST_TEST(dot.find(criticalEdge) != std::string::npos);
+    BOOST_TEST(dot.find("\\nworker ") != std::string::npos);
+    BOOST_TEST(json.find("\"subGraphs\":[{") != std::string::npos);
+    BOOST_TEST(json.find("\"criticalPathCost\":200") != std::string::npos);
+    BOOST_TEST(json.find("\"id\":" + std::to_string(other.getTaskID()) + ",\"dummy\":false,\"cost\":10") != std::string::npos);
+}
+
+
+/**
+ * Test that work, span and parallelism are computed from the cost hints
+ * and that the idle time of a profiled execution is reported, counting the caller when it executed some tasks
+ */
+BOOST_AUTO_TEST_CASE(test_case_graph_analysis){
+    TaskSystem::TaskSystem::Task first, second, other, busy, waiting;
+
+    void (*func)(void*) = [](void*){
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    };
+
+    first.setExecute(func);
+    second.setExecute(func);
+    other.setExecute(func);
+    busy.setExecute(func);
+    waiting.setExecute(func);
+
+    first.setCostHint(100);
+    second.setCostHint(100);
+    other.setCostHint(50);
+
+    try {
+        TaskSystem::TaskSystem::TaskGraph taskGraph;
+        TaskSystem::TaskSystem taskSystem(2);
+        taskSystem.setCallerParticipation(false);
+
+        taskGraph.addTask(&first);
+        taskGraph.addTask(&second);
+        taskGraph.addTask(&other);
+        first.addDependencyTo(&second);
+
+        TaskSystem::TaskSystem::GraphAnalysis analysis = taskGraph.analyze();
+
+        BOOST_TEST(analysis.work == 250ul);
+        BOOST_TEST(analysis.span == 200ul);
+        BOOST_TEST(analysis.parallelism == 1.25);
+        BOOST_TEST(analysis.getIdealSpeedup(1) == 1.0);
+        BOOST_TEST(analysis.getIdealSpeedup(4) == 1.25);
+        BOOST_TEST(analysis.getGreedySpeedup(2) < analysis.getIdealSpeedup(2));
+        BOOST_TEST(analysis.lastNumWorkers == 0u);
+
+        taskGraph.setProfiling(true);
+        taskSystem.executeTaskGraph(&taskGraph);
+
+        analysis = taskGraph.analyze();
+
+        BOOST_TEST(analysis.lastNumWorkers == 2u);
+        BOOST_TEST(analysis.lastBusyTime >= 15000000ul);
+        BOOST_TEST(analysis.lastExecutionTime >= 10000000ul);
+        BOOST_TEST(analysis.lastIdleTime + analysis.lastBusyTime == 2 * analysis.lastExecutionTime);
+        BOOST_TEST(analysis.span >= 10000000ul);
+
+        //The only worker is busy with one of the two tasks, the caller executes the other
+        TaskSystem::TaskSystem::TaskGraph parallelGraph;
+        TaskSystem::TaskSystem oneWorker(1);
+
+        parallelGraph.addTask(&busy);
+        parallelGraph.addTask(&waiting);
+        parallelGraph.setProfiling(true);
+        oneWorker.executeTaskGraph(&parallelGraph);
+
+        analysis = parallelGraph.analyze();
+
+        BOOST_TEST(analysis.lastNumWorkers == 2u);
+        BOOST_TEST(analysis.lastIdleTime + analysis.lastBusyTime == 2 * analysis.lastExecutionTime);
+
+    }catch(std::exception& exe){
+        BOOST_TEST(false);
+    }
+}
+
+
+/**
+ * Test that pinned tasks are always executed by their worker and that, with affinity,
+ * tasks are executed again by the worker of the previous execution
+ */
+BOOST_AUTO_TEST_CASE(test_case_task_affinity){
+    class WorkerTask : public TaskSystem::TaskSystem::Task{
+    public:
+        int worker;
+        WorkerTask() : worker(-2) {}
+    };
+
+    void (*func)(void*) = [](void* arg){
+        ((WorkerTask*) arg)->worker = PThreadPool::getCurrentWorkerIndex();
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    };
+
+    WorkerTask pinnedTasks[8];
+    WorkerTask first, second;
+
+    try {
+        TaskSystem::TaskSystem taskSystem(2);
+        TaskSystem::TaskSystem::TaskGraph pinnedGraph, affinityGraph;
+
+        for (int i = 0; i < 8; ++i) {
+            pinnedTasks[i].setExecute(func);
+            pinnedTasks[i].setPinnedWorker(3);
+            pinnedGraph.addTask(&pinnedTasks[i]);
+        }
+
+        taskSystem.executeTaskGraph(&pinnedGraph);
+
+        for (int i = 0; i < 8; ++i) {
+            BOOST_TEST(pinnedTasks[i].worker == 1);
+        }
+
+        first.setExecute(func);
+        second.setExecute(func);
+        affinityGraph.addTask(&first);
+        affinityGraph.addTask(&second);
+        affinityGraph.setAffinity(true);
+
+        taskSystem.executeTaskGraph(&affinityGraph);
+
+        int firstWorker = first.worker;
+        int secondWorker = second.worker;
+
+        for (int i = 0; i < 3; ++i) {
+            //Let the workers become ready, a busy worker would leave its task to the other one
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            taskSystem.executeTaskGraph(&affinityGraph);
+
+            BOOST_TEST(first.worker == firstWorker);
+            BOOST_TEST(second.worker == secondWorker);
+        }
+
+    }catch(std::exception& exe){
+        BOOST_TEST(false);
     }
+}
+
+
+/**
+ * Test that the first exception thrown by a task is rethrown by executeTaskGraph, that the successors
+ * of the failed task are skipped and that a running task sees the execution as cancelled
+ */
+BOOST_AUTO_TEST_CASE(test_case_task_exception_propagation){
+    class FailingTask : public TaskSystem::TaskSystem::Task{
+    public:
+        bool fail;
+        bool sawCancellation;
+        int executions;
+        FailingTask() : fail(false), sawCancellation(false), executions(0) {}
+    };
+
+    FailingTask thrower, successor, poller;
+
+    try {
+        TaskSystem::TaskSystem taskSystem(2);
+        TaskSystem::TaskSystem::TaskGraph taskGraph;
+
+        thrower.setExecute([](void* arg){
+            FailingTask* task = (FailingTask*) arg;
+            task->executions++;
 
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+
+            if (task->fail)
+                throw std::runtime_error("task failed");
+        });
+
+        successor.setExecute([](void* arg){
+            ((FailingTask*) arg)->executions++;
+        });
+
+        poller.setExecute([](void* arg){
+            FailingTask* task = (FailingTask*) arg;
+            task->executions++;
+
+            for (int i = 0; i < 2000 && task->fail; ++i) {
+                if (TaskSystem::TaskSystem::isExecutionCancelled()) {
+                    task->sawCancellation = true;
+                    break;
+                }
+
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        });
+
+        taskGraph.addTask(&thrower);
+        taskGraph.addTask(&successor);
+        taskGraph.addTask(&poller);
+        thrower.addDependencyTo(&successor);
+
+        thrower.fail = true;
+        poller.fail = true;
+
+        bool thrown = false;
+        try {
+            taskSystem.executeTaskGraph(&taskGraph);
+        } catch (std::runtime_error& error) {
+            thrown = std::string(error.what()) == "task failed";
+        }
+
+        BOOST_TEST(thrown);
+        BOOST_TEST(thrower.executions == 1);
+        BOOST_TEST(successor.executions == 0);
+        BOOST_TEST(poller.executions == 1);
+        BOOST_TEST(poller.sawCancellation);
+
+        //The graph can be executed again after a failure
+        thrower.fail = false;
+        poller.fail = false;
+
+        BOOST_TEST(taskSystem.executeTaskGraph(&taskGraph) == TaskSystem::TaskSystem::COMPLETED);
+        BOOST_TEST(thrower.executions == 2);
+        BOOST_TEST(successor.executions == 1);
+
+    }catch(std::exception& exe){
+        BOOST_TEST(false);
+    }
+}
+
+/**
+ * Test that a cancelled token stops the execution of the tasks not yet started
+ */
+BOOST_AUTO_TEST_CASE(test_case_cancellation_token){
+    class ChainTask : public TaskSystem::TaskSystem::Task{
+    public:
+        TaskSystem::TaskSystem::CancellationToken* token;
+        int* executed;
+        bool cancel;
+        ChainTask() : token(nullptr), executed(nullptr), cancel(false) {}
+    };
+
+    ChainTask tasks[20];
+    int executed = 0;
+
+    try {
+        TaskSystem::TaskSystem taskSystem(2);
+        TaskSystem::TaskSystem::TaskGraph taskGraph;
+        TaskSystem::TaskSystem::CancellationToken token;
+
+        for (int i = 0; i < 20; ++i) {
+            tasks[i].token = &token;
+            tasks[i].executed = &executed;
+            tasks[i].setExecute([](void* arg){
+                ChainTask* task = (ChainTask*) arg;
+                (*task->executed)++;
+
+                if (task->cancel)
+                    task->token->cancel();
+            });
+
+            taskGraph.addTask(&tasks[i]);
+
+            if (i > 0)
+                tasks[i - 1].addDependencyTo(&tasks[i]);
+        }
+
+        tasks[5].cancel = true;
+
+        BOOST_TEST(taskSystem.executeTaskGraph(&taskGraph, &token) == TaskSystem::TaskSystem::CANCELLED);
+        BOOST_TEST(executed == 6);
+
+        //A token cancelled before the execution skips all the tasks
+        executed = 0;
+        BOOST_TEST(taskSystem.executeTaskGraph(&taskGraph, &token) == TaskSystem::TaskSystem::CANCELLED);
+        BOOST_TEST(executed == 0);
+
+        token.reset();
+        tasks[5].cancel = false;
+        BOOST_TEST(taskSystem.executeTaskGraph(&taskGraph, &token) == TaskSystem::TaskSystem::COMPLETED);
+        BOOST_TEST(executed == 20);
+
+    }catch(std::exception& exe){
+        BOOST_TEST(false);
+    }
+}
+
+/**
+ * Test that an execution returns when its deadline passes even if its tasks are still running or waiting
+ * for a worker, that the graph can be executed again once they complete and that the TaskSystem can be
+ * destroyed while they run
+ */
+BOOST_AUTO_TEST_CASE(test_case_deadline_expired){
+    class SlowTask : public TaskSystem::TaskSystem::Task{
+    public:
+        int sleepMilliseconds;
+        std::atomic<int> executions;
+        SlowTask() : sleepMilliseconds(0), executions(0) {}
+    };
+
+    void (*func)(void*) = [](void* arg){
+        SlowTask* task = (SlowTask*) arg;
+
+        //The running tasks stop early when they see the execution as cancelled
+        for (int i = 0; i < task->sleepMilliseconds && !TaskSystem::TaskSystem::isExecutionCancelled(); ++i) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+
+        task->executions++;
+    };
+
+    SlowTask slowTasks[3];
+    SlowTask successor;
+
+    try {
+        TaskSystem::TaskSystem taskSystem(2);
+        TaskSystem::TaskSystem::TaskGraph taskGraph;
+
+        successor.setExecute(func);
+        taskGraph.addTask(&successor);
+
+        for (int i = 0; i < 3; ++i) {
+            slowTasks[i].setExecute(func);
+            slowTasks[i].sleepMilliseconds = 2000;
+            taskGraph.addTask(&slowTasks[i]);
+            slowTasks[i].addDependencyTo(&successor);
+        }
+
+        //Two tasks take both the workers, the third one waits for a worker until the deadline
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        TaskSystem::TaskSystem::ExecutionStatus status =
+                taskSystem.executeTaskGraph(&taskGraph, start + std::chrono::milliseconds(30));
+        std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+
+        BOOST_TEST(status == TaskSystem::TaskSystem::DEADLINE_EXPIRED);
+        BOOST_TEST(std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count() < 1000);
+
+        //The next execution waits for the tasks of the expired one
+        for (int i = 0; i < 3; ++i) {
+            slowTasks[i].sleepMilliseconds = 0;
+        }
+
+        BOOST_TEST(taskSystem.executeTaskGraph(&taskGraph) == TaskSystem::TaskSystem::COMPLETED);
+        BOOST_TEST(successor.executions == 1);
+
+        for (int i = 0; i < 3; ++i) {
+            BOOST_TEST(slowTasks[i].executions >= 1);
+        }
+
+        BOOST_TEST(taskSystem.executeTaskGraph(&taskGraph, std::chrono::steady_clock::now() + std::chrono::seconds(10))
+                   == TaskSystem::TaskSystem::COMPLETED);
+        BOOST_TEST(successor.executions == 2);
+
+    }catch(std::exception& exe){
+        BOOST_TEST(false);
+    }
+
+    TaskSystem::TaskSystem::Task busyTask([](void*){
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    });
+
+    try {
+        //The TaskSystem is destroyed before the graph while the task of the expired execution is still running
+        TaskSystem::TaskSystem::TaskGraph taskGraph;
+        TaskSystem::TaskSystem taskSystem(1);
+
+        taskGraph.addTask(&busyTask);
+
+        BOOST_TEST(taskSystem.executeTaskGraph(&taskGraph, std::chrono::steady_clock::now() + std::chrono::milliseconds(10))
+                   == TaskSystem::TaskSystem::DEADLINE_EXPIRED);
+
+    }catch(std::exception& exe){
+        BOOST_TEST(false);
+    }
+}
+
+/**
+ * Test that the ready tasks that must start first to meet a deadline are executed before the others
+ */
+BOOST_AUTO_TEST_CASE(test_case_task_deadline_priority){
+    class OrderTask : public TaskSystem::TaskSystem::Task{
+    public:
+        std::atomic<int>* counter;
+        int position;
+        OrderTask() : counter(nullptr), position(-1) {}
+    };
+
+    OrderTask a, b, d, e;
+    std::atomic<int> counter(0);
+
+    try {
+        TaskSystem::TaskSystem taskSystem(1);
+        TaskSystem::TaskSystem::TaskGraph taskGraph;
+
+        //The order is observed on a single thread
+        taskSystem.setCallerParticipation(false);
+
+        OrderTask* tasks[4] = {&a, &b, &d, &e};
+        for (int i = 0; i < 4; ++i) {
+            tasks[i]->counter = &counter;
+            tasks[i]->setExecute([](void* arg){
+                OrderTask* task = (OrderTask*) arg;
+                task->position = (*task->counter)++;
+            });
+            taskGraph.addTask(tasks[i]);
+        }
+
+        a.setCostHint(1000000);
+        b.setCostHint(2000000);
+        d.setCostHint(10);
+        e.setCostHint(10);
+        d.addDependencyTo(&e);
+
+        //Without deadlines the tasks with the longest path to the end start first
+        taskSystem.executeTaskGraph(&taskGraph);
+
+        BOOST_TEST(b.position == 0);
+        BOOST_TEST(a.position == 1);
+
+        //The deadline of e moves its predecessor d before the longer tasks
+        e.setDeadline(1000);
+        counter = 0;
+        taskSystem.executeTaskGraph(&taskGraph);
+
+        BOOST_TEST(d.position == 0);
+        BOOST_TEST(b.position < a.position);
+        BOOST_TEST(e.position < a.position);
+
+    }catch(std::exception& exe){
+        BOOST_TEST(false);
+    }
+}
+
+/**
+ * Test that two graphs executed at the same time on a single worker share it
+ * in proportion to the weights of their tenants
+ */
+BOOST_AUTO_TEST_CASE(test_case_tenant_weighted_share){
+    class TenantTask : public TaskSystem::TaskSystem::Task{
+    public:
+        int tenant;
+        std::atomic<int>* position;
+        int* log;
+        TenantTask() : tenant(0), position(nullptr), log(nullptr) {}
+    };
+
+    const int numTasks = 120;
+    std::vector<TenantTask> tasks(2 * numTasks);
+    std::atomic<int> position(0);
+    int log[2 * numTasks];
+
+    try {
+        TaskSystem::TaskSystem taskSystem(1);
+        TaskSystem::TaskSystem::Tenant heavy(3);
+        TaskSystem::TaskSystem::Tenant light(1);
+        TaskSystem::TaskSystem::TaskGraph graphs[2];
+
+        graphs[0].setTenant(&heavy);
+        graphs[1].setTenant(&light);
+
+        for (int i = 0; i < 2 * numTasks; ++i) {
+            tasks[i].tenant = i / numTasks;
+            tasks[i].position = &position;
+            tasks[i].log = log;
+            tasks[i].setExecute([](void* arg){
+                TenantTask* task = (TenantTask*) arg;
+                task->log[(*task->position)++] = task->tenant;
+                std::this_thread::sleep_for(std::chrono::microseconds(200));
+            });
+            graphs[i / numTasks].addTask(&tasks[i]);
+        }
+
+        std::thread lightThread([&](){
+            taskSystem.executeTaskGraph(&graphs[1]);
+        });
+        taskSystem.executeTaskGraph(&graphs[0]);
+        lightThread.join();
+
+        BOOST_TEST(position == 2 * numTasks);
+
+        //Count the tasks of the two tenants while both graphs had tasks to run
+        int firstSeen[2] = {-1, -1};
+        int lastSeen[2] = {-1, -1};
+        for (int i = 0; i < 2 * numTasks; ++i) {
+            if (firstSeen[log[i]] < 0)
+                firstSeen[log[i]] = i;
+            lastSeen[log[i]] = i;
+        }
+
+        int begin = std::max(firstSeen[0], firstSeen[1]);
+        int end = std::min(lastSeen[0], lastSeen[1]);
+        int counts[2] = {0, 0};
+        for (int i = begin; i <= end; ++i) {
+            counts[log[i]]++;
+        }
+
+        BOOST_TEST(counts[0] + counts[1] > numTasks / 2);
+        BOOST_TEST(counts[0] >= 2 * counts[1]);
+        BOOST_TEST(counts[0] <= 4 * counts[1] + 4);
+
+    }catch(std::exception& exe){
+        BOOST_TEST(false);
+    }
+}
+
+/**
+ * Test that the graphs of a tenant never use more workers than its maximum concurrency
+ */
+BOOST_AUTO_TEST_CASE(test_case_tenant_max_concurrency){
+    struct Concurrency{
+        std::atomic<int> running;
+        std::atomic<int> maxRunning;
+    } concurrency;
+
+    class ConcurrencyTask : public TaskSystem::TaskSystem::Task{
+    public:
+        Concurrency* concurrency;
+        ConcurrencyTask() : concurrency(nullptr) {}
+    };
+
+    concurrency.running = 0;
+    concurrency.maxRunning = 0;
+
+    std::vector<ConcurrencyTask> tasks(20);
+
+    try {
+        TaskSystem::TaskSystem taskSystem(2);
+        TaskSystem::TaskSystem::Tenant tenant(1, 1);
+        TaskSystem::TaskSystem::TaskGraph taskGraph;
+
+        taskGraph.setTenant(&tenant);
+
+        for (unsigned int i = 0; i < tasks.size(); ++i) {
+            tasks[i].concurrency = &concurrency;
+            tasks[i].setExecute([](void* arg){
+                Concurrency* context = ((ConcurrencyTask*) arg)->concurrency;
+                int running = ++context->running;
+                int maxRunning = context->maxRunning;
+
+                while (running > maxRunning && !context->maxRunning.compare_exchange_weak(maxRunning, running));
+
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                context->running--;
+            });
+            taskGraph.addTask(&tasks[i]);
+        }
+
+        taskSystem.executeTaskGraph(&taskGraph);
+
+        BOOST_TEST(concurrency.maxRunning == 1);
+        BOOST_TEST(tenant.getMaxConcurrency() == 1);
+
+    }catch(std::exception& exe){
+        BOOST_TEST(false);
+    }
+}
+
+/**
+ * Test that a graph of high priority is executed by a reserved worker
+ * while a normal graph keeps all the shared workers busy
+ */
+BOOST_AUTO_TEST_CASE(test_case_high_priority_reserved_worker){
+    class GateTask : public TaskSystem::TaskSystem::Task{
+    public:
+        std::atomic<bool>* open;
+        bool opened;
+        int worker;
+        GateTask() : open(nullptr), opened(false), worker(-1) {}
+    };
+
+    std::atomic<bool> open(false);
+    GateTask bulk, urgent;
+
+    try {
+        TaskSystem::TaskSystem taskSystem(2, 1);
+        TaskSystem::TaskSystem::TaskGraph bulkGraph;
+        TaskSystem::TaskSystem::TaskGraph urgentGraph;
+
+        //The bulk task holds the only shared worker until the urgent task opens the gate
+        bulk.open = &open;
+        bulk.setExecute([](void* arg){
+            GateTask* task = (GateTask*) arg;
+
+            for (int i = 0; i < 2000 && !*task->open; ++i) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+
+            task->opened = *task->open;
+        });
+        bulkGraph.addTask(&bulk);
+
+        urgent.open = &open;
+        urgent.setExecute([](void* arg){
+            GateTask* task = (GateTask*) arg;
+            task->worker = PThreadPool::getCurrentWorkerIndex();
+            *task->open = true;
+        });
+        urgentGraph.addTask(&urgent);
+        urgentGraph.setPriority(PThreadPool::HIGH);
+
+        std::thread bulkThread([&](){
+            taskSystem.executeTaskGraph(&bulkGraph);
+        });
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        taskSystem.executeTaskGraph(&urgentGraph);
+        bulkThread.join();
+
+        BOOST_TEST(bulk.opened);
+        BOOST_TEST(urgent.worker == 1);
+
+    }catch(std::exception& exe){
+        BOOST_TEST(false);
+    }
+}
+
+/**
+ * Test that the pinned tasks of a graph of high priority are executed by their worker and not by the reserved one
+ */
+BOOST_AUTO_TEST_CASE(test_case_high_priority_pinned){
+    class WorkerTask : public TaskSystem::TaskSystem::Task{
+    public:
+        int worker;
+        WorkerTask() : worker(-1) {}
+    };
+
+    WorkerTask pinned, other;
+
+    try {
+        TaskSystem::TaskSystem taskSystem(3, 1);
+        TaskSystem::TaskSystem::TaskGraph taskGraph;
+
+        void (*func)(void*) = [](void* arg){
+            ((WorkerTask*) arg)->worker = PThreadPool::getCurrentWorkerIndex();
+        };
+
+        pinned.setExecute(func);
+        pinned.setPinnedWorker(1);
+        other.setExecute(func);
+        taskGraph.addTask(&pinned);
+        taskGraph.addTask(&other);
+        taskGraph.setPriority(PThreadPool::HIGH);
+
+        for (int i = 0; i < 5; ++i) {
+            taskSystem.executeTaskGraph(&taskGraph);
+
+            BOOST_TEST(pinned.worker == 1);
+        }
+
+    }catch(std::exception& exe){
+        BOOST_TEST(false);
+    }
+}
+
+/**
+ * Test that a worker that completes its function goes first to the high lane,
+ * and to the normal lane after at most HIGH_BURST consecutive high functions
+ */
+BOOST_AUTO_TEST_CASE(test_case_priority_lanes_no_starvation){
+    struct LaneLog{
+        std::atomic<bool> open;
+        std::atomic<int> position;
+        char log[64];
+    } lanes;
+
+    lanes.open = false;
+    lanes.position = 0;
+
+    PThreadPool pool(1);
+
+    pool.executeFunction([](void* args){
+        LaneLog* context = (LaneLog*) args;
+
+        while (!context->open) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }, &lanes);
+
+    std::thread highThread([&](){
+        for (int i = 0; i < 20; ++i) {
+            pool.executeFunction([](void* args){
+                LaneLog* context = (LaneLog*) args;
+                context->log[context->position] = 'H';
+                context->position++;
+                std::this_thread::sleep_for(std::chrono::milliseconds(2));
+            }, &lanes, nullptr, nullptr, PThreadPool::HIGH);
+        }
+    });
+
+    std::thread normalThread([&](){
+        for (int i = 0; i < 4; ++i) {
+            pool.executeFunction([](void* args){
+                LaneLog* context = (LaneLog*) args;
+                context->log[context->position] = 'N';
+                context->position++;
+                std::this_thread::sleep_for(std::chrono::milliseconds(2));
+            }, &lanes, nullptr, nullptr, PThreadPool::NORMAL);
+        }
+    });
+
+    //Both lanes wait for the busy worker
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    lanes.open = true;
+
+    highThread.join();
+    normalThread.join();
+
+    while (lanes.position < 24) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    std::string log(lanes.log, 24);
+
+    BOOST_TEST(log[0] == 'H');
+    BOOST_TEST(log.find('N') <= PThreadPool::HIGH_BURST);
+    BOOST_TEST(log.find(std::string(PThreadPool::HIGH_BURST + 1, 'H')) > log.rfind('N'));
+}
+
+/**
+ * Test that the thread that executes a graph runs ready tasks while the workers are busy,
+ * and only dispatches them when the participation is disabled
+ */
+BOOST_AUTO_TEST_CASE(test_case_caller_participation){
+    class ThreadTask : public TaskSystem::TaskSystem::Task{
+    public:
+        int worker;
+        ThreadTask() : worker(-2) {}
+    };
+
+    std::vector<ThreadTask> tasks(16);
+
+    try {
+        TaskSystem::TaskSystem taskSystem(1);
+        TaskSystem::TaskSystem::TaskGraph taskGraph;
+
+        for (unsigned int i = 0; i < tasks.size(); ++i) {
+            tasks[i].setExecute([](void* arg){
+                ((ThreadTask*) arg)->worker = PThreadPool::getCurrentWorkerIndex();
+                std::this_thread::sleep_for(std::chrono::milliseconds(2));
+            });
+            taskGraph.addTask(&tasks[i]);
+        }
+
+        taskSystem.executeTaskGraph(&taskGraph);
+
+        int byCaller = 0;
+        for (unsigned int i = 0; i < tasks.size(); ++i) {
+            BOOST_TEST(tasks[i].worker >= -1);
+            byCaller += tasks[i].worker == -1;
+        }
+
+        BOOST_TEST(byCaller > 0);
+        BOOST_TEST(byCaller < (int) tasks.size());
+
+        taskSystem.setCallerParticipation(false);
+        taskSystem.executeTaskGraph(&taskGraph);
+
+        for (unsigned int i = 0; i < tasks.size(); ++i) {
+            BOOST_TEST(tasks[i].worker == 0);
+        }
+
+    }catch(std::exception& exe){
+        BOOST_TEST(false);
+    }
+}
+
+/**
+ * Test that a task of the only worker can execute a graph and wait for it,
+ * its tasks are run by the waiting worker itself
+ */
+BOOST_AUTO_TEST_CASE(test_case_caller_participation_nested){
+    class NestedTask : public TaskSystem::TaskSystem::Task{
+    public:
+        TaskSystem::TaskSystem* taskSystem;
+        TaskSystem::TaskSystem::TaskGraph* innerGraph;
+        int worker;
+        NestedTask() : taskSystem(nullptr), innerGraph(nullptr), worker(-2) {}
+    };
+
+    class CountTask : public TaskSystem::TaskSystem::Task{
+    public:
+        std::atomic<int>* counter;
+        CountTask() : counter(nullptr) {}
+    };
+
+    NestedTask outer;
+    CountTask inner[3];
+    std::atomic<int> counter(0);
+
+    try {
+        TaskSystem::TaskSystem taskSystem(1);
+        TaskSystem::TaskSystem::TaskGraph outerGraph;
+        TaskSystem::TaskSystem::TaskGraph innerGraph;
+
+        for (int i = 0; i < 3; ++i) {
+            inner[i].counter = &counter;
+            inner[i].setExecute([](void* arg){
+                (*((CountTask*) arg)->counter)++;
+            });
+            innerGraph.addTask(&inner[i]);
+        }
+        inner[0].addDependencyTo(&inner[1]);
+
+        outer.taskSystem = &taskSystem;
+        outer.innerGraph = &innerGraph;
+        outer.setExecute([](void* arg){
+            NestedTask* task = (NestedTask*) arg;
+            task->worker = PThreadPool::getCurrentWorkerIndex();
+            task->taskSystem->executeTaskGraph(task->innerGraph);
+        });
+        outerGraph.addTask(&outer);
+
+        //With the affinity the outer task prefers a worker, so it is not run by the caller
+        outerGraph.setAffinity(true);
+        taskSystem.executeTaskGraph(&outerGraph);
+
+        BOOST_TEST(counter == 3);
+        BOOST_TEST(outer.worker == 0);
+
+    }catch(std::exception& exe){
+        BOOST_TEST(false);
+    }
+}
+
+/**
+ * Test that functions submitted at the same time by more threads, in both lanes and pinned to workers,
+ * are all executed exactly once
+ */
+BOOST_AUTO_TEST_CASE(test_case_pool_concurrent_submitters){
+    const int numSubmissions = 2000;
+    std::atomic<int> executed(0);
+
+    PThreadPool pool(3, 1);
+    std::vector<std::thread> submitters;
+
+    for (int s = 0; s < 4; ++s) {
+        submitters.push_back(std::thread([&pool, &executed, s](){
+            void (*increment)(void*) = [](void* args){
+                (*(std::atomic<int>*) args)++;
+            };
+
+            for (int i = 0; i < numSubmissions; ++i) {
+                switch ((s + i) % 4) {
+                    case 0:
+                        pool.executeFunction(increment, &executed);
+                        break;
+                    case 1:
+                        if (!pool.tryExecuteFunction(increment, &executed, nullptr, nullptr))
+                            pool.executeFunction(increment, &executed);
+                        break;
+                    case 2:
+                        pool.executeFunctionOn((unsigned int) i, true, increment, &executed, nullptr, nullptr);
+                        break;
+                    default:
+                        pool.executeFunction(increment, &executed, nullptr, nullptr, PThreadPool::HIGH);
+                }
+            }
+        }));
+    }
+
+    for (unsigned int s = 0; s < submitters.size(); ++s) {
+        submitters[s].join();
+    }
+
+    for (int i = 0; i < 5000 && executed < 4 * numSubmissions; ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    BOOST_TEST(executed == 4 * numSubmissions);
+}
+
+/**
+ * Test that a graph whose plan is allocated from huge pages executes all its tasks in order,
+ * also after switching back to regular pages
+ */
+BOOST_AUTO_TEST_CASE(test_case_huge_pages_plan){
+    class ChainTask : public TaskSystem::TaskSystem::Task{
+    public:
+        ChainTask* predecessor;
+        int executions;
+        bool ordered;
+        ChainTask() : predecessor(nullptr), executions(0), ordered(true) {}
+    };
+
+    std::vector<ChainTask> tasks(5000);
+
+    try {
+        TaskSystem::TaskSystem taskSystem(2);
+        TaskSystem::TaskSystem::TaskGraph taskGraph;
+
+        for (unsigned int i = 0; i < tasks.size(); ++i) {
+            tasks[i].setExecute([](void* arg){
+                ChainTask* task = (ChainTask*) arg;
+                task->executions++;
+
+                if (task->predecessor != nullptr && task->predecessor->executions != task->executions)
+                    task->ordered = false;
+            });
+            taskGraph.addTask(&tasks[i]);
+
+            //Every task depends on the task 64 positions before
+            if (i >= 64) {
+                tasks[i].predecessor = &tasks[i - 64];
+                tasks[i - 64].addDependencyTo(&tasks[i]);
+            }
+        }
+
+        taskGraph.setHugePages(true);
+        BOOST_TEST(taskGraph.isHugePages());
+
+        taskSystem.executeTaskGraph(&taskGraph);
+        taskSystem.executeTaskGraph(&taskGraph);
+
+        taskGraph.setHugePages(false);
+        taskSystem.executeTaskGraph(&taskGraph);
+
+        for (unsigned int i = 0; i < tasks.size(); ++i) {
+            BOOST_TEST(tasks[i].executions == 3);
+            BOOST_TEST(tasks[i].ordered);
+        }
+
+    }catch(std::exception& exe){
+        BOOST_TEST(false);
+    }
+}
+
+/**
+ * Context of the static fork/join graphs: every stage records its position in the order of execution
+ */
+struct StaticForkJoin {
+    std::atomic<int> next;
+    int order[5];
+    long values[5];
+};
+
+void staticSource(StaticForkJoin* context){
+    context->order[0] = context->next++;
+    context->values[0] = 1;
+}
+
+void staticFirstBranch(StaticForkJoin* context){
+    context->order[1] = context->next++;
+    context->values[1] = context->values[0] + 10;
+}
+
+void staticSecondBranch(StaticForkJoin* context){
+    context->order[2] = context->next++;
+    context->values[2] = context->values[0] + 100;
+}
+
+void staticThirdBranch(StaticForkJoin* context){
+    context->order[3] = context->next++;
+    context->values[3] = context->values[0] + 1000;
+}
+
+void staticJoin(StaticForkJoin* context){
+    context->order[4] = context->next++;
+    context->values[4] = context->values[1] + context->values[2] + context->values[3];
+}
+
+void staticThrowingBranch(StaticForkJoin* context){
+    context->order[2] = context->next++;
+    throw std::runtime_error("stage failed");
+}
+
+/**
+ * Test that a static fork/join graph executes every stage once, after all the stages it depends on
+ */
+BOOST_AUTO_TEST_CASE(test_case_static_graph_fork_join){
+    typedef TaskSystem::StaticGraph<StaticForkJoin,
+            TaskSystem::StaticTask<staticSource>,
+            TaskSystem::StaticTask<staticFirstBranch, 0>,
+            TaskSystem::StaticTask<staticSecondBranch, 0>,
+            TaskSystem::StaticTask<staticThirdBranch, 0>,
+            TaskSystem::StaticTask<staticJoin, 1, 2, 3>> ForkJoin;
+
+    static_assert(ForkJoin::NUM_TASKS == 5, "");
+    static_assert(ForkJoin::getNumSuccessors(0) == 3, "");
+    static_assert(ForkJoin::getNumDependencies(4) == 3, "");
+
+    try {
+        TaskSystem::TaskSystem taskSystem(3);
+
+        for (int i = 0; i < 200; ++i) {
+            StaticForkJoin context;
+            context.next = 0;
+
+            ForkJoin::execute(&taskSystem, &context);
+
+            BOOST_TEST(context.next == 5);
+            BOOST_TEST(context.order[0] == 0);
+            BOOST_TEST(context.order[4] == 4);
+            BOOST_TEST(context.values[4] == 1113);
+        }
+
+    }catch(std::exception& exe){
+        BOOST_TEST(false);
+    }
+}
+
+/**
+ * Test that the exception of a stage of a static graph is rethrown by execute and that the stages
+ * after it are not executed
+ */
+BOOST_AUTO_TEST_CASE(test_case_static_graph_exception){
+    typedef TaskSystem::StaticGraph<StaticForkJoin,
+            TaskSystem::StaticTask<staticSource>,
+            TaskSystem::StaticTask<staticFirstBranch, 0>,
+            TaskSystem::StaticTask<staticThrowingBranch, 0>,
+            TaskSystem::StaticTask<staticThirdBranch, 0>,
+            TaskSystem::StaticTask<staticJoin, 1, 2, 3>> ForkJoin;
+
+    TaskSystem::TaskSystem taskSystem(2);
+
+    StaticForkJoin context;
+    context.next = 0;
+    context.order[4] = -1;
+
+    BOOST_CHECK_THROW(ForkJoin::execute(&taskSystem, &context), std::runtime_error);
+    BOOST_TEST(context.order[4] == -1);
+
+    //The graph can be executed again after a failure
+    BOOST_CHECK_THROW(ForkJoin::execute(&taskSystem, &context), std::runtime_error);
+}
+
+/**
+ * Test that a task waiting for an fd does not take a worker: with a single worker the independent task runs
+ * while the input is not yet available, then the tasks after the fd read the data; an other task can wait
+ * for the same fd in the same execution
+ */
+BOOST_AUTO_TEST_CASE(test_case_event_task_fd){
+    class ReadTask : public TaskSystem::TaskSystem::EventTask{
+    public:
+        char buffer[16];
+        long size;
+        explicit ReadTask(int fd) : EventTask(fd), size(0) {}
+    };
+
+    class FlagTask : public TaskSystem::TaskSystem::Task{
+    public:
+        std::atomic<bool> done;
+        FlagTask() : done(false) {}
+    };
+
+    class SumTask : public TaskSystem::TaskSystem::Task{
+    public:
+        ReadTask* input;
+        int sum;
+        SumTask() : input(nullptr), sum(0) {}
+    };
+
+    int fds[2];
+    BOOST_REQUIRE(pipe(fds) == 0);
+
+    try {
+        TaskSystem::TaskSystem taskSystem(1);
+        taskSystem.setCallerParticipation(false);
+        TaskSystem::TaskSystem::TaskGraph taskGraph;
+
+        ReadTask readTask(fds[0]);
+        TaskSystem::TaskSystem::EventTask sameFd(fds[0]);
+        FlagTask independent;
+        SumTask sumTask;
+
+        readTask.setExecute([](void* arg){
+            ReadTask* task = (ReadTask*) arg;
+            task->size = read(task->getFd(), task->buffer, sizeof(task->buffer));
+        });
+        independent.setExecute([](void* arg){
+            ((FlagTask*) arg)->done = true;
+        });
+        sumTask.input = &readTask;
+        sumTask.setExecute([](void* arg){
+            SumTask* task = (SumTask*) arg;
+
+            for (long i = 0; i < task->input->size; ++i) {
+                task->sum += task->input->buffer[i];
+            }
+        });
+
+        sameFd.setExecute([](void*){});
+
+        taskGraph.addTask(&readTask);
+        taskGraph.addTask(&sameFd);
+        taskGraph.addTask(&independent);
+        taskGraph.addTask(&sumTask);
+        readTask.addDependencyTo(&sumTask);
+
+        //The input arrives only after the independent task has been executed by the worker
+        std::thread producer([&independent, &fds](){
+            for (int i = 0; i < 5000 && !independent.done; ++i) {
+                usleep(1000);
+            }
+
+            char data[3] = {1, 2, 3};
+            BOOST_TEST(write(fds[1], data, sizeof(data)) == 3);
+        });
+
+        taskSystem.executeTaskGraph(&taskGraph);
+        producer.join();
+
+        BOOST_TEST(independent.done);
+        BOOST_TEST(readTask.size == 3);
+        BOOST_TEST(sumTask.sum == 6);
+        BOOST_TEST(sameFd.getFd() == fds[0]);
+
+    }catch(std::exception& exe){
+        BOOST_TEST(false);
+    }
+
+    close(fds[0]);
+    close(fds[1]);
+}
+
+/**
+ * Test that the tasks after a timer and a user event wait for both, also when the graph is executed again
+ */
+BOOST_AUTO_TEST_CASE(test_case_event_task_timer_user){
+    class JoinTask : public TaskSystem::TaskSystem::Task{
+    public:
+        std::chrono::steady_clock::time_point end;
+        int executions;
+        JoinTask() : executions(0) {}
+    };
+
+    try {
+        TaskSystem::TaskSystem taskSystem(2);
+        TaskSystem::TaskSystem::TaskGraph taskGraph;
+
+        TaskSystem::TaskSystem::EventTask timer(std::chrono::milliseconds(20));
+        TaskSystem::TaskSystem::EventTask userEvent;
+        JoinTask join;
+
+        join.setExecute([](void* arg){
+            JoinTask* task = (JoinTask*) arg;
+            task->end = std::chrono::steady_clock::now();
+            task->executions++;
+        });
+
+        taskGraph.addTask(&timer);
+        taskGraph.addTask(&userEvent);
+        taskGraph.addTask(&join);
+        timer.addDependencyTo(&join);
+        userEvent.addDependencyTo(&join);
+
+        BOOST_TEST(timer.getType() == TaskSystem::TaskSystem::EventTask::TIMER);
+        BOOST_TEST(userEvent.getType() == TaskSystem::TaskSystem::EventTask::USER_EVENT);
+
+        for (int i = 0; i < 3; ++i) {
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+            //The signal of the first execution comes before the event task is armed
+            if (i == 0)
+                userEvent.signal();
+
+            std::thread signaller([&userEvent, i](){
+                if (i == 0)
+                    return;
+
+                usleep(5000);
+                userEvent.signal();
+            });
+
+            taskSystem.executeTaskGraph(&taskGraph);
+            signaller.join();
+
+            BOOST_TEST(join.executions == i + 1);
+            BOOST_TEST((join.end - start >= std::chrono::milliseconds(20)));
+        }
+
+    }catch(std::exception& exe){
+        BOOST_TEST(false);
+    }
+}
+
+/**
+ * Test that an execution waiting for an event that never happens is stopped by its token
+ */
+BOOST_AUTO_TEST_CASE(test_case_event_task_cancelled){
+    class CountTask : public TaskSystem::TaskSystem::Task{
+    public:
+        int executions;
+        CountTask() : executions(0) {}
+    };
+
+    try {
+        TaskSystem::TaskSystem taskSystem(2);
+        TaskSystem::TaskSystem::TaskGraph taskGraph;
+        TaskSystem::TaskSystem::CancellationToken token;
+
+        TaskSystem::TaskSystem::EventTask never;
+        CountTask after;
+
+        after.setExecute([](void* arg){
+            ((CountTask*) arg)->executions++;
+        });
+
+        taskGraph.addTask(&never);
+        taskGraph.addTask(&after);
+        never.addDependencyTo(&after);
+
+        std::thread canceller([&token](){
+            usleep(20000);
+            token.cancel();
+        });
+
+        BOOST_TEST(taskSystem.executeTaskGraph(&taskGraph, &token) == TaskSystem::TaskSystem::CANCELLED);
+        canceller.join();
+
+        BOOST_TEST(after.executions == 0);
+
+        //The event task is armed again by the next execution
+        token.reset();
+        never.signal();
+
+        BOOST_TEST(taskSystem.executeTaskGraph(&taskGraph, &token) == TaskSystem::TaskSystem::COMPLETED);
+        BOOST_TEST(after.executions == 1);
+
+    }catch(std::exception& exe){
+        BOOST_TEST(false);
+    }
+}
+
+/**
+ * Test that the per-thread partial sums of a parallelFor combine to the total and that the scratch buffers
+ * are created once per thread and reused by the following loops
+ */
+BOOST_AUTO_TEST_CASE(test_case_worker_local_reduction){
+    struct ReduceData {
+        TaskSystem::WorkerLocal<long>* sums;
+        TaskSystem::WorkerLocal<std::vector<long>>* scratch;
+    };
+
+    try {
+        TaskSystem::TaskSystem taskSystem(3);
+        TaskSystem::WorkerLocal<long> sums(&taskSystem, 0);
+        TaskSystem::WorkerLocal<std::vector<long>> scratch(&taskSystem);
+        ReduceData data = {&sums, &scratch};
+
+        for (int run = 0; run < 3; ++run) {
+            taskSystem.parallelFor(TaskSystem::TaskSystem::BlockedRange(0, 100000, 1000),
+                                   [](TaskSystem::TaskSystem::BlockedRange* range, void* args){
+                ReduceData* context = (ReduceData*) args;
+                std::vector<long>& buffer = context->scratch->local();
+
+                buffer.clear();
+                for (long i = range->getBegin(); i < range->getEnd(); ++i) {
+                    buffer.push_back(i);
+                }
+
+                for (std::vector<long>::iterator it = buffer.begin(); it != buffer.end(); it++) {
+                    context->sums->local() += *it;
+                }
+            }, &data);
+
+            BOOST_TEST(sums.combine([](const long& a, const long& b){ return a + b; }) == 4999950000l * (run + 1));
+        }
+
+        //The workers and the caller are the only threads of the loops
+        BOOST_TEST(scratch.size() >= 1);
+        BOOST_TEST(scratch.size() <= taskSystem.getNumWorkerThreads() + 1);
+
+        unsigned long capacity = 0;
+        scratch.forEach([&capacity](std::vector<long>& buffer){
+            capacity = std::max(capacity, (unsigned long) buffer.capacity());
+        });
+        BOOST_TEST(capacity >= 1000);
+
+        sums.clear();
+        BOOST_TEST(sums.size() == 0);
+        BOOST_TEST(sums.combine([](const long& a, const long& b){ return a + b; }) == 0);
+
+    }catch(std::exception& exe){
+        BOOST_TEST(false);
+    }
+}
+
+/**
+ * Test that the tasks of a graph executed by an other TaskSystem get their own values, not the ones of the workers
+ */
+BOOST_AUTO_TEST_CASE(test_case_worker_local_other_pool){
+    class CountTask : public TaskSystem::TaskSystem::Task{
+    public:
+        TaskSystem::WorkerLocal<int>* counts;
+    };
+
+    try {
+        TaskSystem::TaskSystem taskSystem(2);
+        TaskSystem::TaskSystem otherSystem(2);
+        TaskSystem::WorkerLocal<int> counts(&taskSystem, 0);
+
+        std::vector<CountTask> tasks(200);
+        TaskSystem::TaskSystem::TaskGraph taskGraph;
+
+        for (unsigned int i = 0; i < tasks.size(); ++i) {
+            tasks[i].counts = &counts;
+            tasks[i].setExecute([](void* arg){
+                ((CountTask*) arg)->counts->local()++;
+            });
+            taskGraph.addTask(&tasks[i]);
+        }
+
+        taskSystem.executeTaskGraph(&taskGraph);
+        otherSystem.executeTaskGraph(&taskGraph);
+
+        BOOST_TEST(counts.combine([](const int& a, const int& b){ return a + b; }) == 400);
+        BOOST_TEST(counts.size() <= 6);
+
+    }catch(std::exception& exe){
+        BOOST_TEST(false);
+    }
+}
+
+/**
+ * Test that a recorded execution logs every task once on a worker of the pool or on the caller,
+ * also when the caller is a worker, and that a schedule is saved and loaded unchanged
+ */
+BOOST_AUTO_TEST_CASE(test_case_schedule_record){
+    try {
+        TaskSystem::TaskSystem taskSystem(3);
+        TaskSystem::TaskSystem::TaskGraph taskGraph;
+        std::vector<TaskSystem::TaskSystem::Task> tasks(40);
+
+        //Ten sources, each followed by three tasks
+        for (unsigned int i = 0; i < tasks.size(); ++i) {
+            taskGraph.addTask(&tasks[i]);
+
+            if (i >= 10)
+                tasks[(i - 10) / 3].addDependencyTo(&tasks[i]);
+        }
+
+        BOOST_TEST(taskGraph.getLastSchedule().size() == 0);
+
+        taskGraph.setRecording(true);
+        BOOST_TEST(taskGraph.isRecording());
+
+        taskSystem.executeTaskGraph(&taskGraph);
+
+        TaskSystem::TaskSystem::Schedule schedule = taskGraph.getLastSchedule();
+        BOOST_TEST(schedule.size() == 40);
+
+        std::vector<bool> started(taskGraph.getNumPlanNodes(), false);
+
+        for (unsigned long i = 0; i < schedule.size(); ++i) {
+            BOOST_TEST(schedule.getWorker(i) >= -1);
+            BOOST_TEST(schedule.getWorker(i) < 3);
+            BOOST_TEST(!started[schedule.getNode(i)]);
+
+            started[schedule.getNode(i)] = true;
+        }
+
+        std::stringstream stream;
+        schedule.save(stream);
+
+        TaskSystem::TaskSystem::Schedule loaded;
+        BOOST_TEST(loaded.load(stream));
+        BOOST_TEST((loaded == schedule));
+
+        std::stringstream invalid("not a schedule");
+        BOOST_TEST(!loaded.load(invalid));
+
+        std::stringstream tooManyEntries("3 4000000000\n0 0\n");
+        BOOST_TEST(!loaded.load(tooManyEntries));
+
+        std::stringstream invalidNode("3 1\n7 0\n");
+        BOOST_TEST(!loaded.load(invalidNode));
+        BOOST_TEST((loaded == schedule));
+
+    }catch(std::exception& exe){
+        BOOST_TEST(false);
+    }
+
+    class NestedTask : public TaskSystem::TaskSystem::Task{
+    public:
+        TaskSystem::TaskSystem* taskSystem;
+        TaskSystem::TaskSystem::TaskGraph* innerGraph;
+    };
+
+    try {
+        //The only worker executes the outer task, so the inner tasks are all run by the task itself
+        TaskSystem::TaskSystem taskSystem(1);
+        TaskSystem::TaskSystem::TaskGraph outerGraph, innerGraph;
+        TaskSystem::TaskSystem::Task first, second;
+        NestedTask nested;
+
+        innerGraph.addTask(&first);
+        innerGraph.addTask(&second);
+        innerGraph.setRecording(true);
+
+        nested.taskSystem = &taskSystem;
+        nested.innerGraph = &innerGraph;
+        nested.setExecute([](void* arg){
+            NestedTask* task = (NestedTask*) arg;
+            task->taskSystem->executeTaskGraph(task->innerGraph);
+        });
+        outerGraph.addTask(&nested);
+
+        taskSystem.executeTaskGraph(&outerGraph);
+
+        TaskSystem::TaskSystem::Schedule inner = innerGraph.getLastSchedule();
+        BOOST_TEST(inner.size() == 2);
+
+        for (unsigned long i = 0; i < inner.size(); ++i) {
+            BOOST_TEST(inner.getWorker(i) == -1);
+        }
+
+        //The replay runs them on the task again instead of waiting for its own worker
+        innerGraph.setReplay(&inner);
+        taskSystem.executeTaskGraph(&outerGraph);
+        BOOST_TEST((innerGraph.getLastSchedule() == inner));
+
+    }catch(std::exception& exe){
+        BOOST_TEST(false);
+    }
+}
+
+/**
+ * Test that the replays of a recorded schedule start the tasks in the same order on the same workers
+ * and that a schedule of an other plan is refused
+ */
+BOOST_AUTO_TEST_CASE(test_case_schedule_replay){
+    class OrderTask : public TaskSystem::TaskSystem::Task{
+    public:
+        std::atomic<int>* next;
+        int position;
+        int worker;
+    };
+
+    try {
+        TaskSystem::TaskSystem taskSystem(3);
+        TaskSystem::TaskSystem::TaskGraph taskGraph;
+        std::vector<OrderTask> tasks(60);
+        std::atomic<int> next(0);
+
+        for (unsigned int i = 0; i < tasks.size(); ++i) {
+            tasks[i].next = &next;
+            tasks[i].setExecute([](void* arg){
+                OrderTask* task = (OrderTask*) arg;
+                task->worker = PThreadPool::getCurrentWorkerIndex();
+
+                for (volatile int j = 0; j < 2000; ++j) {}
+
+                task->position = (*task->next)++;
+            });
+            taskGraph.addTask(&tasks[i]);
+
+            if (i >= 6)
+                tasks[i % 6].addDependencyTo(&tasks[i]);
+        }
+
+        taskGraph.setRecording(true);
+        taskSystem.executeTaskGraph(&taskGraph);
+
+        TaskSystem::TaskSystem::Schedule recorded = taskGraph.getLastSchedule();
+        taskGraph.setReplay(&recorded);
+        BOOST_TEST(taskGraph.getReplay() == &recorded);
+
+        std::vector<int> firstWorkers;
+
+        for (int run = 0; run < 3; ++run) {
+            next = 0;
+            taskSystem.executeTaskGraph(&taskGraph);
+
+            BOOST_TEST((taskGraph.getLastSchedule() == recorded));
+
+            std::vector<int> workers;
+            for (unsigned int i = 0; i < tasks.size(); ++i) {
+                workers.push_back(tasks[i].worker);
+            }
+
+            if (run == 0)
+                firstWorkers = workers;
+            else
+                BOOST_TEST((workers == firstWorkers));
+        }
+
+        //A schedule of a different plan is refused before the execution
+        TaskSystem::TaskSystem::Schedule empty;
+        taskGraph.setReplay(&empty);
+        BOOST_CHECK_THROW(taskSystem.executeTaskGraph(&taskGraph), TaskSystem::TaskSystem::ScheduleMismatchException);
+
+        taskGraph.setReplay(nullptr);
+        taskSystem.executeTaskGraph(&taskGraph);
+        BOOST_TEST(taskGraph.getLastSchedule().size() == 60);
+
+    }catch(std::exception& exe){
+        BOOST_TEST(false);
+    }
+}
+
+/****************************************************************
+ *  PIPELINE TESTS
+ ****************************************************************/
+
+/**
+ * Test that every item produced by the input flows through all the stages
+ * and that a serial in order stage sees the items in input order
+ */
+BOOST_AUTO_TEST_CASE(test_case_pipeline_serial_in_order){
+    struct PipelineData{
+        long produced;
+        long numItems;
+        long items[200];
+        long lastSeen;
+        bool ordered;
+        long consumed;
+    } data;
+
+    data.produced = 0;
+    data.numItems = 200;
+    data.lastSeen = -1;
+    data.ordered = true;
+    data.consumed = 0;
+
+    TaskSystem::TaskSystem taskSystem(4);
+    TaskSystem::TaskSystem::Pipeline pipeline;
+
+    pipeline.setInput([](void* args) -> void*{
+        PipelineData* context = (PipelineData*) args;
+
+        if(context->produced == context->numItems)
+            return nullptr;
+
+        context->items[context->produced] = context->produced;
+        return &context->items[context->produced++];
+    }, &data);
+
+    pipeline.addStage(TaskSystem::TaskSystem::Pipeline::PARALLEL, [](void* item, void*) -> void*{
+        std::this_thread::sleep_for(std::chrono::microseconds(*((long*) item) % 7 * 100));
+        return item;
+    }, nullptr);
+
+    pipeline.addStage(TaskSystem::TaskSystem::Pipeline::SERIAL_IN_ORDER, [](void* item, void* args) -> void*{
+        PipelineData* context = (PipelineData*) args;
+        long value = *((long*) item);
+
+        if(value != context->lastSeen + 1)
+            context->ordered = false;
+
+        context->lastSeen = value;
+        context->consumed++;
+        return item;
+    }, &data);
+
+    try {
+        taskSystem.executePipeline(&pipeline, 8);
+    }catch(std::exception& exe){
+        BOOST_TEST(false);
+    }
+
+    BOOST_TEST(data.ordered);
+    BOOST_TEST(data.consumed == 200);
+}
+
+/**
+ * Test that the number of items in flight never exceeds the number of tokens
+ */
+BOOST_AUTO_TEST_CASE(test_case_pipeline_bounded_tokens){
+    struct PipelineData{
+        long produced;
+        std::atomic<int> inFlight;
+        std::atomic<int> maxInFlight;
+    } data;
+
+    data.produced = 0;
+    data.inFlight = 0;
+    data.maxInFlight = 0;
+
+    TaskSystem::TaskSystem taskSystem(4);
+    TaskSystem::TaskSystem::Pipeline pipeline;
+
+    pipeline.setInput([](void* args) -> void*{
+        PipelineData* context = (PipelineData*) args;
+
+        if(context->produced == 100)
+            return nullptr;
+
+        context->produced++;
+
+        int current = ++context->inFlight;
+        int max = context->maxInFlight;
+        while(current > max && !context->maxInFlight.compare_exchange_weak(max, current));
+
+        return context;
+    }, &data);
+
+    pipeline.addStage(TaskSystem::TaskSystem::Pipeline::PARALLEL, [](void* item, void*) -> void*{
+        std::this_thread::sleep_for(std::chrono::microseconds(200));
+        return item;
+    }, nullptr);
+
+    pipeline.addStage(TaskSystem::TaskSystem::Pipeline::SERIAL_OUT_OF_ORDER, [](void* item, void*) -> void*{
+        PipelineData* context = (PipelineData*) item;
+        context->inFlight--;
+        return item;
+    }, nullptr);
+
+    try {
+        taskSystem.executePipeline(&pipeline, 3);
+    }catch(std::exception& exe){
+        BOOST_TEST(false);
+    }
+
+    BOOST_TEST(data.produced == 100);
+    BOOST_TEST(data.maxInFlight <= 3);
+}
+
+
+/****************************************************************
+ *  DATA PARALLEL TESTS
+ ****************************************************************/
+
+/**
+ * Test that parallelMap applies the kernel once to every element and that
+ * the bounds between the chunks fall on the cache lines of the array,
+ * also when a parallelMap is called from a chunk while all the workers are busy
+ */
+BOOST_AUTO_TEST_CASE(test_case_parallel_map_aligned_chunks){
+    struct MapData {
+        TaskSystem::TaskSystem* taskSystem;
+        std::atomic<int> outerStarted;
+        float* values;
+        pthread_mutex_t mutex;
+        std::vector<long> begins;
+        std::vector<long> ends;
+    };
+
+    alignas(64) static float values[1000 + 3];
+
+    MapData data;
+    data.values = values + 3;
+    data.mutex = PTHREAD_MUTEX_INITIALIZER;
+
+    for (int i = 0; i < 1003; ++i) {
+        values[i] = 0;
+    }
+
+    try {
+        TaskSystem::TaskSystem taskSystem(2);
+
+        taskSystem.parallelMap(data.values, sizeof(float), 1000, [](long begin, long end, void* args){
+            MapData* context = (MapData*) args;
+
+            for (long i = begin; i < end; ++i) {
+                context->values[i] += 1;
+            }
+
+            pthread_mutex_lock(&context->mutex);
+            context->begins.push_back(begin);
+            context->ends.push_back(end);
+            pthread_mutex_unlock(&context->mutex);
+        }, &data, 5);
+
+        //The two chunks of the outer map keep both the workers busy while they execute the inner maps
+        data.taskSystem = &taskSystem;
+        data.outerStarted = 0;
+
+        taskSystem.parallelMap(data.values, sizeof(float), 1000, [](long begin, long end, void* args){
+            MapData* context = (MapData*) args;
+
+            //Wait for the other chunk, a chunk run by the caller stops waiting after a while
+            std::chrono::steady_clock::time_point limit = std::chrono::steady_clock::now() + std::chrono::milliseconds(100);
+            context->outerStarted++;
+            while (context->outerStarted < 2 && std::chrono::steady_clock::now() < limit)
+                std::this_thread::yield();
+
+            context->taskSystem->parallelMap(context->values + begin, sizeof(float), end - begin,
+                                             [](long begin, long end, void* args){
+                float* values = (float*) args;
+
+                for (long i = begin; i < end; ++i) {
+                    values[i] += 1;
+                }
+            }, context->values + begin, 4);
+        }, &data, 2);
+
+    }catch(std::exception& exe){
+        BOOST_TEST(false);
+    }
+
+    for (int i = 0; i < 1000; ++i) {
+        BOOST_TEST(data.values[i] == 2);
+    }
+
+    BOOST_TEST(data.begins.size() == 5);
+
+    for (unsigned int i = 0; i < data.begins.size(); ++i) {
+        if (data.begins[i] != 0)
+            BOOST_TEST(((unsigned long) (data.values + data.begins[i])) % 64 == 0);
+
+        if (data.ends[i] != 1000)
+            BOOST_TEST(((unsigned long) (data.values + data.ends[i])) % 64 == 0);
+    }
+}
+
+
+/**
+ * Test that parallelFor executes every index once in ranges not larger than the grain size,
+ * also when a parallelFor is nested in the body of an other one
+ */
+BOOST_AUTO_TEST_CASE(test_case_parallel_for_blocked_range){
+    struct ForData {
+        TaskSystem::TaskSystem* taskSystem;
+        std::atomic<int> visits[4096];
+        std::atomic<int> oversized;
+    };
+
+    static ForData data;
+
+    for (int i = 0; i < 4096; ++i) {
+        data.visits[i] = 0;
+    }
+    data.oversized = 0;
+
+    try {
+        TaskSystem::TaskSystem taskSystem(2);
+        data.taskSystem = &taskSystem;
+
+        taskSystem.parallelFor(TaskSystem::TaskSystem::BlockedRange(0, 4096, 100),
+                               [](TaskSystem::TaskSystem::BlockedRange* range, void* args){
+            ForData* context = (ForData*) args;
+
+            if (range->size() > 100)
+                context->oversized++;
+
+            for (long i = range->getBegin(); i < range->getEnd(); ++i) {
+                context->visits[i]++;
+            }
+        }, &data);
+
+        //Every range of the outer loop executes an inner loop on 64 indexes
+        taskSystem.parallelFor(TaskSystem::TaskSystem::BlockedRange(0, 64, 1),
+                               [](TaskSystem::TaskSystem::BlockedRange* range, void* args){
+            ForData* context = (ForData*) args;
+            long outer = range->getBegin();
+
+            context->taskSystem->parallelFor(TaskSystem::TaskSystem::BlockedRange(outer * 64, outer * 64 + 64, 8),
+                                             [](TaskSystem::TaskSystem::BlockedRange* range, void* args){
+                ForData* context = (ForData*) args;
+
+                for (long i = range->getBegin(); i < range->getEnd(); ++i) {
+                    context->visits[i]++;
+                }
+            }, context);
+        }, &data);
+
+    }catch(std::exception& exe){
+        BOOST_TEST(false);
+    }
+
+    for (int i = 0; i < 4096; ++i) {
+        BOOST_TEST(data.visits[i] == 2);
+    }
+    BOOST_TEST(data.oversized == 0);
+}
+
+/**
+ * Test that a 2D parallelFor covers every cell once with tiles not larger than the grain sizes
+ */
+BOOST_AUTO_TEST_CASE(test_case_parallel_for_blocked_range_2d){
+    struct TileData {
+        std::atomic<int> visits[300][50];
+        std::atomic<int> oversized;
+    };
+
+    static TileData data;
+
+    for (int i = 0; i < 300; ++i) {
+        for (int j = 0; j < 50; ++j) {
+            data.visits[i][j] = 0;
+        }
+    }
+    data.oversized = 0;
+
+    TaskSystem::TaskSystem::BlockedRange2D range(0, 300, 16, 0, 50, 16);
+    TaskSystem::TaskSystem::BlockedRange2D second = range.split();
+
+    //The rows have more grains than the columns
+    BOOST_TEST(range.getRows().getEnd() == 150);
+    BOOST_TEST(second.getCols().size() == 50);
+
+    try {
+        TaskSystem::TaskSystem taskSystem(2);
+
+        taskSystem.parallelFor(TaskSystem::TaskSystem::BlockedRange2D(0, 300, 16, 0, 50, 16),
+                               [](TaskSystem::TaskSystem::BlockedRange2D* tile, void* args){
+            TileData* context = (TileData*) args;
+
+            if (tile->getRows().size() > 16 || tile->getCols().size() > 16)
+                context->oversized++;
+
+            for (long i = tile->getRows().getBegin(); i < tile->getRows().getEnd(); ++i) {
+                for (long j = tile->getCols().getBegin(); j < tile->getCols().getEnd(); ++j) {
+                    context->visits[i][j]++;
+                }
+            }
+        }, &data);
+
+    }catch(std::exception& exe){
+        BOOST_TEST(false);
+    }
+
+    bool allOnce = true;
+    for (int i = 0; i < 300; ++i) {
+        for (int j = 0; j < 50; ++j) {
+            allOnce = allOnce && data.visits[i][j] == 1;
+        }
+    }
+
+    BOOST_TEST(allOnce);
+    BOOST_TEST(data.oversized == 0);
+}
+
+
+/**
+ * Element without a default constructor, sorted by key
+ */
+struct SortKey {
+    int key;
+
+    explicit SortKey(int key) : key(key) {}
+
+    bool operator<(const SortKey& other) const {
+        return key < other.key;
+    }
+};
+
+/**
+ * Test that parallelSort gives the same result of std::sort, also with a custom comparator
+ * and with elements that are not default constructible
+ */
+BOOST_AUTO_TEST_CASE(test_case_parallel_sort){
+    std::vector<int> values(100000);
+    unsigned int seed = 12345;
+
+    for (unsigned int i = 0; i < values.size(); ++i) {
+        seed = seed * 1103515245 + 12345;
+        values[i] = (int) (seed >> 8) % 50000;
+    }
+
+    std::vector<int> expected(values);
+    std::sort(expected.begin(), expected.end());
+
+    std::vector<int> descending(values);
+
+    std::vector<SortKey> keys;
+    for (unsigned int i = 0; i < values.size(); ++i) {
+        keys.push_back(SortKey(values[i]));
+    }
+
+    try {
+        TaskSystem::TaskSystem taskSystem(2);
+
+        TaskSystem::parallelSort(&taskSystem, values.begin(), values.end(), std::less<int>(), 1000);
+        TaskSystem::parallelSort(&taskSystem, descending.begin(), descending.end(), std::greater<int>(), 777);
+        TaskSystem::parallelSort(&taskSystem, keys.begin(), keys.end(), std::less<SortKey>(), 5000);
+
+    }catch(std::exception& exe){
+        BOOST_TEST(false);
+    }
+
+    BOOST_TEST((values == expected));
+    BOOST_TEST(std::is_sorted(descending.begin(), descending.end(), std::greater<int>()));
+
+    bool keysSorted = keys.size() == expected.size();
+    for (unsigned int i = 0; keysSorted && i < keys.size(); ++i) {
+        keysSorted = keys[i].key == expected[i];
+    }
+    BOOST_TEST(keysSorted);
+}
+
+/**
+ * Test that parallelMerge merges two sorted ranges keeping the elements of the first range before the equal ones of the second
+ */
+BOOST_AUTO_TEST_CASE(test_case_parallel_merge){
+    std::vector<std::pair<int, int>> first, second, merged(30000);
+
+    for (int i = 0; i < 10000; ++i) {
+        first.push_back(std::pair<int, int>(i * 2, 1));
+    }
+    for (int i = 0; i < 20000; ++i) {
+        second.push_back(std::pair<int, int>(i, 2));
+    }
+
+    try {
+        TaskSystem::TaskSystem taskSystem(2);
+
+        TaskSystem::parallelMerge(&taskSystem, first.begin(), first.end(), second.begin(), second.end(), merged.begin(),
+                                  [](const std::pair<int, int>& a, const std::pair<int, int>& b){
+            return a.first < b.first;
+        }, 1000);
+
+    }catch(std::exception& exe){
+        BOOST_TEST(false);
+    }
+
+    bool ordered = true;
+    for (unsigned int i = 1; i < merged.size(); ++i) {
+        ordered = ordered && (merged[i - 1].first < merged[i].first ||
+                              (merged[i - 1].first == merged[i].first && merged[i - 1].second <= merged[i].second));
+    }
+
+    BOOST_TEST(ordered);
+    BOOST_TEST(merged.back().first == 19999);
+}
+
+
+/****************************************************************
+ *  UTILITY TESTS
+ ****************************************************************/
+
+/**
+ * Test that the spliEqually function work with a number of workers multiple
+ * of the total work
+ */
+BOOST_AUTO_TEST_CASE(test_case_split_equally_work_multiple_of_workers){
+
+    std::vector<std::pair<unsigned long, unsigned long>> pairs;
+
+    TaskSystem::splitEqually(100,5,&pairs);
+
+    for (int i = 0; i < 5; ++i) {
+        unsigned long diff = pairs.at(i).second - pairs.at(i).first;
+
+        BOOST_TEST(diff == 100 / 5 - 1);
+    }
+}
+
+/**
+ * Test that the spliEqually function work with a number of workers that is not
+ * multiple of the total work
+ */
+BOOST_AUTO_TEST_CASE(test_case_split_equally_work_not_multiple_of_workers){
+
+    std::vector<std::pair<unsigned long, unsigned long>> pairs;
+
+    TaskSystem::splitEqually(100,6,&pairs);
+
+    for (int i = 0; i < 6; ++i) {
+        unsigned long diff = pairs.at(i).second - pairs.at(i).first;
+
+        if (i < 100 % 6)
+            BOOST_TEST(diff == 100 / 6);
+        else
+            BOOST_TEST(diff == 100 / 6 - 1);
+    }
+
+}
+
+/**
+ * Test that the splitAligned function covers all the work with contiguous bounds
+ * that fall on the blocks after the head
+ */
+BOOST_AUTO_TEST_CASE(test_case_split_aligned){
+
+    std::vector<std::pair<long, long>> pairs;
+
+    TaskSystem::splitAligned(1000, 6, 5, 16, &pairs);
+
+    BOOST_TEST(pairs.at(0).first == 0);
+    BOOST_TEST(pairs.at(5).second == 999);
+
+    for (int i = 1; i < 6; ++i) {
+        BOOST_TEST(pairs.at(i).first == pairs.at(i - 1).second + 1);
+        BOOST_TEST((pairs.at(i).first - 5) % 16 == 0);
+    }
 }
\ No newline at end of file